@@ -0,0 +1,88 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/filter.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include "chn_filter.h"
+
+#define UDP_HDR_LEN 8
+#define IP_SADDR_OFF 12 // IPv4 头中源地址的偏移
+
+/*
+UDP socket 上的过滤器从 UDP 头开始看报文，负偏移 SKF_NET_OFF 访问 IP 头：
+  ld  [net + 12]        源地址
+  jeq server_ip
+  ldh [0]               源端口
+  jeq server_port
+  ldb [8]               负载第一个字节
+  jeq LISTCHNID         -> 放行节目单
+  ldh [8 + 12]          packet_header.channel_id
+  jeq chn[0]            -> 放行
+  ...
+  jeq chn[n-1]          -> 放行
+  ret -1                放行
+  ret 0                 丢弃
+CHN_FILTER_ALL 时在端口匹配之后直接跳到放行。
+*/
+int chn_filter_attach_set(int sd, const struct sockaddr_in *server, const int *chn, int n) {
+    struct sock_filter code[9 + CHN_FILTER_MAX];
+    struct sock_fprog prog = {.filter = code};
+    int pc = 0, accept, drop;
+
+    if (n < 1 || n > CHN_FILTER_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    accept = 7 + n;
+    drop = accept + 1;
+    // 跳转偏移相对于下一条指令
+#define JUMP_TO(target) ((target) - pc - 1)
+    code[pc] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + IP_SADDR_OFF);
+    pc++;
+    code[pc] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                            ntohl(server->sin_addr.s_addr), 0, JUMP_TO(drop));
+    pc++;
+    code[pc] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 0);
+    pc++;
+    code[pc] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(server->sin_port),
+                                            0, JUMP_TO(drop));
+    pc++;
+    if (chn[0] == CHN_FILTER_ALL)
+        code[pc] = (struct sock_filter)BPF_STMT(BPF_JMP | BPF_JA, JUMP_TO(accept));
+    else
+        code[pc] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, UDP_HDR_LEN);
+    pc++;
+    code[pc] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, LISTCHNID,
+                                            JUMP_TO(accept), 0);
+    pc++;
+    code[pc] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H | BPF_ABS,
+                                            UDP_HDR_LEN + offsetof(struct packet_header, channel_id));
+    pc++;
+    for (int i = 0; i < n; i++, pc++) {
+        code[pc] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, chn[i],
+                                                JUMP_TO(accept), i == n - 1 ? JUMP_TO(drop) : 0);
+    }
+#undef JUMP_TO
+    code[pc++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff); // 放行整个报文
+    code[pc++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);          // 丢弃
+    prog.len = pc;
+
+    // SO_ATTACH_FILTER 在内核里原子地替换已有的过滤器
+    return setsockopt(sd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+int chn_filter_attach(int sd, const struct sockaddr_in *server, int chnid) {
+    return chn_filter_attach_set(sd, server, &chnid, 1);
+}
+
+int chn_filter_drop_all(int sd) {
+    struct sock_filter code[] = {BPF_STMT(BPF_RET | BPF_K, 0)};
+    struct sock_fprog prog = {.len = 1, .filter = code};
+
+    return setsockopt(sd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+int chn_filter_detach(int sd) {
+    int dummy = 0;
+    return setsockopt(sd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy));
+}
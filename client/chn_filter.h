@@ -0,0 +1,24 @@
+#ifndef CHN_FILTER_H_
+#define CHN_FILTER_H_
+#include <netinet/in.h>
+#include "../include/proto.h"
+
+/*
+内核里的频道过滤：所有频道共用一个多播组，不过滤的话内核会把每个频道的报文都拷到用户态。
+给 socket 挂一个经典 BPF 过滤器，只放行来自 server 地址和端口、
+且是节目单（首字节 LISTCHNID）或者 channel_id == chnid 的报文，其余在内核里直接丢弃。
+chnid 为 CHN_FILTER_ALL 时放行 server 的所有报文（多频道录制）。
+再次调用会原子地替换旧的过滤器（换台时用），不会有没有过滤器的空窗。
+成功返回 0，失败返回 -1 并设置 errno，调用者可以继续只靠用户态检查。
+*/
+#define CHN_FILTER_ALL (-1)
+#define CHN_FILTER_MAX 32 // chn_filter_attach_set 最多放行的频道数
+
+int chn_filter_attach(int sd, const struct sockaddr_in *server, int chnid);
+// 放行 chn[0..n) 中的任一频道（换台时预收相邻频道用）
+int chn_filter_attach_set(int sd, const struct sockaddr_in *server, const int *chn, int n);
+// 丢弃所有报文，套接字只用来保持组播成员关系（另有映射环收包时）
+int chn_filter_drop_all(int sd);
+int chn_filter_detach(int sd);
+
+#endif
@@ -0,0 +1,123 @@
+/*
+频道过滤器自测：在回环地址上用一个"服务端"和一个陌生的发送端发包，
+检查挂上过滤器后只有服务端的节目单和所选频道的报文能到达，
+以及换台时重新挂过滤器立即生效、多频道、全频道和全部丢弃的过滤器的放行范围。
+*/
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../include/proto.h"
+#include "chn_filter.h"
+
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static int udp_socket(struct sockaddr_in *addr) {
+    socklen_t len = sizeof(*addr);
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (sd < 0 || bind(sd, (void *)addr, sizeof(*addr)) < 0 ||
+        getsockname(sd, (void *)addr, &len) < 0) {
+        perror("udp_socket");
+        return -1;
+    }
+    return sd;
+}
+
+static void send_list(int from, const struct sockaddr_in *to) {
+    struct msg_list_st list = {.chnid = LISTCHNID, .type = LIST_TYPE_BEACON};
+    sendto(from, &list, MSG_LIST_HDR, 0, (void *)to, sizeof(*to));
+}
+
+static void send_data(int from, const struct sockaddr_in *to, int chnid, int len) {
+    static char buf[MSG_CHANNEL_MAX];
+    struct msg_channel_st *msg = (void *)buf;
+
+    memset(buf, 0, sizeof(buf));
+    msg->hdr.magic = htonl(PACKET_MAGIC);
+    msg->hdr.channel_id = htons(chnid);
+    sendto(from, buf, sizeof(struct packet_header) + len, 0, (void *)to, sizeof(*to));
+}
+
+// 收完队列中所有报文，返回个数
+static int drain(int sd) {
+    static char buf[MSG_CHANNEL_MAX];
+    int n = 0;
+
+    usleep(10000);
+    while (recv(sd, buf, sizeof(buf), MSG_DONTWAIT) >= 0)
+        n++;
+    return n;
+}
+
+int main(void) {
+    struct sockaddr_in raddr, saddr, faddr;
+    int rsd = udp_socket(&raddr);
+    int server = udp_socket(&saddr);
+    int foreign = udp_socket(&faddr);
+
+    if (rsd < 0 || server < 0 || foreign < 0) return 1;
+    drain(rsd);
+
+    check(chn_filter_attach(rsd, &saddr, 5) == 0, "attach filter");
+    send_list(server, &raddr);
+    send_data(server, &raddr, 5, 100);
+    send_data(server, &raddr, 5, 40000); // 分片的大报文
+    check(drain(rsd) == 3, "list and chosen channel must pass");
+
+    send_data(server, &raddr, 6, 100);
+    send_data(server, &raddr, 200, 40000);
+    send_data(foreign, &raddr, 5, 100);
+    send_list(foreign, &raddr);
+    check(drain(rsd) == 0, "other channels and foreign senders must be dropped");
+
+    // 换台：原子替换过滤器
+    check(chn_filter_attach(rsd, &saddr, 6) == 0, "replace filter");
+    send_data(server, &raddr, 5, 100);
+    send_data(server, &raddr, 6, 100);
+    check(drain(rsd) == 1, "replaced filter must follow the new channel");
+
+    // 多频道录制：服务端的所有报文都放行
+    check(chn_filter_attach(rsd, &saddr, CHN_FILTER_ALL) == 0, "attach all-channel filter");
+    send_list(server, &raddr);
+    send_data(server, &raddr, 5, 100);
+    send_data(server, &raddr, 200, 40000);
+    send_data(foreign, &raddr, 5, 100);
+    check(drain(rsd) == 3, "all-channel filter must pass every server packet only");
+
+    // 换台预收：所选频道和相邻频道都放行
+    int set[] = {6, 5, 7};
+    check(chn_filter_attach_set(rsd, &saddr, set, 3) == 0, "attach channel set");
+    send_list(server, &raddr);
+    send_data(server, &raddr, 5, 100);
+    send_data(server, &raddr, 7, 40000);
+    send_data(server, &raddr, 8, 100);
+    send_data(foreign, &raddr, 6, 100);
+    check(drain(rsd) == 3, "channel set must pass the list and listed channels only");
+
+    check(chn_filter_drop_all(rsd) == 0, "attach drop-all filter");
+    send_list(server, &raddr);
+    send_data(server, &raddr, 5, 100);
+    check(drain(rsd) == 0, "drop-all filter must pass nothing");
+
+    check(chn_filter_detach(rsd) == 0, "detach filter");
+    send_data(foreign, &raddr, 7, 100);
+    check(drain(rsd) == 1, "detached socket must receive everything");
+
+    close(rsd);
+    close(server);
+    close(foreign);
+    printf("chn_filter: failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
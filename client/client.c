@@ -1,3 +1,4 @@
+#define _GNU_SOURCE          // setsourcefilter()
 #include <getopt.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
@@ -17,65 +18,469 @@
 #include <string.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <signal.h>
 #include <sys/time.h>
+#include <time.h>
 #include "recv_thr.h"
 #include "writer_thr.h"
 #include "stat_thr.h"
+#include "../include/crc32c.h"
+#include "jitter_buf.h"
+#include "chn_filter.h"
+#include "recorder.h"
+#include "relay.h"
+#include "relay_thr.h"
+#include "list_cache.h"
 
 /*
 -M --mgroup specify multicast group
+-s --source join the group only for this sender (source-specific multicast)
 -P --port specify receive port
 -p --player specify player
+-o --output player, stdout, null or file:PATH
+-L --latency jitter buffer target latency in ms
+-r --record record channels into a directory (headless)
+-m --monitor only measure channels (headless)
+-c --channels channels for record/monitor: all or 1,3,10-20
+-w --workers worker threads for record/monitor
+-E --engine socket or packet[:IFNAME] receive engine for record/monitor
+-R --relay publish all channels to local players through shared memory (headless)
+-A --attach play from a local relay instead of the network
+-K --list-cache programme list cache file, or off
+-b --busy-poll spin budget in microseconds before blocking
+-C --cpu pin the receiver thread to a cpu
+-W --watermark low:high[:batch] prebuffer watermarks in ms
+-Z --zap-neighbors keep a rolling buffer of N neighbour channels per side
+-S --metrics serve Prometheus metrics on a unix socket path or [host:]port
 -H --help show help
 */
 struct client_conf_st client_conf = {.rcvport = DEFAULT_RCVPORT,
                                      .mgroup = DEFAULT_MGROUP,
-                                     .player_cmd = DEFAULT_PLAYERCMD};
+                                     .source = NULL,
+                                     .player_cmd = DEFAULT_PLAYERCMD,
+                                     .output = DEFAULT_OUTPUT,
+                                     .latency_ms = JITTER_DEFAULT_MS,
+                                     .busy_poll_us = 0,
+                                     .cpu = -1,
+                                     .low_ms = WRITER_LOW_MS,
+                                     .high_ms = WRITER_HIGH_MS,
+                                     .batch_ms = WRITER_BATCH_MS,
+                                     .zap_neighbors = 0,
+                                     .metrics_addr = NULL,
+                                     .attach = NULL,
+                                     .list_cache = NULL};
 
 static void print_help() {
     printf("-P --port   specify receive port\n");
     printf("-M --mgroup specify multicast group\n");
-    printf("-p --player specify player \n");
+    printf("-s --source ADDR join the group for this sender only (SSM); by default the client\n"
+           "            joins any-source and narrows to the server found in the list\n");
+    printf("-p --player specify player command (run without a shell, default \"%s\")\n",
+           DEFAULT_PLAYERCMD);
+    printf("-o --output where audio goes: player, stdout, null or file:PATH (default %s)\n",
+           DEFAULT_OUTPUT);
+    printf("-L --latency jitter buffer target latency in ms (default %d, %d when resuming\n"
+           "             from the list cache)\n", JITTER_DEFAULT_MS, JITTER_RESUME_MS);
+    printf("-r --record   record channels into DIR/chNNN.mp3, no player\n");
+    printf("-m --monitor  only report per-channel bitrate, loss and jitter\n");
+    printf("-c --channels channels to record/monitor: all or 1,3,10-20 (default all)\n");
+    printf("-w --workers  worker threads for record/monitor (default online cpus)\n");
+    printf("-E --engine   record/monitor receive engine: socket (recvmmsg, default) or\n"
+           "              packet[:IFNAME] (AF_PACKET TPACKET_V3 ring, needs CAP_NET_RAW)\n");
+    printf("-R --relay PATH  receive all channels once and serve them to local players on the\n"
+           "                 unix socket PATH through shared memory, no player\n");
+    printf("-A --attach PATH play from the relay on PATH instead of joining the group\n");
+    printf("-K --list-cache PATH|off  programme list cache shown at startup before the live list\n"
+           "                 arrives; playback resumes on the last channel without asking\n"
+           "                 (default $XDG_CACHE_HOME/netradio/GROUP-PORT.list)\n");
+    printf("-b --busy-poll spin up to USEC microseconds before blocking (default 0, off)\n");
+    printf("-C --cpu    pin the receiver thread to cpu N\n");
+    printf("-W --watermark LOW:HIGH[:BATCH] start/resume playback once HIGH ms are buffered,\n"
+           "               rebuffer when the player has had LOW ms or less for over BATCH ms,\n"
+           "               write every BATCH ms\n"
+           "               (default %d:%d:%d, HIGH is %d when resuming from the list cache)\n",
+           WRITER_LOW_MS, WRITER_HIGH_MS, WRITER_BATCH_MS, WRITER_RESUME_HIGH_MS);
+    printf("-Z --zap-neighbors N  prebuffer N neighbour channels on each side for instant switching\n");
+    printf("-S --metrics serve Prometheus metrics on /unix/path or [host:]port instead of printing stats\n");
     printf("-H --help   show help\n");
 }
 
-// 初始化环形缓冲区
-void ring_buffer_init(struct ring_buffer *rb) {
-    memset(rb->data, 0, RING_BUFFER_SIZE);
-    rb->head = 0;
-    rb->tail = 0;
-    rb->count = 0;
-    pthread_mutex_init(&rb->mutex, NULL);
-    pthread_cond_init(&rb->not_empty, NULL);
-    pthread_cond_init(&rb->not_full, NULL);
+// 加入组播组。给了源地址时做源特定加入（SSM，IGMPv3），失败就退回任意源加入；
+// 返回 1 表示源特定，0 表示任意源，-1 表示都失败
+static int mcast_join(int sd, const struct sockaddr_in *group, int ifindex, const char *source) {
+    struct group_source_req gsr = {.gsr_interface = ifindex};
+    struct sockaddr_in *src = (void *)&gsr.gsr_source;
+    struct ip_mreqn mreq = {.imr_multiaddr = group->sin_addr, .imr_ifindex = ifindex};
+
+    if (source != NULL) {
+        memcpy(&gsr.gsr_group, group, sizeof(*group));
+        src->sin_family = AF_INET;
+        if (inet_pton(AF_INET, source, &src->sin_addr) != 1) {
+            fprintf(stderr, "bad source address: %s\n", source);
+            exit(1);
+        }
+        if (setsockopt(sd, IPPROTO_IP, MCAST_JOIN_SOURCE_GROUP, &gsr, sizeof(gsr)) == 0) {
+            return 1;
+        }
+        perror("setsockopt MCAST_JOIN_SOURCE_GROUP, falling back to any-source join");
+    }
+    if (setsockopt(sd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("setsockopt IP_ADD_MEMBERSHIP");
+        return -1;
+    }
+    return 0;
+}
+
+// 任意源加入之后收窄到只收 source 发来的报文。MCAST_MSFILTER 一次把过滤模式从
+// “排除空集”换成“只含 source”，不用先退组再加入，中间不会漏包；失败时保持任意源
+int mcast_narrow(int sd, const struct sockaddr_in *group, int ifindex,
+                 const struct sockaddr_in *source) {
+    struct sockaddr_storage slist = {0};
+
+    memcpy(&slist, source, sizeof(*source));
+    ((struct sockaddr_in *)&slist)->sin_port = 0;
+    return setsourcefilter(sd, ifindex, (const void *)group, sizeof(*group), MCAST_INCLUDE, 1,
+                           &slist);
+}
+
+// 检查一页节目单：类型和每个节目项的长度，成功返回 0
+int list_check(const struct msg_list_st *msg_list, int len) {
+    const struct msg_listentry_st *pos;
+    
+    if (len < (int)MSG_LIST_HDR || msg_list->chnid != LISTCHNID ||
+        msg_list->type != LIST_TYPE_FULL || msg_list->pages == 0 ||
+        msg_list->page >= msg_list->pages) {
+        return -1;
+    }
+    for (pos = msg_list->entry; (char *)pos < (char *)msg_list + len;
+         pos = (void *)((char *)pos + ntohs(pos->len))) {
+        if (ntohs(pos->len) < sizeof(struct msg_listentry_st) ||
+            (char *)pos + ntohs(pos->len) > (char *)msg_list + len) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
+void list_asm_free(struct list_asm_st *la) {
+    for (int i = 0; i < LIST_PAGES_MAX; i++) {
+        free(la->page[i]);
+    }
+    memset(la, 0, sizeof(*la));
+}
+
+/*
+增量拼装节目单：页可以乱序、分多轮收齐，版本或哈希变化时重新开始。
+收齐并通过哈希校验后返回 1，*out 指向拼好的完整节目单（调用者 free），*outlen 为长度；
+还没收齐返回 0，坏页返回 -1。
+*/
+int list_asm_add(struct list_asm_st *la, const struct msg_list_st *msg_list, int len,
+                 struct msg_list_st **out, int *outlen) {
+    struct msg_list_st *whole;
+    int total = MSG_LIST_HDR;
+    char *p;
+    
+    if (list_check(msg_list, len) != 0) {
+        return -1;
+    }
+    if (la->pages != msg_list->pages || la->version != ntohl(msg_list->version) ||
+        la->hash != ntohl(msg_list->hash)) {
+        list_asm_free(la);
+        la->pages = msg_list->pages;
+        la->version = ntohl(msg_list->version);
+        la->hash = ntohl(msg_list->hash);
+    }
+    if (la->page[msg_list->page] == NULL) {
+        la->page[msg_list->page] = malloc(len - MSG_LIST_HDR);
+        if (la->page[msg_list->page] == NULL) {
+            return -1;
+        }
+        memcpy(la->page[msg_list->page], msg_list->entry, len - MSG_LIST_HDR);
+        la->len[msg_list->page] = len - MSG_LIST_HDR;
+        la->got++;
+    }
+    if (la->got < la->pages) {
+        return 0;
+    }
+    
+    for (int i = 0; i < la->pages; i++) {
+        total += la->len[i];
+    }
+    whole = malloc(total);
+    if (whole == NULL) {
+        return -1;
+    }
+    memcpy(whole, msg_list, MSG_LIST_HDR);
+    whole->page = 0;
+    whole->pages = 1;
+    p = (char *)whole->entry;
+    for (int i = 0; i < la->pages; i++) {
+        memcpy(p, la->page[i], la->len[i]);
+        p += la->len[i];
+    }
+    if (crc32c(0, whole->entry, total - MSG_LIST_HDR) != la->hash) {
+        // 各页来自不同内容的节目单，全部丢弃重新收
+        free(whole);
+        list_asm_free(la);
+        return -1;
+    }
+    list_asm_free(la);
+    *out = whole;
+    *outlen = total;
+    return 1;
+}
+
+// 显示频道列表（需先通过 list_check 或 list_asm_add）
+void list_print(const struct msg_list_st *msg_list, int len) {
+    const struct msg_listentry_st *pos;
+    for (pos = msg_list->entry; (char *)pos < ((char *)msg_list + len);
+         pos = (void *)((char *)pos + ntohs(pos->len))) {
+        printf("channel:%d:%s\n", pos->chnid, pos->desc);
+    }
+}
+
+static struct shared_data *running; // 信号处理函数要停的那份共享数据
+
+// Ctrl+C 或 SIGTERM：让各线程退出，主线程再关闭输出端（文件输出写出缓冲区的尾巴）
+static void stop_handler(int s) {
+    running->stop_flag = true;
+}
+
+// 只让主线程接收停止信号，好打断它读标准输入；创建完线程后由调用者解除 stop_set 的屏蔽
+static void catch_stop(struct shared_data *shared, sigset_t *stop_set) {
+    struct sigaction sa;
+
+    running = shared;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigemptyset(stop_set);
+    sigaddset(stop_set, SIGINT);
+    sigaddset(stop_set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, stop_set, NULL);
+}
+
+static long long mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 从标准输入读一个频道号；def 是上次收听的频道，直接回车就选它，没有时为 -1
+static int choose_channel(int def) {
+    char line[64];
+    int chosenid;
+
+    if (def >= MINCHNID && def <= MAXCHNID) {
+        printf("请输入您想要的频道号（回车收听上次的 %d）: ", def);
+    } else {
+        def = -1;
+        printf("请输入您想要的频道号: ");
+    }
+    fflush(stdout);
+    while (1) {
+        if (fgets(line, sizeof(line), stdin) == NULL) {
+            exit(1);
+        }
+        if (def >= 0 && line[strspn(line, " \t\r\n")] == '\0') {
+            chosenid = def;
+            break;
+        }
+        if (sscanf(line, "%d", &chosenid) == 1) {
+            break;
+        }
+        printf("输入无效！请重新输入一个整数频道号: ");
+        fflush(stdout);
+    }
+    
+    printf("您选择了频道号: %d\n", chosenid);
+    if (chosenid < MINCHNID || chosenid > MAXCHNID) {
+        fprintf(stderr, "channel id is not match.\n");
+        exit(1);
+    }
+    return chosenid;
+}
+
+/*
+播放过程中从标准输入读换台命令：频道号，或者 +/- 换到下一个/上一个频道（环绕）。
+只是把请求交给接收线程，读到文件结束就返回。
+*/
+static void command_loop(struct shared_data *shared) {
+    char line[64];
+    int chnid, current = shared->chosen_channel;
+    struct timespec ts;
+    
+    // 信号没有 SA_RESTART，fgets 被打断后返回 NULL
+    while (!shared->stop_flag && fgets(line, sizeof(line), stdin) != NULL) {
+        if (line[0] == '+') {
+            chnid = current == MAXCHNID ? MINCHNID : current + 1;
+        } else if (line[0] == '-') {
+            chnid = current == MINCHNID ? MAXCHNID : current - 1;
+        } else if (sscanf(line, "%d", &chnid) != 1) {
+            continue;
+        }
+        if (chnid < MINCHNID || chnid > MAXCHNID) {
+            fprintf(stderr, "channel id is not match.\n");
+            continue;
+        }
+        current = chnid;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        atomic_store(&shared->zap_start_us, (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+        atomic_store(&shared->zap_request, chnid);
+    }
+}
+
+// 从组播收一份完整的节目单（按页拼装），返回整张节目单（malloc），*server_addr 为发送它的服务器
+static struct msg_list_st *list_receive(int sd, struct sockaddr_in *server_addr, int *plen) {
+    struct msg_list_st *msg_list;
+    struct list_asm_st list_asm = {0};
+    struct msg_list_st *whole_list = NULL;
+    socklen_t serveraddr_len;
+    int len;
+    
+    msg_list = malloc(MSG_LIST_MAX);
+    if (msg_list == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    serveraddr_len = sizeof(*server_addr);
+    while (1) {
+        len = recvfrom(sd, msg_list, MSG_LIST_MAX, 0, (void *)server_addr, &serveraddr_len);
+        
+        if (len < (int)MSG_LIST_HDR) {
+            fprintf(stderr, "message is too short.\n");
+            continue;
+        }
+        
+        if (msg_list->chnid != LISTCHNID) {
+            continue; // 频道数据包
+        }
+        // 信标只有版本号，等待完整节目单
+        if (msg_list->type == LIST_TYPE_BEACON) {
+            continue;
+        }
+        int ret = list_asm_add(&list_asm, msg_list, len, &whole_list, plen);
+        if (ret < 0) {
+            fprintf(stderr, "bad list page, ignored.\n");
+            continue;
+        }
+        if (ret == 0) {
+            continue; // 还没收齐
+        }
+        fprintf(stderr, "server_addr: %s\n", inet_ntoa(server_addr->sin_addr));
+        fprintf(stderr, "chnid is matched current chnid:%d, list version:%u.\n",
+                whole_list->chnid, ntohl(whole_list->version));
+        break;
+    }
+    free(msg_list);
+    return whole_list;
+}
+
+/*
+接入本机中继（-A）：不开套接字也不入组，节目单和所有频道都在中继的共享内存里，
+只有一个读者线程把选中的频道交给输出端，接收端的统计在中继那边看。
+*/
+static int attach_run(struct shared_data *shared) {
+    struct relay_rd_st rd;
+    const struct msg_list_st *msg_list;
+    pthread_t reader_tid;
+    sigset_t stop_set;
+    bool gone;
+    int len;
+
+    if (relay_attach(&rd, client_conf.attach) < 0) {
+        fprintf(stderr, "cannot attach to relay %s: %s\n", client_conf.attach, strerror(errno));
+        return 1;
+    }
+    msg_list = relay_list(&rd, &len);
+    if (list_check(msg_list, len) != 0) {
+        fprintf(stderr, "bad list from relay %s\n", client_conf.attach);
+        relay_detach(&rd);
+        return 1;
+    }
+    list_print(msg_list, len);
+    
+    shared->relay = &rd;
+    shared->chosen_channel = choose_channel(-1);
+    shared->start_us = mono_us();
+    shared->list_version = ntohl(msg_list->version);
+    shared->stop_flag = false;
+    atomic_init(&shared->zap_request, -1);
+    
+    catch_stop(shared, &stop_set);
+    if (pthread_create(&reader_tid, NULL, relay_reader_thread, shared) != 0) {
+        perror("pthread_create relay reader");
+        return 1;
+    }
+    pthread_sigmask(SIG_UNBLOCK, &stop_set, NULL);
+    
+    printf("Attached to relay %s. Enter a channel number, + or - to switch, Ctrl+C to exit.\n",
+           client_conf.attach);
+    command_loop(shared);
+    shared->stop_flag = true;
+    pthread_join(reader_tid, NULL);
+    gone = !relay_alive(&rd);
+    
+    sink_close(&shared->sink);
+    relay_detach(&rd);
+    return gone ? 1 : 0;
+}
 
 int main(int argc, char *argv[]) {
     int index = 0;
     int sd = 0;
-    struct ip_mreqn mreq;
+    struct sockaddr_in group = {.sin_family = AF_INET};
+    int ifindex, ssm;
     struct sockaddr_in laddr;
-    int pd[2];
-    pid_t pid;
     struct sockaddr_in server_addr;
-    socklen_t serveraddr_len;
     int len;
     int chosenid;
     struct msg_list_st *msg_list;
+    char cache_path[4096] = "";
+    int last_chn = -1;
+    bool cached = false;
+    bool latency_set = false, watermark_set = false; // 命令行给了 -L、-W，续播时不换默认值
+    long long start_us = mono_us();
     
     // 线程变量
-    pthread_t receiver_tid, writer_tid, stats_tid;
+    pthread_t receiver_tid, writer_tid, stats_tid, metrics_tid;
+    sigset_t stop_set;
     struct shared_data shared_data = {0};
     
+    // 无界面录制/监控模式
+    bool headless = false;
+    static struct recorder_conf_st rec_conf = {.report_sec = RECORDER_REPORT_SEC};
+    recorder_parse_channels("all", rec_conf.chn);
+    rec_conf.workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (rec_conf.workers < 1) rec_conf.workers = 1;
+    if (rec_conf.workers > RECORDER_WORKERS_MAX) rec_conf.workers = RECORDER_WORKERS_MAX;
+    
     struct option argarr[] = {{"port", 1, NULL, 'P'},
                               {"mgroup", 1, NULL, 'M'},
+                              {"source", 1, NULL, 's'},
                               {"player", 1, NULL, 'p'},
+                              {"output", 1, NULL, 'o'},
+                              {"latency", 1, NULL, 'L'},
+                              {"record", 1, NULL, 'r'},
+                              {"monitor", 0, NULL, 'm'},
+                              {"channels", 1, NULL, 'c'},
+                              {"workers", 1, NULL, 'w'},
+                              {"engine", 1, NULL, 'E'},
+                              {"relay", 1, NULL, 'R'},
+                              {"attach", 1, NULL, 'A'},
+                              {"list-cache", 1, NULL, 'K'},
+                              {"busy-poll", 1, NULL, 'b'},
+                              {"cpu", 1, NULL, 'C'},
+                              {"watermark", 1, NULL, 'W'},
+                              {"zap-neighbors", 1, NULL, 'Z'},
+                              {"metrics", 1, NULL, 'S'},
                               {"help", 0, NULL, 'H'},
                               {NULL, 0, NULL, 0}};
     int c;
     while (1) {
-        c = getopt_long(argc, argv, "P:M:p:H", argarr, &index);
+        c = getopt_long(argc, argv, "P:M:s:p:o:L:r:mc:w:E:R:A:K:b:C:W:Z:S:H", argarr, &index);
         if (c < 0) break;
         switch (c) {
         case 'P':
@@ -84,9 +489,100 @@ int main(int argc, char *argv[]) {
         case 'M':
             client_conf.mgroup = optarg;
             break;
+        case 's':
+            client_conf.source = optarg;
+            break;
         case 'p':
             client_conf.player_cmd = optarg;
             break;
+        case 'o':
+            client_conf.output = optarg;
+            break;
+        case 'L':
+            client_conf.latency_ms = atoi(optarg);
+            latency_set = true;
+            if (client_conf.latency_ms < 0) {
+                fprintf(stderr, "latency must not be negative.\n");
+                exit(1);
+            }
+            break;
+        case 'r':
+            headless = true;
+            rec_conf.dir = optarg;
+            break;
+        case 'm':
+            headless = true;
+            rec_conf.dir = NULL;
+            break;
+        case 'c':
+            if (recorder_parse_channels(optarg, rec_conf.chn) < 0) {
+                fprintf(stderr, "bad channel list: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'w':
+            rec_conf.workers = atoi(optarg);
+            if (rec_conf.workers < 1 || rec_conf.workers > RECORDER_WORKERS_MAX) {
+                fprintf(stderr, "workers must be 1..%d.\n", RECORDER_WORKERS_MAX);
+                exit(1);
+            }
+            break;
+        case 'E':
+            if (strcmp(optarg, "socket") == 0) {
+                rec_conf.ring = false;
+            } else if (strncmp(optarg, "packet", 6) == 0 && (optarg[6] == '\0' || optarg[6] == ':')) {
+                rec_conf.ring = true;
+                rec_conf.ring_if = optarg[6] == ':' ? optarg + 7 : NULL;
+            } else {
+                fprintf(stderr, "bad engine: %s (want socket or packet[:IFNAME])\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'R':
+            headless = true;
+            rec_conf.relay = optarg;
+            break;
+        case 'A':
+            client_conf.attach = optarg;
+            break;
+        case 'K':
+            client_conf.list_cache = optarg;
+            break;
+        case 'b':
+            client_conf.busy_poll_us = atoi(optarg);
+            if (client_conf.busy_poll_us < 0) {
+                fprintf(stderr, "busy-poll budget must not be negative.\n");
+                exit(1);
+            }
+            break;
+        case 'C':
+            client_conf.cpu = atoi(optarg);
+            if (client_conf.cpu < 0) {
+                fprintf(stderr, "cpu must not be negative.\n");
+                exit(1);
+            }
+            break;
+        case 'W':
+            watermark_set = true;
+            client_conf.batch_ms = WRITER_BATCH_MS;
+            if (sscanf(optarg, "%d:%d:%d", &client_conf.low_ms, &client_conf.high_ms,
+                       &client_conf.batch_ms) < 2 ||
+                client_conf.low_ms < 0 || client_conf.high_ms < client_conf.low_ms ||
+                client_conf.batch_ms < 0) {
+                fprintf(stderr, "bad watermarks: %s (want LOW:HIGH[:BATCH], LOW <= HIGH)\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'Z':
+            client_conf.zap_neighbors = atoi(optarg);
+            if (client_conf.zap_neighbors < 0 || client_conf.zap_neighbors > ZAP_NEIGHBORS_MAX) {
+                fprintf(stderr, "zap-neighbors must be 0..%d.\n", ZAP_NEIGHBORS_MAX);
+                exit(1);
+            }
+            break;
+        case 'S':
+            client_conf.metrics_addr = optarg;
+            break;
         case 'H':
             print_help();
             exit(0);
@@ -97,19 +593,37 @@ int main(int argc, char *argv[]) {
         }
     }
     
-    // 创建socket
-    sd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (client_conf.attach != NULL && headless) {
+        fprintf(stderr, "-A cannot be combined with -r, -m or -R.\n");
+        exit(1);
+    }
+    
+    // 先打开输出端：输出到标准输出时，下面打印的节目单等信息都要改走标准错误。
+    // 播放器用 posix_spawnp 直接启动；无界面模式不需要输出端
+    if (!headless &&
+        sink_open(&shared_data.sink, client_conf.output, client_conf.player_cmd) < 0) {
+        fprintf(stderr, "cannot open output %s: %s\n", client_conf.output, strerror(errno));
+        exit(1);
+    }
+    if (client_conf.attach != NULL) {
+        exit(attach_run(&shared_data));
+    }
+    
+    // 创建socket（播放器进程不继承）
+    sd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
     if (sd < 0) {
         perror("socket()");
         exit(1);
     }
     
-    // 设置组播
-    inet_pton(AF_INET, client_conf.mgroup, &mreq.imr_multiaddr);
-    inet_pton(AF_INET, "0.0.0.0", &mreq.imr_address);
-    mreq.imr_ifindex = if_nametoindex("ens33");
-    if (setsockopt(sd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
-        perror("setsockopt IP_ADD_MEMBERSHIP");
+    // 设置组播：交换机和内核按源过滤，别的发送者的报文到不了这里
+    if (inet_pton(AF_INET, client_conf.mgroup, &group.sin_addr) != 1) {
+        fprintf(stderr, "bad multicast group: %s\n", client_conf.mgroup);
+        exit(1);
+    }
+    ifindex = if_nametoindex("ens33");
+    ssm = mcast_join(sd, &group, ifindex, client_conf.source);
+    if (ssm < 0) {
         exit(1);
     }
     
@@ -119,11 +633,12 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
     
-    // 设置更大的UDP接收缓冲区
-    int rcvbuf_size = 2 * 1024 * 1024; // 2MB
-    if (setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &rcvbuf_size, sizeof(rcvbuf_size)) < 0) {
-        perror("setsockopt SO_RCVBUF");
+    // 设置更大的UDP接收缓冲区，内核丢包时接收线程还会继续加大
+    int rcvbuf_size = recv_set_rcvbuf(sd, RECV_RCVBUF_INIT);
+    if (rcvbuf_size < RECV_RCVBUF_INIT) {
         // 非致命错误，继续执行
+        fprintf(stderr, "receive buffer is %d bytes, wanted %d (net.core.rmem_max too small?)\n",
+                rcvbuf_size, RECV_RCVBUF_INIT);
     }
     
     // 绑定地址
@@ -135,128 +650,164 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
     
-    // 创建管道
-    if (pipe(pd) < 0) {
-        perror("pipe()");
-        exit(1);
+    // 节目单：有缓存时先用缓存里的，马上就能选台，网上的由接收线程在后台核对
+    if (!headless) {
+        if (client_conf.list_cache == NULL) {
+            if (list_cache_path(cache_path, sizeof(cache_path), client_conf.mgroup,
+                                client_conf.rcvport) < 0) {
+                cache_path[0] = '\0';
+            }
+        } else if (strcmp(client_conf.list_cache, "off") != 0) {
+            snprintf(cache_path, sizeof(cache_path), "%s", client_conf.list_cache);
+        }
     }
-    
-    // 设置管道为非阻塞模式并增加缓冲区
-    int flags = fcntl(pd[1], F_GETFL);
-    if (flags != -1) {
-        fcntl(pd[1], F_SETFL, flags | O_NONBLOCK);
+    msg_list = NULL;
+    if (cache_path[0] != '\0') {
+        msg_list = list_cache_load(cache_path, &len, &server_addr, &last_chn);
+        if (msg_list != NULL && list_check(msg_list, len) != 0) {
+            free(msg_list);
+            msg_list = NULL;
+        }
+        if (msg_list != NULL) {
+            cached = true;
+            fprintf(stderr, "cached list version %u from %s, verifying in background\n",
+                    ntohl(msg_list->version), inet_ntoa(server_addr.sin_addr));
+        }
     }
-    
-#ifdef F_SETPIPE_SZ
-    fcntl(pd[1], F_SETPIPE_SZ, 1024 * 1024); // 1MB管道缓冲区
-#endif
-    
-    // 接收节目单
-    msg_list = malloc(MSG_LIST_MAX);
     if (msg_list == NULL) {
-        perror("malloc");
-        exit(1);
+        msg_list = list_receive(sd, &server_addr, &len);
     }
     
-    serveraddr_len = sizeof(server_addr);
-    while (1) {
-        len = recvfrom(sd, msg_list, MSG_LIST_MAX, 0, (void *)&server_addr, &serveraddr_len);
-        fprintf(stderr, "server_addr: %s\n", inet_ntoa(server_addr.sin_addr));
-        
-        if (len < sizeof(struct msg_list_st)) {
-            fprintf(stderr, "message is too short.\n");
-            continue;
-        }
-        
-        if (msg_list->chnid != LISTCHNID) {
-            fprintf(stderr, "current chnid:%d.\n", msg_list->chnid);
-            fprintf(stderr, "chnid is not match.\n");
-            continue;
-        } else {
-            fprintf(stderr, "chnid is matched current chnid:%d.\n", msg_list->chnid);
-            break;
+    // 任意源加入时，从节目单学到服务器地址后改成源特定；接收线程仍在用户态核对来源。
+    // 缓存里的地址要等接收线程确认
+    if (!cached) {
+        if (!ssm) {
+            if (mcast_narrow(sd, &group, ifindex, &server_addr) == 0) {
+                ssm = 1;
+            } else {
+                perror("setsourcefilter, staying on any-source join");
+            }
         }
+        fprintf(stderr, "multicast join: %s\n", ssm ? "source-specific" : "any-source");
     }
     
     // 显示频道列表
-    struct msg_listentry_st *pos;
-    for (pos = msg_list->entry; (char *)pos < ((char *)msg_list + len);
-         pos = (void *)((char *)pos) + ntohs(pos->len)) {
-        printf("channel:%d:%s\n", pos->chnid, pos->desc);
+    list_print(msg_list, len);
+    
+    // 无界面模式：订阅多个频道，不选台也不启动播放器
+    // 做中继时节目单原样交给读者
+    if (headless) {
+        rec_conf.list = msg_list;
+        rec_conf.list_len = len;
+        rec_conf.group = group;
+        rec_conf.group.sin_port = laddr.sin_port;
+        exit(recorder_run(sd, &server_addr, &rec_conf));
     }
+    uint32_t list_version = ntohl(msg_list->version);
     
-    // 选择频道
-    printf("请输入您想要的频道号: ");
-    while (scanf("%d", &chosenid) != 1) {
-        while (getchar() != '\n');
-        printf("输入无效！请重新输入一个整数频道号: ");
+    // 选择频道：缓存里有上次收听的频道就直接开始，不等标准输入，想换台时输入别的频道号
+    if (cached && last_chn >= MINCHNID && last_chn <= MAXCHNID) {
+        chosenid = last_chn;
+        // 续播要尽快出声，默认的延迟和高水位调小，抗抖动差一些，需要时用 -L、-W 指定
+        if (!latency_set) client_conf.latency_ms = JITTER_RESUME_MS;
+        if (!watermark_set) client_conf.high_ms = WRITER_RESUME_HIGH_MS;
+        printf("Resuming channel %d from the cached list (latency %d ms, prebuffer %d ms).\n",
+               chosenid, client_conf.latency_ms, client_conf.high_ms);
+    } else {
+        chosenid = choose_channel(last_chn);
+        start_us = mono_us(); // 等用户输入的时间不算
     }
-    while (getchar() != '\n');
     
-    printf("您选择了频道号: %d\n", chosenid);
-    if (chosenid < MINCHNID || chosenid > MAXCHNID) {
-        fprintf(stderr, "channel id is not match.\n");
+    // 其他频道和其他来源的报文在内核里就丢掉，失败时接收线程仍会在用户态过滤
+    if (!cached && chn_filter_attach(sd, &server_addr, chosenid) < 0) {
+        perror("chn_filter_attach");
+    }
+    
+    // 初始化共享数据
+    if (ring_buffer_init(&shared_data.rb) < 0) {
+        perror("ring_buffer_init");
         exit(1);
     }
+    shared_data.socket_fd = sd;
+    shared_data.chosen_channel = chosenid;
+    shared_data.start_us = start_us;
+    shared_data.latency_ms = client_conf.latency_ms;
+    shared_data.low_ms = client_conf.low_ms;
+    shared_data.high_ms = client_conf.high_ms;
+    shared_data.batch_ms = client_conf.batch_ms;
+    shared_data.busy_poll_us = client_conf.busy_poll_us;
+    shared_data.cpu = client_conf.cpu;
+    shared_data.server_addr = server_addr;
+    shared_data.stop_flag = false;
+    shared_data.receiver_ready = false;
+    shared_data.list_version = list_version;
+    shared_data.list = msg_list;
+    shared_data.list_len = len;
+    shared_data.server_confirmed = !cached;
+    shared_data.ssm = ssm;
+    shared_data.group = group;
+    shared_data.ifindex = ifindex;
+    atomic_init(&shared_data.zap_request, -1);
+    shared_data.zap_neighbors = client_conf.zap_neighbors;
+    shared_data.metrics_fd = -1;
+    if (client_conf.metrics_addr != NULL) {
+        shared_data.metrics_fd = metrics_listen(client_conf.metrics_addr);
+        if (shared_data.metrics_fd < 0) {
+            perror("metrics_listen");
+            exit(1);
+        }
+    }
     
-    free(msg_list);
+    catch_stop(&shared_data, &stop_set);
     
-    // fork子进程处理音频播放
-    pid = fork();
-    if (pid < 0) {
-        perror("fork()");
+    // 创建线程 UDP接受数据线程
+    if (pthread_create(&receiver_tid, NULL, receiver_thread, &shared_data) != 0) {
+        perror("pthread_create receiver");
         exit(1);
     }
-    
-    if (pid == 0) { // 子进程
-        close(sd);
-        close(pd[1]);
-        dup2(pd[0], 0);
-        if (pd[0] > 0) close(pd[0]);
-        
-        execl("/bin/sh", "sh", "-c", 
-              "mpg123 --quiet --buffer 2048 -", NULL);
-        perror("execl");
+    //管道写入线程
+    if (pthread_create(&writer_tid, NULL, writer_thread, &shared_data) != 0) {
+        perror("pthread_create writer");
         exit(1);
-    } else { // 父进程
-        close(pd[0]);
-        
-        // 初始化共享数据
-        ring_buffer_init(&shared_data.rb);
-        shared_data.socket_fd = sd;
-        shared_data.pipe_fd = pd[1];
-        shared_data.chosen_channel = chosenid;
-        shared_data.server_addr = server_addr;
-        shared_data.stop_flag = false;
-        shared_data.receiver_ready = false;
-        
-        // 创建线程 UDP接受数据线程
-        if (pthread_create(&receiver_tid, NULL, receiver_thread, &shared_data) != 0) {
-            perror("pthread_create receiver");
-            exit(1);
-        }
-        //管道写入线程
-        if (pthread_create(&writer_tid, NULL, writer_thread, &shared_data) != 0) {
-            perror("pthread_create writer");
-            exit(1);
-        }
-        
-        // (stats_thread): 监控性能和丢包情况
-        if (pthread_create(&stats_tid, NULL, stats_thread, &shared_data) != 0) {
-            perror("pthread_create stats");
+    }
+    
+    // 监控性能和丢包情况：有 metrics 端点时供抓取，否则 (stats_thread) 定期打印
+    if (shared_data.metrics_fd >= 0) {
+        if (pthread_create(&metrics_tid, NULL, metrics_thread, &shared_data) != 0) {
+            perror("pthread_create metrics");
             exit(1);
         }
-        
-        printf("All threads started. Press Ctrl+C to exit.\n");
-        
-        // 等待线程结束（通常通过信号处理）
-        pthread_join(receiver_tid, NULL);
-        pthread_join(writer_tid, NULL);
+    } else if (pthread_create(&stats_tid, NULL, stats_thread, &shared_data) != 0) {
+        perror("pthread_create stats");
+        exit(1);
+    }
+    
+    pthread_sigmask(SIG_UNBLOCK, &stop_set, NULL);
+    
+    printf("All threads started. Enter a channel number, + or - to switch, Ctrl+C to exit.\n");
+    command_loop(&shared_data);
+    
+    // 等待线程结束（通常通过信号处理）
+    pthread_join(receiver_tid, NULL);
+    pthread_join(writer_tid, NULL);
+    if (shared_data.metrics_fd >= 0) {
+        pthread_join(metrics_tid, NULL);
+        close(shared_data.metrics_fd);
+    } else {
         pthread_join(stats_tid, NULL);
-        
-        close(sd);
-        close(pd[1]);
     }
     
+    sink_close(&shared_data.sink);
+    ring_buffer_destroy(&shared_data.rb);
+    close(sd);
+    
+    // 没确认过的服务器不往缓存里写，留着原来的
+    if (cache_path[0] != '\0' && shared_data.server_confirmed &&
+        list_cache_save(cache_path, shared_data.list, shared_data.list_len,
+                        &shared_data.server_addr, shared_data.chosen_channel) < 0) {
+        perror(cache_path);
+    }
+    free(shared_data.list);
+    
     return 0;
 }
\ No newline at end of file
@@ -1,48 +1,38 @@
 #ifndef CLIENT_H_
 #define CLIENT_H_
-#define DEFAULT_PLAYERCMD " /usr/bin/mpg123 -   > /dev/null"
-// #define DEFAULT_PLAYERCMD " /usr/bin/mplayer -   > /dev/null"
+// 播放器直接启动，不经过 shell，不能带重定向
+#define DEFAULT_PLAYERCMD "mpg123 --quiet --buffer 2048 -"
+// #define DEFAULT_PLAYERCMD "mplayer -cache 1024 -"
+#define DEFAULT_OUTPUT "player"
 #include <netinet/in.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <pthread.h>
 #include <sys/types.h>
+#include "../include/proto.h"
+#include "ring_buffer.h"
+#include "metrics.h"
+#include "sink.h"
+#include "relay.h"
 struct client_conf_st
 {
   char *rcvport; // for local using
   char *mgroup;
+  char *source; // 只收这个发送者的组播（源特定加入），NULL 时从节目单学
   char *player_cmd;
+  char *output;   // 输出端：player、stdout、null 或 file:PATH，见 sink.h
+  int latency_ms; // 抖动缓冲区的目标延迟
+  int busy_poll_us; // 忙轮询的自旋预算，0 表示阻塞接收
+  int cpu;          // 接收线程绑定的 CPU，-1 表示不绑定
+  int low_ms, high_ms, batch_ms; // 写入线程的低水位、高水位和攒批时间
+  int zap_neighbors; // 每侧预收几个相邻频道，换台时立即有声音
+  char *metrics_addr; // metrics 端点地址，NULL 时每 5 秒打印统计
+  char *attach;       // 本机中继的 unix 套接字，非 NULL 时从中继读而不自己收组播
+  char *list_cache;   // 节目单缓存文件，NULL 时用默认位置，"off" 表示不用缓存
 };
 
 
-// 环形缓冲区结构
-#define RING_BUFFER_SIZE (2 * 1024 * 1024) // 2MB环形缓冲区大小
-
-struct ring_buffer {
-    char data[RING_BUFFER_SIZE];      // 实际存储音频数据的缓冲区数组
-                                      // 使用char数组便于按字节操作
-    
-    volatile size_t head;             // 读指针：指向下一个要读取的位置
-                                      // volatile确保多线程间可见性
-                                      // 消费者线程(writer_thread)使用
-    
-    volatile size_t tail;             // 写指针：指向下一个要写入的位置  
-                                      // volatile确保多线程间可见性
-                                      // 生产者线程(receiver_thread)使用
-    
-    volatile size_t count;            // 当前缓冲区中的数据字节数
-                                      // 用于判断缓冲区空/满状态
-                                      // volatile确保统计数据实时更新
-    
-    pthread_mutex_t mutex;            // 互斥锁：保护缓冲区的并发访问
-                                      // 确保读写操作的原子性
-    
-    pthread_cond_t not_empty;         // 条件变量：通知缓冲区非空
-                                      // 当生产者写入数据后，唤醒等待的消费者
-    
-    pthread_cond_t not_full;          // 条件变量：通知缓冲区非满
-                                      // 当消费者读取数据后，唤醒等待的生产者
-};
+// 环形缓冲区（单生产者/单消费者，无锁）见 ring_buffer.h
 
 // 共享数据结构 - 多线程间的通信桥梁
 struct shared_data {
@@ -52,12 +42,22 @@ struct shared_data {
     int socket_fd;                    // UDP socket文件描述符
                                       // 接收线程用于从网络接收数据
     
-    int pipe_fd;                      // 管道写端文件描述符
-                                      // 写入线程用于向子进程发送数据
+    struct sink_st sink;              // 输出端（播放器管道、标准输出、文件或丢弃）
+                                      // 写入线程把环形缓冲区的数据交给它
     
     int chosen_channel;               // 用户选择的音频频道号
                                       // 接收线程用于过滤数据包
     
+    int latency_ms;                   // 抖动缓冲区的目标延迟（毫秒）
+                                      // 接收线程按服务端时间戳加上它安排播放时刻
+    
+    int low_ms;                       // 低水位：播放器手里的数据不多于它就重新预缓冲
+    int high_ms;                      // 高水位：开始播放和欠载之后先攒够这么多毫秒
+    int batch_ms;                     // 写入线程攒批的期限，0 表示有数据就写
+    
+    int busy_poll_us;                 // 忙轮询的自旋预算（微秒），0 表示阻塞接收
+    int cpu;                          // 接收线程绑定的 CPU，-1 表示不绑定
+    
     struct sockaddr_in server_addr;   // 服务器地址信息
                                       // 用于验证数据包来源，防止恶意包
     
@@ -65,28 +65,57 @@ struct shared_data {
                                       // 用于优雅地终止所有线程
                                       // volatile确保线程间立即可见
     
+    uint32_t list_version;            // 当前节目单的版本
+                                      // 接收线程对比信标，版本变化时才重新接收节目单
+    struct msg_list_st *list;         // 当前的整张节目单，接收线程收到新版本时替换
+    int list_len;                     // 退出时连同服务器地址存进缓存
+    
+    // 从缓存启动时服务器地址还没核对过（服务端重启后源端口会变），先不挂内核过滤器也不收窄组播，
+    // 接收线程收到它的报文，或者从别的地址收到节目单时确认下来
+    bool server_confirmed;
+    bool ssm;                         // 已经是源特定加入
+    struct sockaddr_in group;         // 组播组和网卡，确认服务器地址后收窄加入
+    int ifindex;
+    
     volatile bool receiver_ready;     // 接收线程就绪标志
                                       // 确保写入线程在接收线程启动后再开始工作
                                       // 避免写入线程空等待
     
-    // 统计信息 - 用于监控程序性能和调试
-    volatile long packets_received;   // 已接收的数据包总数
-                                      // 接收线程更新，统计线程读取
+    // 换台：主线程发出请求，接收线程切换过滤器和解码状态，写入线程清掉旧频道的数据
+    atomic_int zap_request;           // 要换到的频道，-1 表示没有请求
+    atomic_llong zap_start_us;        // 换台命令的时刻（CLOCK_MONOTONIC 微秒）
+    long long start_us;               // 开始计首个声音的时刻：启动时，要等用户选台时为选定的时刻
+    atomic_uint flush_gen;            // 接收线程每换一次台加一
+    atomic_size_t flush_to;           // 旧频道的数据在环形缓冲区里的结束位置
+    int zap_neighbors;                // 每侧预收的相邻频道数，0 表示不预收
     
-    volatile long packets_written;    // 已写入管道的数据包总数  
-                                      // 写入线程更新，统计线程读取
+    int metrics_fd;                   // metrics 端点的监听描述符，-1 表示没有开启
     
-    volatile long packets_dropped;    // 丢弃的数据包总数
-                                      // 当缓冲区满时递增
+    struct relay_rd_st *relay;        // 接入的本机中继，NULL 表示自己收组播
     
-    volatile long bytes_received;     // 已接收的字节总数
-                                      // 用于计算网络吞吐量
-    
-    volatile long bytes_written;      // 已写入的字节总数
-                                      // 用于计算处理吞吐量
+    // 统计信息 - 每个线程写自己的一组，见 metrics.h
+    struct metrics_st metrics;
 };
 
 
 extern  struct shared_data shared_data;
 
+// 节目单分页拼装
+struct list_asm_st {
+    uint32_t version;
+    uint32_t hash;
+    int pages;                        // 总页数，0 表示还没开始
+    int got;                          // 已收到的页数
+    char *page[LIST_PAGES_MAX];       // 每一页的节目项
+    int len[LIST_PAGES_MAX];
+};
+
+int list_check(const struct msg_list_st *msg_list, int len);
+int list_asm_add(struct list_asm_st *la, const struct msg_list_st *msg_list, int len,
+                 struct msg_list_st **out, int *outlen);
+void list_asm_free(struct list_asm_st *la);
+void list_print(const struct msg_list_st *msg_list, int len);
+int mcast_narrow(int sd, const struct sockaddr_in *group, int ifindex,
+                 const struct sockaddr_in *source);
+
 #endif
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/proto.h"
+#include "fec_dec.h"
+
+#define SYM_MAX (FEC_LEN_SIZE + MAX_DATA) // 一个符号的最大长度
+
+// 序列号比较，考虑32位回绕
+static int32_t seq_diff(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b);
+}
+
+static void free_bufs(struct fec_dec_st *fd) {
+    for (int i = 0; i < fd->n; i++) {
+        free(fd->data[i]);
+        fd->data[i] = NULL;
+    }
+    for (int j = 0; j < fd->k; j++) {
+        free(fd->parity[j]);
+        fd->parity[j] = NULL;
+    }
+    fd->n = fd->k = 0;
+}
+
+// 按服务端的分组参数分配缓冲区
+static int configure(struct fec_dec_st *fd, int n, int k) {
+    free_bufs(fd);
+    for (int i = 0; i < n; i++) {
+        fd->data[i] = malloc(SYM_MAX);
+        if (fd->data[i] == NULL) goto fail;
+        fd->n = i + 1;
+    }
+    for (int j = 0; j < k; j++) {
+        fd->parity[j] = malloc(SYM_MAX);
+        if (fd->parity[j] == NULL) goto fail;
+        fd->k = j + 1;
+    }
+    return 0;
+fail:
+    perror("malloc in fec_dec");
+    free_bufs(fd);
+    return -1;
+}
+
+// 按序交付时：从 next 开始交付已经到齐的数据包
+static void flush(struct fec_dec_st *fd) {
+    while (seq_diff(fd->next, fd->base) < fd->n) {
+        int i = fd->next - fd->base;
+        if (!fd->data_ok[i]) break;
+        fd->deliver(fd->arg, fd->next, fd->ts[i], fd->data[i] + FEC_LEN_SIZE, fd->datalen[i]);
+        fd->next++;
+    }
+}
+
+// 分组结束：恢复不了的包就不等了；按序交付时把缺口之后留着的包交出去
+static void finish_group(struct fec_dec_st *fd) {
+    if (fd->ordered) {
+        for (; seq_diff(fd->next, fd->base) < fd->n; fd->next++) {
+            int i = fd->next - fd->base;
+            if (fd->data_ok[i])
+                fd->deliver(fd->arg, fd->next, fd->ts[i], fd->data[i] + FEC_LEN_SIZE,
+                            fd->datalen[i]);
+            else
+                fd->unrecovered++;
+        }
+    } else if (!fd->partial) {
+        for (int i = 0; i < fd->n; i++)
+            fd->unrecovered += !fd->data_ok[i];
+    }
+    // 首尾间隔 n-1 个包，分组时长按 n 个包算
+    if (fd->n > 1 && fd->data_ok[0] && fd->data_ok[fd->n - 1] && fd->ts[0] && fd->ts[fd->n - 1])
+        fd->group_ms = (uint64_t)(fd->ts[fd->n - 1] - fd->ts[0]) * fd->n / (fd->n - 1);
+}
+
+static void start_group(struct fec_dec_st *fd, uint32_t base, bool partial) {
+    memset(fd->data_ok, 0, sizeof(fd->data_ok));
+    memset(fd->parity_ok, 0, sizeof(fd->parity_ok));
+    fd->symlen = 0;
+    if (fd->ordered) {
+        if (!fd->started) {
+            fd->next = base;
+        } else if (seq_diff(fd->next, base) < 0) {
+            fd->unrecovered += base - fd->next; // 整组都没收到
+            fd->next = base;
+        }
+    } else if (fd->started && !partial && seq_diff(base, fd->base + fd->n) > 0) {
+        fd->unrecovered += base - (fd->base + fd->n); // 中间整组都没收到
+    }
+    fd->base = base;
+    fd->started = true;
+    fd->partial = partial;
+}
+
+/*
+恢复出来的包没有时间戳（时间戳没有参与编码），按分组里前后收到的包的时间戳线性插值，
+只有一边时沿用那一边的，抖动缓冲区照原来的播放时刻排它。
+估出来的不会晚于后面那个已经到达的包的时间戳，所以不会把抖动缓冲区的时钟偏移拉小。
+*/
+static uint32_t estimate_ts(const struct fec_dec_st *fd, int i) {
+    int lo = i - 1, hi = i + 1;
+
+    while (lo >= 0 && !(fd->data_ok[lo] && fd->ts[lo])) lo--;
+    while (hi < fd->n && !(fd->data_ok[hi] && fd->ts[hi])) hi++;
+    if (lo >= 0 && hi < fd->n)
+        return fd->ts[lo] + (int64_t)seq_diff(fd->ts[hi], fd->ts[lo]) * (i - lo) / (hi - lo);
+    if (lo >= 0) return fd->ts[lo];
+    if (hi < fd->n) return fd->ts[hi];
+    return 0;
+}
+
+static void try_recover(struct fec_dec_st *fd) {
+    uint8_t was_ok[FEC_MAX_N];
+    int missing = 0, have = 0;
+
+    if (fd->symlen == 0 || fd->partial) return;
+    for (int i = 0; i < fd->n; i++)
+        missing += !fd->data_ok[i];
+    for (int j = 0; j < fd->k; j++)
+        have += fd->parity_ok[j];
+    if (missing == 0 || missing > have) return;
+
+    // 已有的数据符号补0到校验符号的长度
+    for (int i = 0; i < fd->n; i++) {
+        if (!fd->data_ok[i]) continue;
+        if (FEC_LEN_SIZE + fd->datalen[i] > fd->symlen) return;
+        memset(fd->data[i] + FEC_LEN_SIZE + fd->datalen[i], 0,
+               fd->symlen - FEC_LEN_SIZE - fd->datalen[i]);
+    }
+    if (fec_decode(fd->n, fd->k, fd->data, fd->data_ok, fd->parity, fd->parity_ok,
+                   fd->symlen) < 0)
+        return;
+    memset(fd->parity_ok, 0, sizeof(fd->parity_ok)); // 校验缓冲区已被用作临时空间
+    memcpy(was_ok, fd->data_ok, sizeof(was_ok));
+    for (int i = 0; i < fd->n; i++) {
+        if (was_ok[i]) continue;
+        size_t len = (fd->data[i][0] << 8) | fd->data[i][1];
+        if (FEC_LEN_SIZE + len > fd->symlen) continue; // 长度不合理，放弃这个包
+        fd->datalen[i] = len;
+        fd->ts[i] = 0;
+        fd->data_ok[i] = 1;
+        fd->recovered++;
+    }
+    // 插值只用真正收到的包
+    for (int i = 0; i < fd->n; i++) {
+        if (was_ok[i] || !fd->data_ok[i]) continue;
+        fd->ts[i] = estimate_ts(fd, i);
+    }
+    if (fd->ordered) {
+        flush(fd);
+        return;
+    }
+    for (int i = 0; i < fd->n; i++) {
+        if (was_ok[i] || !fd->data_ok[i]) continue;
+        fd->deliver(fd->arg, fd->base + i, fd->ts[i], fd->data[i] + FEC_LEN_SIZE, fd->datalen[i]);
+    }
+}
+
+void fec_dec_init(struct fec_dec_st *fd, fec_deliver_t *deliver, void *arg) {
+    memset(fd, 0, sizeof(*fd));
+    fd->deliver = deliver;
+    fd->arg = arg;
+}
+
+void fec_dec_reset(struct fec_dec_st *fd) {
+    free_bufs(fd);
+    fd->started = false;
+}
+
+void fec_dec_destroy(struct fec_dec_st *fd) {
+    free_bufs(fd);
+}
+
+void fec_dec_data(struct fec_dec_st *fd, uint32_t seq, uint32_t ts, const uint8_t *data,
+                  size_t len) {
+    uint32_t base;
+    int i;
+
+    // 先交付再留底：乱序、重传来的迟到包也交付，由抖动缓冲区排序去重
+    if (fd->n == 0 || !fd->ordered) fd->deliver(fd->arg, seq, ts, data, len);
+    if (fd->n == 0) {
+        if (!fd->started || seq_diff(seq, fd->next) >= 0) fd->next = seq + 1;
+        fd->started = true;
+        return;
+    }
+    base = seq - seq % fd->n;
+    if (seq_diff(base, fd->base) < 0) return; // 已经结束的分组
+    if (base != fd->base) {
+        finish_group(fd);
+        start_group(fd, base, false);
+    }
+    i = seq - base;
+    if (fd->data_ok[i] || (fd->ordered && seq_diff(seq, fd->next) < 0) ||
+        FEC_LEN_SIZE + len > SYM_MAX)
+        return;
+    fd->data[i][0] = len >> 8;
+    fd->data[i][1] = len & 0xff;
+    memcpy(fd->data[i] + FEC_LEN_SIZE, data, len);
+    fd->datalen[i] = len;
+    fd->ts[i] = ts;
+    fd->data_ok[i] = 1;
+    if (fd->ordered) flush(fd);
+    try_recover(fd); // 校验包可能先于乱序的数据包到达
+}
+
+void fec_dec_parity(struct fec_dec_st *fd, uint32_t base, const struct fec_header *fh,
+                    const uint8_t *sym, size_t symlen) {
+    if (fh->n < 1 || fh->n > FEC_MAX_N || fh->k < 1 || fh->k > FEC_MAX_K ||
+        fh->index >= fh->k || base % fh->n != 0 ||
+        symlen < FEC_LEN_SIZE || symlen > SYM_MAX)
+        return;
+    if (fh->n != fd->n || fh->k != fd->k) { // 第一次收到校验包或服务端改了比例
+        if (fd->n) finish_group(fd);
+        if (configure(fd, fh->n, fh->k) < 0) return;
+        // 这一组里之前透传的包没有留底，恢复不了，也不算丢
+        start_group(fd, base, true);
+    }
+    if (seq_diff(base, fd->base) < 0) return;
+    if (base != fd->base) {
+        finish_group(fd);
+        start_group(fd, base, false);
+    }
+    if (fd->parity_ok[fh->index] || (fd->symlen && symlen != fd->symlen)) return;
+    memcpy(fd->parity[fh->index], sym, symlen);
+    fd->parity_ok[fh->index] = 1;
+    fd->symlen = symlen;
+    try_recover(fd);
+}
+
+int fec_dec_missing(struct fec_dec_st *fd, uint32_t *seqs, int max) {
+    int missing = 0, have = 0, last = -1, count = 0;
+
+    if (fd->n == 0 || fd->partial) return 0;
+    for (int i = 0; i < fd->n; i++)
+        missing += !fd->data_ok[i];
+    for (int j = 0; j < fd->k; j++) {
+        if (fd->parity_ok[j]) {
+            have++;
+            last = j;
+        }
+    }
+    // 校验包按序号发送，比 last 大的还可能到达
+    if (missing <= have + (fd->k - 1 - last)) return 0;
+    for (int i = 0; i < fd->n && count < max; i++)
+        if (!fd->data_ok[i])
+            seqs[count++] = fd->base + i;
+    return count;
+}
@@ -0,0 +1,55 @@
+#ifndef FECDEC_H_
+#define FECDEC_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../include/proto.h"
+#include "../include/fec.h"
+
+// 交付的数据（包括恢复出来的），ordered 时按序列号顺序；ts 为服务端时间戳，恢复出来的包为估计值
+typedef void fec_deliver_t(void *arg, uint32_t seq, uint32_t ts, const uint8_t *data,
+                           size_t len);
+
+/*
+FEC 分组解码：数据包到了就交付（迟到、重复的也照样交付），同时在分组里留一份底；
+校验包到达后恢复出缺失的包再补交，带上按前后包估出的时间戳，
+由后面的抖动缓冲区排序去重，并按原来的播放时刻等它（队首缺包时等到后面第一个包的播放时刻）。
+这样分组内丢包不会拖住后面的包：服务端每个频道约一秒一个包，按分组攒齐要多等 N-1 秒。
+分组结束仍无法恢复的包就不等了。服务端不开 FEC 时只是透传。
+后面没有抖动缓冲区的（录制、中继要的是按序的字节流）设 ordered：
+分组内出现缺口时，缺口之后的包先留在分组里，等恢复或分组结束再按序交付，最多多等一个分组。
+校验包在分组最后一个数据包之后才发，恢复出来的包最多晚一个分组的时长，
+抖动缓冲区的目标延迟比分组时长短时就用不上了（group_ms 供调用者核对）。
+*/
+struct fec_dec_st {
+    int n, k;                       // 0 表示还没有收到校验包，直接透传
+    bool ordered;                   // 按序交付，fec_dec_init() 之后由调用者设置
+    bool started;                   // base 是否有效
+    bool partial;                   // 当前分组开始时还在透传，前面的包没有留底，不做恢复
+    uint32_t base;                  // 当前分组第一个数据包的序列号
+    uint32_t next;                  // ordered 时下一个要交付的序列号
+    size_t symlen;                  // 当前分组的校验符号长度
+    uint8_t *data[FEC_MAX_N];       // 数据符号：长度字段 + 数据
+    size_t datalen[FEC_MAX_N];
+    uint32_t ts[FEC_MAX_N];         // 数据包的服务端时间戳
+    uint8_t data_ok[FEC_MAX_N];
+    uint8_t *parity[FEC_MAX_K];
+    uint8_t parity_ok[FEC_MAX_K];
+    fec_deliver_t *deliver;
+    void *arg;
+    long recovered;                 // 恢复出的数据包
+    long unrecovered;               // 分组结束时仍然缺失的数据包
+    uint32_t group_ms;              // 最近一个收齐首尾的分组的时长（服务端时间戳，毫秒），0 表示还不知道
+};
+
+void fec_dec_init(struct fec_dec_st *fd, fec_deliver_t *deliver, void *arg);
+void fec_dec_reset(struct fec_dec_st *fd);
+void fec_dec_destroy(struct fec_dec_st *fd);
+void fec_dec_data(struct fec_dec_st *fd, uint32_t seq, uint32_t ts, const uint8_t *data,
+                  size_t len);
+void fec_dec_parity(struct fec_dec_st *fd, uint32_t base, const struct fec_header *fh,
+                    const uint8_t *sym, size_t symlen);
+// 当前分组中即使剩下的校验包都到达也恢复不了的缺失序列号（需要重传），返回个数
+int fec_dec_missing(struct fec_dec_st *fd, uint32_t *seqs, int max);
+
+#endif
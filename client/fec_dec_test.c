@@ -0,0 +1,186 @@
+/*
+FEC 解码器自测：模拟带丢包的频道流（数据包和校验包都会丢），
+检查每个包只交付一次、内容和时间戳，以及可恢复的丢包全部被恢复；
+另外检查分组内丢了一个包时，后面的包不等校验包就交付；
+按序交付（ordered）时检查序列号递增，后面的包等到恢复之后才交付。
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/proto.h"
+#include "fec_dec.h"
+
+#define NPKT 4000
+#define MAXLEN 1400
+
+static uint8_t payload[NPKT + 1][MAXLEN]; // 最后一个是哨兵
+static size_t paylen[NPKT + 1];
+static uint8_t lost[NPKT + 1];
+static uint8_t seen[NPKT + 1];
+static long delivered;
+static bool ordered;
+static long last_seq;
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void deliver(void *arg, uint32_t seq, uint32_t ts, const uint8_t *data, size_t len) {
+    int n = arg ? *(int *)arg : 1;
+
+    check(seq <= NPKT && !seen[seq], "packet delivered twice");
+    check(seq <= NPKT && len == paylen[seq] && memcmp(data, payload[seq], len) == 0,
+          "delivered data differs");
+    // 收到的包带原来的时间戳（seq + 1），恢复出来的按同一分组里的包估计
+    if (seq <= NPKT && !lost[seq])
+        check(ts == seq + 1, "delivered timestamp differs");
+    else
+        check(ts > seq + 1 - n && ts < seq + 1 + n, "recovered timestamp out of its group");
+    if (ordered) check((long)seq > last_seq, "ordered delivery out of order");
+    if (seq <= NPKT) seen[seq] = 1;
+    last_seq = seq;
+    delivered++;
+}
+
+// 丢包数不超过 k 的分组必须全部恢复
+static void run(int n, int k, int first_seq) {
+    struct fec_dec_st fd;
+    static uint8_t sym[FEC_MAX_K][FEC_LEN_SIZE + MAXLEN];
+    uint8_t *parity[FEC_MAX_K];
+    struct fec_header fh = {.n = n, .k = k};
+    long expect = 0, unrecoverable = 0;
+
+    fec_dec_init(&fd, deliver, &n);
+    fd.ordered = ordered;
+    delivered = 0;
+    last_seq = -1;
+    memset(lost, 0, sizeof(lost));
+    memset(seen, 0, sizeof(seen));
+    for (int j = 0; j < k; j++)
+        parity[j] = sym[j];
+
+    // first_seq 不在分组开头，模拟客户端中途加入
+    int join = first_seq - first_seq % n;
+    for (int base = join; base + n <= NPKT; base += n) {
+        int drop[FEC_MAX_N + FEC_MAX_K] = {0};
+        int ndrop = rand() % (k + 2), lost_data = 0;
+        size_t maxlen = 0;
+
+        // 加入时的分组只丢数据包，保证解码器能收到校验包开始工作
+        for (int d = 0; d < ndrop; d++)
+            drop[rand() % (base == join ? n : n + k)] = 1;
+        for (int j = 0; j < k; j++)
+            memset(sym[j], 0, sizeof(sym[j]));
+        for (int i = 0; i < n; i++) {
+            uint32_t seq = base + i;
+            uint8_t lenbuf[FEC_LEN_SIZE] = {paylen[seq] >> 8, paylen[seq] & 0xff};
+            uint8_t *symdata[FEC_MAX_K];
+            for (int j = 0; j < k; j++)
+                symdata[j] = sym[j] + FEC_LEN_SIZE;
+            fec_encode_add(n, k, parity, i, lenbuf, FEC_LEN_SIZE);
+            fec_encode_add(n, k, symdata, i, payload[seq], paylen[seq]);
+            if (paylen[seq] > maxlen) maxlen = paylen[seq];
+            if ((int)seq < first_seq) continue;
+            if (drop[i]) {
+                lost[seq] = 1;
+                lost_data++;
+                continue;
+            }
+            fec_dec_data(&fd, seq, seq + 1, payload[seq], paylen[seq]);
+        }
+        int dropped_total = 0;
+        for (int i = 0; i < n + k; i++) dropped_total += drop[i];
+        for (int j = 0; j < k; j++) {
+            fh.index = j;
+            if (!drop[n + j])
+                fec_dec_parity(&fd, base, &fh, sym[j], FEC_LEN_SIZE + maxlen);
+        }
+        if (base == join) { // 收到第一个校验包之前透传，丢了就是丢了
+            for (int i = first_seq - base; i < n; i++)
+                expect += !drop[i];
+            continue;
+        }
+        if (dropped_total <= k)
+            expect += n;
+        else {
+            expect += n - lost_data;
+            unrecoverable += lost_data;
+        }
+    }
+    fec_dec_data(&fd, NPKT, NPKT + 1, payload[NPKT], 0); // 哨兵，触发最后一个分组结束
+    delivered--;                                // 不计上面这个哨兵
+    printf("fec_dec n=%d k=%d%s: delivered=%ld expect=%ld recovered=%ld unrecovered=%ld\n",
+           n, k, ordered ? " ordered" : "", delivered, expect, fd.recovered, fd.unrecovered);
+    check(delivered == expect, "recoverable loss not recovered");
+    check(fd.unrecovered >= unrecoverable, "unrecovered count too low");
+    fec_dec_destroy(&fd);
+}
+
+/*
+分组中间丢一个包：后面的包马上交付，校验包到了再补交丢的那个，带插值的时间戳；
+按序交付时后面的包留着，校验包到了和恢复出来的那个一起按序交付
+*/
+static void no_stall(void) {
+    enum { N = 8 };
+    struct fec_dec_st fd;
+    static uint8_t sym[1][FEC_LEN_SIZE + MAXLEN];
+    uint8_t *parity[1] = {sym[0]};
+    struct fec_header fh = {.n = N, .k = 1};
+    int n = N;
+    size_t maxlen = 0;
+
+    fec_dec_init(&fd, deliver, &n);
+    fd.ordered = ordered;
+    delivered = 0;
+    last_seq = -1;
+    memset(lost, 0, sizeof(lost));
+    memset(seen, 0, sizeof(seen));
+    fec_dec_parity(&fd, 0, &fh, sym[0], FEC_LEN_SIZE + 1); // 让解码器知道分组参数
+    lost[N + 2] = 1;
+    for (int i = 0; i < N; i++) {
+        uint32_t seq = N + i;
+        uint8_t lenbuf[FEC_LEN_SIZE] = {paylen[seq] >> 8, paylen[seq] & 0xff};
+        uint8_t *symdata[1] = {sym[0] + FEC_LEN_SIZE};
+        if (i == 0) memset(sym[0], 0, sizeof(sym[0]));
+        fec_encode_add(N, 1, parity, i, lenbuf, FEC_LEN_SIZE);
+        fec_encode_add(N, 1, symdata, i, payload[seq], paylen[seq]);
+        if (paylen[seq] > maxlen) maxlen = paylen[seq];
+        if (lost[seq]) continue;
+        fec_dec_data(&fd, seq, seq + 1, payload[seq], paylen[seq]);
+        if (ordered)
+            check(seen[seq] == (i < 2), "ordered data after a loss must wait for parity");
+        else
+            check(seen[seq], "data after a loss must not wait for parity");
+    }
+    if (!ordered)
+        check(delivered == N - 1 && !seen[N + 2], "all received packets delivered before parity");
+    fh.index = 0;
+    fec_dec_parity(&fd, N, &fh, sym[0], FEC_LEN_SIZE + maxlen);
+    printf("fec_dec no_stall%s: delivered=%ld recovered=%ld\n", ordered ? " ordered" : "",
+           delivered, fd.recovered);
+    check(delivered == N && seen[N + 2] && fd.recovered == 1, "lost packet recovered when parity arrives");
+    fec_dec_destroy(&fd);
+}
+
+int main(void) {
+    srand(2024);
+    for (int i = 0; i < NPKT; i++) {
+        paylen[i] = 1 + rand() % MAXLEN;
+        for (size_t b = 0; b < paylen[i]; b++)
+            payload[i][b] = rand();
+    }
+    for (int o = 0; o < 2; o++) {
+        ordered = o;
+        run(4, 1, 0);
+        run(8, 2, 5);
+        run(10, 4, 3);
+        no_stall();
+    }
+    printf("failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
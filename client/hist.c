@@ -0,0 +1,81 @@
+#include "hist.h"
+
+int hist_bucket(uint64_t v) {
+    int e;
+
+    if (v < HIST_SUB) return (int)v;
+    e = 63 - __builtin_clzll(v);
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+uint64_t hist_bucket_upper(int b) {
+    int e, shift;
+
+    if (b < HIST_SUB) return b;
+    e = b / HIST_SUB + HIST_SUB_BITS - 1;
+    shift = e - HIST_SUB_BITS;
+    return (((uint64_t)(HIST_SUB + b % HIST_SUB)) << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+void hist_record(struct hist_st *h, uint64_t v) {
+    unsigned long long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&h->count[hist_bucket(v)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, v, memory_order_relaxed);
+    while (v > max &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &max, v, memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+void hist_reset(struct hist_st *h) {
+    for (int b = 0; b < HIST_BUCKETS; b++)
+        atomic_store_explicit(&h->count[b], 0, memory_order_relaxed);
+    atomic_store_explicit(&h->total, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+}
+
+uint64_t hist_percentile(struct hist_st *h, double p) {
+    unsigned long total = atomic_load_explicit(&h->total, memory_order_relaxed);
+    unsigned long seen = 0, rank;
+
+    if (total == 0) return 0;
+    rank = (unsigned long)(total * p / 100.0 + 0.5);
+    if (rank < 1) rank = 1;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += atomic_load_explicit(&h->count[b], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = hist_bucket_upper(b);
+            uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+            return upper < max ? upper : max;
+        }
+    }
+    return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+unsigned long hist_count_le(struct hist_st *h, uint64_t v) {
+    unsigned long n = 0;
+
+    for (int b = 0; b < HIST_BUCKETS && hist_bucket_upper(b) <= v; b++)
+        n += atomic_load_explicit(&h->count[b], memory_order_relaxed);
+    return n;
+}
+
+uint64_t hist_le_bound(uint64_t v) {
+    int b = hist_bucket(v);
+
+    if (hist_bucket_upper(b) == v || b == 0) return hist_bucket_upper(b);
+    return hist_bucket_upper(b - 1);
+}
+
+void hist_print_summary(struct hist_st *h, FILE *fp, const char *name, const char *unit) {
+    fprintf(fp, "%s: n=%lu p50=%llu%s p90=%llu%s p99=%llu%s p99.9=%llu%s max=%llu%s\n", name,
+            atomic_load_explicit(&h->total, memory_order_relaxed),
+            (unsigned long long)hist_percentile(h, 50), unit,
+            (unsigned long long)hist_percentile(h, 90), unit,
+            (unsigned long long)hist_percentile(h, 99), unit,
+            (unsigned long long)hist_percentile(h, 99.9), unit,
+            atomic_load_explicit(&h->max, memory_order_relaxed), unit);
+}
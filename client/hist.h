@@ -0,0 +1,36 @@
+#ifndef HIST_H_
+#define HIST_H_
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+HDR 风格的对数线性直方图：每个 2 的幂区间再均分成 HIST_SUB 个桶，
+相对误差不超过 1/HIST_SUB，覆盖整个 uint64_t 范围，只要约 4KB。
+计数都是原子的，任何线程都可以记录，统计线程随时读取，不需要加锁。
+*/
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct hist_st {
+    atomic_ulong count[HIST_BUCKETS];
+    atomic_ulong total;               // 记录的个数
+    atomic_ullong sum;                // 所有值的和
+    atomic_ullong max;
+};
+
+int hist_bucket(uint64_t v);
+uint64_t hist_bucket_upper(int b);    // 桶内的最大值
+void hist_record(struct hist_st *h, uint64_t v);
+void hist_reset(struct hist_st *h);
+// 百分位数（0~100），返回所在桶的上界，没有数据返回 0
+uint64_t hist_percentile(struct hist_st *h, double p);
+// 不大于 v 的记录数：只算上界不超过 v 的桶，v 落在桶中间时那个桶不算（偏保守）
+unsigned long hist_count_le(struct hist_st *h, uint64_t v);
+// 不超过 v 的最大桶上界；拿它作累计分布的边界（Prometheus 的 le），hist_count_le 是精确的
+uint64_t hist_le_bound(uint64_t v);
+// 一行摘要：name n= p50= p90= p99= p99.9= max=
+void hist_print_summary(struct hist_st *h, FILE *fp, const char *name, const char *unit);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+直方图自测：检查桶的划分覆盖整个 uint64_t 范围且单调、相对误差在 1/HIST_SUB 以内，
+累计计数，以及均匀分布和多线程并发记录时百分位数和计数的正确性。
+*/
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "hist.h"
+
+#define THREADS 4
+#define PER_THREAD 100000
+
+static struct hist_st h;
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void *recorder(void *arg) {
+    for (int i = 1; i <= PER_THREAD; i++)
+        hist_record(&h, i);
+    return NULL;
+}
+
+int main(void) {
+    pthread_t tid[THREADS];
+    uint64_t v, p;
+    int last = -1, bad = 0;
+
+    // 桶号单调，值落在自己桶的上界以内，上界的相对误差有限
+    for (int shift = 0; shift < 64; shift++) {
+        for (int k = -2; k <= 2; k++) {
+            v = ((uint64_t)1 << shift) + k;
+            if (shift == 63 && k > 0) v = UINT64_MAX - k;
+            int b = hist_bucket(v);
+            if (b < 0 || b >= HIST_BUCKETS || hist_bucket_upper(b) < v ||
+                (v >= HIST_SUB && (hist_bucket_upper(b) - v) * HIST_SUB > v))
+                bad++;
+        }
+    }
+    check(bad == 0, "bucket bounds");
+    check(hist_bucket(UINT64_MAX) == HIST_BUCKETS - 1, "last bucket");
+    for (v = 0; v < 100000; v++) {
+        int b = hist_bucket(v);
+        if (b < last || b > last + 1) bad++;
+        last = b;
+    }
+    check(bad == 0, "buckets are contiguous");
+
+    check(hist_percentile(&h, 50) == 0, "empty histogram");
+
+    // 四个线程同时记录 1..PER_THREAD
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&tid[i], NULL, recorder, NULL);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(tid[i], NULL);
+    check(h.total == THREADS * PER_THREAD, "total count");
+    check(h.max == PER_THREAD, "max");
+    check(h.sum == (unsigned long long)THREADS * PER_THREAD * (PER_THREAD + 1) / 2, "sum");
+    p = hist_percentile(&h, 50);
+    check(p >= PER_THREAD / 2 && p <= PER_THREAD / 2 + PER_THREAD / 2 / HIST_SUB, "p50");
+    p = hist_percentile(&h, 99);
+    check(p >= PER_THREAD * 99 / 100 && p <= PER_THREAD, "p99");
+    check(hist_percentile(&h, 100) == PER_THREAD, "p100 is max");
+    check(hist_count_le(&h, 7) == THREADS * 7, "count_le exact below HIST_SUB");
+    check(hist_count_le(&h, 1023) == THREADS * 1023, "count_le exact at bucket upper");
+    check(hist_count_le(&h, UINT64_MAX) == h.total, "count_le everything");
+    // metrics 端点用的边界：都是桶上界，累计计数精确
+    for (int k = 0; k < 20; k++) {
+        uint64_t le = hist_le_bound((uint64_t)1 << k);
+        uint64_t want = le < PER_THREAD ? le : PER_THREAD;
+        if (le > ((uint64_t)1 << k) || hist_bucket_upper(hist_bucket(le)) != le ||
+            hist_count_le(&h, le) != THREADS * want)
+            bad++;
+    }
+    check(bad == 0, "le bounds are bucket uppers and count exactly");
+    hist_print_summary(&h, stdout, "hist", "");
+
+    hist_reset(&h);
+    check(h.total == 0 && hist_percentile(&h, 99) == 0, "reset");
+
+    printf("hist: failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
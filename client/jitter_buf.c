@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jitter_buf.h"
+
+// 序列号/时刻比较，考虑32位回绕
+static int32_t seq_diff(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b);
+}
+
+// 包的播放时刻：没有时间戳的包沿用前一个包的时刻，还没有交付过就立即播放
+static uint32_t pkt_deadline(const struct jitter_buf_st *jb, const struct jitter_pkt_st *p,
+                             uint32_t now) {
+    if (p->has_deadline) return p->deadline;
+    return jb->last_deadline ? jb->last_deadline : now;
+}
+
+// 从 next 开始第一个缓存着的包，没有返回 NULL
+static struct jitter_pkt_st *first_buffered(const struct jitter_buf_st *jb) {
+    for (int i = 0; i < JITTER_SLOTS && jb->count > 0; i++) {
+        const struct jitter_pkt_st *p = &jb->slot[(jb->next + i) % JITTER_SLOTS];
+        if (p->used && p->seq == jb->next + i) return (struct jitter_pkt_st *)p;
+    }
+    return NULL;
+}
+
+static void deliver_head(struct jitter_buf_st *jb, struct jitter_pkt_st *p, uint32_t deadline) {
+    jb->deliver(jb->arg, p->seq, p->data, p->len);
+    p->used = false;
+    jb->count--;
+    jb->last_deadline = deadline;
+    jb->next = p->seq + 1;
+}
+
+// 服务端时钟与本地时钟的偏移，取窗口内的最小值，窗口结束时允许偏移变大（时钟漂移）
+static void update_offset(struct jitter_buf_st *jb, uint32_t ts, uint32_t now) {
+    int32_t d = seq_diff(now, ts);
+
+    if (!jb->synced) {
+        jb->offset = jb->win_min = d;
+        jb->win_start = now;
+        jb->synced = true;
+        return;
+    }
+    if (d < jb->offset) jb->offset = d;
+    if (d < jb->win_min) jb->win_min = d;
+    if (seq_diff(now, jb->win_start) >= JITTER_OFFSET_WINDOW_MS) {
+        if (jb->win_min > jb->offset) jb->offset = jb->win_min;
+        jb->win_min = d;
+        jb->win_start = now;
+    }
+}
+
+void jitter_init(struct jitter_buf_st *jb, int target_ms, jitter_deliver_t *deliver, void *arg) {
+    memset(jb, 0, sizeof(*jb));
+    jb->target_ms = target_ms;
+    jb->deliver = deliver;
+    jb->arg = arg;
+}
+
+void jitter_destroy(struct jitter_buf_st *jb) {
+    for (int i = 0; i < JITTER_SLOTS; i++) {
+        free(jb->slot[i].data);
+        jb->slot[i].data = NULL;
+    }
+    jb->count = 0;
+}
+
+void jitter_put(struct jitter_buf_st *jb, uint32_t seq, uint32_t ts, const uint8_t *data,
+                size_t len, uint32_t now) {
+    struct jitter_pkt_st *p;
+    uint8_t *buf;
+
+    if (!jb->started) {
+        jb->next = jb->highest = seq;
+        jb->started = true;
+    }
+    if (seq_diff(seq, jb->next) < 0) { // 已经交付或跳过，来得太晚
+        jb->late++;
+        return;
+    }
+    if (seq_diff(seq, jb->next) >= JITTER_SLOTS) {
+        // 超出缓存范围（长时间断流或服务端重启）：按序交付缓存中的全部数据，从 seq 重新开始
+        while ((p = first_buffered(jb)) != NULL) {
+            jb->skipped += p->seq - jb->next;
+            deliver_head(jb, p, pkt_deadline(jb, p, now));
+        }
+        jb->next = jb->highest = seq;
+    }
+    p = &jb->slot[seq % JITTER_SLOTS];
+    if (p->used) {
+        jb->duplicates++;
+        return;
+    }
+    if (seq_diff(seq, jb->highest) < 0)
+        jb->reordered++;
+    else
+        jb->highest = seq;
+
+    buf = realloc(p->data, len ? len : 1);
+    if (buf == NULL) {
+        perror("realloc in jitter_put");
+        return;
+    }
+    p->data = buf;
+    memcpy(p->data, data, len);
+    p->len = len;
+    p->seq = seq;
+    p->has_deadline = ts != 0;
+    if (p->has_deadline) {
+        update_offset(jb, ts, now);
+        p->deadline = ts + jb->offset + jb->target_ms;
+    }
+    p->used = true;
+    jb->count++;
+}
+
+void jitter_release(struct jitter_buf_st *jb, uint32_t now) {
+    struct jitter_pkt_st *p;
+    uint32_t deadline;
+
+    // 队首缺包时，后面第一个包到了播放时刻就跳过缺口
+    while ((p = first_buffered(jb)) != NULL) {
+        deadline = pkt_deadline(jb, p, now);
+        if (seq_diff(now, deadline) < 0) break;
+        jb->skipped += p->seq - jb->next;
+        deliver_head(jb, p, deadline);
+    }
+}
+
+int jitter_timeout(const struct jitter_buf_st *jb, uint32_t now) {
+    const struct jitter_pkt_st *p = first_buffered(jb);
+    int32_t left;
+
+    if (p == NULL) return -1;
+    left = seq_diff(pkt_deadline(jb, p, now), now);
+    return left > 0 ? left : 0;
+}
@@ -0,0 +1,61 @@
+#ifndef JITTER_BUF_H_
+#define JITTER_BUF_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JITTER_SLOTS 128             // 最多缓存的包数（2的幂），要大于 FEC 分组长度
+#define JITTER_DEFAULT_MS 500        // 默认目标延迟
+#define JITTER_RESUME_MS 50          // 从缓存直接续播上次的频道时的默认目标延迟，换来更快出声
+#define JITTER_OFFSET_WINDOW_MS 10000 // 时钟偏移的统计窗口
+
+// 到了播放时刻的数据，按序列号顺序交付
+typedef void jitter_deliver_t(void *arg, uint32_t seq, const uint8_t *data, size_t len);
+
+struct jitter_pkt_st {
+    bool used;
+    uint32_t seq;
+    uint32_t deadline;              // 本地播放时刻（毫秒），ts 未知时无效
+    bool has_deadline;
+    size_t len;
+    uint8_t *data;
+};
+
+/*
+抖动缓冲区：把乱序、重复、间隔不均的包整理成按序列号、按播放时刻交付的流。
+播放时刻 = 服务端时间戳 + 时钟偏移 + 目标延迟，时钟偏移取一段时间内
+(到达时刻 - 时间戳) 的最小值，即传输最快的那个包，不受排队抖动影响。
+队首缺包时一直等到后面第一个包的播放时刻，给 FEC 和重传留出时间，仍未到达就跳过。
+所有时刻都是 packet_now_ms() 的毫秒值，由调用者传入，便于测试。
+*/
+struct jitter_buf_st {
+    int target_ms;
+    bool started;                   // next 是否有效
+    uint32_t next;                  // 下一个要交付的序列号
+    uint32_t highest;               // 收到过的最大序列号
+    bool synced;                    // offset 是否有效
+    int32_t offset;                 // 本地时钟 - 服务端时钟 + 最小传输延迟
+    int32_t win_min;                // 当前窗口内的最小偏移
+    uint32_t win_start;
+    uint32_t last_deadline;         // 上一个交付的包的播放时刻
+    int count;                      // 缓存中的包数
+    struct jitter_pkt_st slot[JITTER_SLOTS];
+    jitter_deliver_t *deliver;
+    void *arg;
+    long reordered;                 // 比已收到的包序列号小的包
+    long duplicates;                // 重复的包
+    long late;                      // 已经交付或跳过之后才到达的包
+    long skipped;                   // 到播放时刻仍缺失而跳过的包
+};
+
+void jitter_init(struct jitter_buf_st *jb, int target_ms, jitter_deliver_t *deliver, void *arg);
+void jitter_destroy(struct jitter_buf_st *jb);
+// 放入一个包，ts 为 0 表示没有时间戳（FEC 恢复出来又估不出时间戳的包），沿用前一个包的播放时刻
+void jitter_put(struct jitter_buf_st *jb, uint32_t seq, uint32_t ts, const uint8_t *data,
+                size_t len, uint32_t now);
+// 交付所有到了播放时刻的包
+void jitter_release(struct jitter_buf_st *jb, uint32_t now);
+// 距离下一个包的播放时刻还有多少毫秒，缓存为空返回 -1（可直接用作 poll 的超时）
+int jitter_timeout(const struct jitter_buf_st *jb, uint32_t now);
+
+#endif
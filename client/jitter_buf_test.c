@@ -0,0 +1,113 @@
+/*
+抖动缓冲区自测：模拟带抖动、乱序、重复、丢包和重传的频道流，
+用模拟时钟逐毫秒推进，检查交付顺序、播放时刻的稳定性和跳过的包数。
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jitter_buf.h"
+
+#define NPKT 2000
+#define INTERVAL_MS 100      // 服务端发包间隔
+#define CLOCK_SKEW 5000      // 客户端时钟比服务端快多少
+#define MIN_DELAY 20         // 最小传输延迟
+#define MAX_JITTER 300       // 排队抖动上限
+#define REPAIR_DELAY 150     // 丢包后重传到达的额外延迟
+#define TARGET_MS 500        // 大于 MAX_JITTER + REPAIR_DELAY，不应跳过可修复的包
+#define WARMUP 50            // 时钟偏移收敛之前的包不检查播放时刻
+
+struct event_st {
+    uint32_t at;             // 到达时刻（客户端时钟）
+    uint32_t seq;
+};
+
+static struct event_st ev[NPKT * 3];
+static int nev;
+static uint32_t sim_now;
+static uint32_t last_seq;
+static long delivered;
+static int32_t worst_dev;
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static uint32_t send_ts(uint32_t seq) {
+    return 1000 + seq * INTERVAL_MS;
+}
+
+static void add_event(uint32_t at, uint32_t seq) {
+    ev[nev].at = at;
+    ev[nev].seq = seq;
+    nev++;
+}
+
+static int cmp_event(const void *a, const void *b) {
+    const struct event_st *x = a, *y = b;
+    if (x->at != y->at) return x->at < y->at ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void deliver(void *arg, uint32_t seq, const uint8_t *data, size_t len) {
+    uint32_t seqbuf;
+
+    check(delivered == 0 || seq > last_seq, "out of order or duplicate delivery");
+    memcpy(&seqbuf, data, sizeof(seqbuf));
+    check(len == sizeof(seqbuf) && seqbuf == seq, "delivered data differs");
+    if (seq >= WARMUP) {
+        // 偏移收敛后，每个包都应该正好在 发送时刻 + 最小延迟 + 目标延迟 播放
+        int32_t dev = (int32_t)(sim_now - (send_ts(seq) + CLOCK_SKEW + MIN_DELAY + TARGET_MS));
+        if (dev < 0) dev = -dev;
+        if (dev > worst_dev) worst_dev = dev;
+    }
+    last_seq = seq;
+    delivered++;
+}
+
+int main(void) {
+    struct jitter_buf_st jb;
+    long lost = 0;
+    int i = 0;
+
+    srand(2024);
+    for (uint32_t seq = 0; seq < NPKT; seq++) {
+        uint32_t at = send_ts(seq) + CLOCK_SKEW + MIN_DELAY;
+        int r = rand() % 100;
+        if (seq % 10 != 0) at += rand() % MAX_JITTER; // 每10个包至少有一个没有排队
+        if (r < 3 && seq % 10 != 0) {
+            lost++; // 丢了，也没有重传
+        } else if (r < 8 && seq % 10 != 0) {
+            add_event(at + REPAIR_DELAY, seq); // 丢了，重传补回来
+        } else {
+            add_event(at, seq);
+            if (r < 13) add_event(at + rand() % MAX_JITTER, seq); // 重复
+        }
+    }
+    qsort(ev, nev, sizeof(ev[0]), cmp_event);
+
+    jitter_init(&jb, TARGET_MS, deliver, NULL);
+    for (sim_now = ev[0].at; i < nev || jb.count > 0; sim_now++) {
+        for (; i < nev && ev[i].at == sim_now; i++)
+            jitter_put(&jb, ev[i].seq, send_ts(ev[i].seq), (uint8_t *)&ev[i].seq,
+                       sizeof(ev[i].seq), sim_now);
+        jitter_release(&jb, sim_now);
+        int t = jitter_timeout(&jb, sim_now);
+        check(t < 0 || t <= TARGET_MS + MAX_JITTER + MIN_DELAY, "timeout out of range");
+    }
+    jitter_destroy(&jb);
+
+    printf("jitter: delivered=%ld lost=%ld skipped=%ld reordered=%ld duplicates=%ld late=%ld "
+           "worst_dev_ms=%d\n",
+           delivered, lost, jb.skipped, jb.reordered, jb.duplicates, jb.late, worst_dev);
+    check(delivered == NPKT - lost, "packets missing from output");
+    check(jb.skipped == lost, "skipped count differs from lost packets");
+    check(jb.late == 0, "packets arrived after their playout time");
+    check(jb.reordered > 0 && jb.duplicates > 0, "simulation has no reordering or duplicates");
+    check(worst_dev == 0, "playout time is not stable");
+    printf("failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/crc32c.h"
+#include "list_cache.h"
+
+int list_cache_path(char *buf, size_t size, const char *group, const char *port) {
+    const char *base = getenv("XDG_CACHE_HOME"), *sub = "netradio";
+    int n, m;
+
+    if (base == NULL || base[0] == '\0') {
+        base = getenv("HOME");
+        sub = ".cache/netradio";
+    }
+    if (base == NULL || base[0] == '\0') return -1;
+    n = snprintf(buf, size, "%s/%s", base, sub);
+    if (n < 0 || (size_t)n >= size) return -1;
+    // 逐级创建，已经存在的不管；真的建不了的话保存时再报错
+    for (char *p = buf + 1; ; p++) {
+        if (*p == '/' || *p == '\0') {
+            char c = *p;
+            *p = '\0';
+            mkdir(buf, 0700);
+            *p = c;
+            if (c == '\0') break;
+        }
+    }
+    m = snprintf(buf + n, size - n, "/%s-%s.list", group, port);
+    return m < 0 || (size_t)m >= size - n ? -1 : 0;
+}
+
+struct msg_list_st *list_cache_load(const char *path, int *len, struct sockaddr_in *server,
+                                    int *chnid) {
+    struct list_cache_hdr_st hdr;
+    struct msg_list_st *list = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) return NULL;
+    if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != LIST_CACHE_MAGIC ||
+        hdr.len < MSG_LIST_HDR || hdr.len > LIST_CACHE_MAX ||
+        (list = malloc(hdr.len)) == NULL || read(fd, list, hdr.len) != (ssize_t)hdr.len ||
+        crc32c(0, list, hdr.len) != hdr.crc) {
+        free(list);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    memset(server, 0, sizeof(*server));
+    server->sin_family = AF_INET;
+    server->sin_addr.s_addr = hdr.server_ip;
+    server->sin_port = hdr.server_port;
+    *len = hdr.len;
+    *chnid = hdr.chnid;
+    return list;
+}
+
+int list_cache_save(const char *path, const struct msg_list_st *list, int len,
+                    const struct sockaddr_in *server, int chnid) {
+    struct list_cache_hdr_st hdr = {.magic = LIST_CACHE_MAGIC,
+                                    .len = len,
+                                    .crc = crc32c(0, list, len),
+                                    .server_ip = server->sin_addr.s_addr,
+                                    .server_port = server->sin_port,
+                                    .chnid = chnid};
+    char tmp[4096];
+    int fd, err;
+
+    if (len < (int)MSG_LIST_HDR || len > LIST_CACHE_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid()) >= (int)sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    errno = 0; // 写了一部分时 write() 不设 errno
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || write(fd, list, len) != len) {
+        err = errno ? errno : EIO;
+        close(fd);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    if (close(fd) < 0 || rename(tmp, path) < 0) {
+        err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
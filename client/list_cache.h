@@ -0,0 +1,42 @@
+#ifndef LIST_CACHE_H_
+#define LIST_CACHE_H_
+#include <netinet/in.h>
+#include <stddef.h>
+#include "../include/proto.h"
+
+/*
+节目单缓存：服务端每秒才发一次完整节目单，启动时等它要等上最多一秒。
+退出时把拼好的整张节目单、发它的服务器地址和最后收听的频道存到本地，
+下次启动先显示缓存里的节目单，马上就能选台（回车直接收听上次的频道），
+网上的节目单由接收线程在后台核对：版本变了就显示新的，服务器地址变了就改用新的。
+每个组播组和端口一个文件，写入时先写临时文件再改名，读到的要么是旧的要么是新的。
+*/
+#define LIST_CACHE_MAGIC 0x4C495354u     // "LIST"
+#define LIST_CACHE_MAX (1 << 20)         // 缓存的节目单最大长度
+
+// 缓存文件头，后面跟 len 字节的整张节目单
+struct list_cache_hdr_st {
+    uint32_t magic;
+    uint32_t len;
+    uint32_t crc;                        // 节目单的 CRC32C
+    uint32_t server_ip;                  // 网络字节序
+    uint16_t server_port;                // 网络字节序
+    int16_t chnid;                       // 最后收听的频道，没有时为 -1
+};
+
+/*
+缓存文件的路径：$XDG_CACHE_HOME（没有时 $HOME/.cache）/netradio/GROUP-PORT.list，
+需要时创建目录。成功返回 0，两个环境变量都没有或者路径太长返回 -1。
+*/
+int list_cache_path(char *buf, size_t size, const char *group, const char *port);
+/*
+读出缓存的节目单（malloc，调用者释放），*len 为长度，*server 为服务器地址，
+*chnid 为最后收听的频道。文件不存在、不完整或者校验不对返回 NULL。
+*/
+struct msg_list_st *list_cache_load(const char *path, int *len, struct sockaddr_in *server,
+                                    int *chnid);
+// 存下节目单；成功返回 0，失败返回 -1 并设置 errno
+int list_cache_save(const char *path, const struct msg_list_st *list, int len,
+                    const struct sockaddr_in *server, int chnid);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+节目单缓存自测：在临时目录下按组和端口生成路径，存进去再读出来要原样一致，
+覆盖保存后读到新的；文件被截断、改坏或者不存在时都读不出来。
+*/
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "list_cache.h"
+
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// 一张有 n 个节目项的整张节目单
+static struct msg_list_st *make_list(int n, uint32_t version, int *len) {
+    struct msg_list_st *list = calloc(1, MSG_LIST_HDR + n * 64);
+    char *p = (char *)list->entry;
+
+    list->chnid = LISTCHNID;
+    list->type = LIST_TYPE_FULL;
+    list->version = htonl(version);
+    list->pages = 1;
+    for (int i = 0; i < n; i++) {
+        struct msg_listentry_st *e = (void *)p;
+        int dlen = snprintf((char *)e->desc, 48, "channel %d", i + 1) + 1;
+        e->chnid = i + 1;
+        e->len = htons(sizeof(*e) + dlen);
+        p += sizeof(*e) + dlen;
+    }
+    *len = p - (char *)list;
+    return list;
+}
+
+int main(void) {
+    char dir[] = "/tmp/list_cache_test.XXXXXX", path[4096], cmd[4200];
+    struct sockaddr_in server = {.sin_family = AF_INET, .sin_port = htons(40000)}, got_server;
+    struct msg_list_st *list, *got;
+    int len, got_len, got_chn;
+    FILE *fp;
+
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    inet_pton(AF_INET, "192.0.2.1", &server.sin_addr);
+
+    setenv("XDG_CACHE_HOME", dir, 1);
+    check(list_cache_path(path, sizeof(path), "224.2.2.2", "1989") == 0, "path");
+    check(strstr(path, "/netradio/224.2.2.2-1989.list") != NULL, "path is keyed by group and port");
+    check(list_cache_load(path, &got_len, &got_server, &got_chn) == NULL, "missing cache");
+
+    list = make_list(20, 7, &len);
+    check(list_cache_save(path, list, len, &server, 3) == 0, "save");
+    got = list_cache_load(path, &got_len, &got_server, &got_chn);
+    check(got != NULL && got_len == len && memcmp(got, list, len) == 0, "list round trip");
+    check(got_server.sin_addr.s_addr == server.sin_addr.s_addr &&
+          got_server.sin_port == server.sin_port && got_chn == 3, "server and channel round trip");
+    free(got);
+    free(list);
+
+    // 覆盖保存
+    list = make_list(5, 8, &len);
+    check(list_cache_save(path, list, len, &server, -1) == 0, "save again");
+    got = list_cache_load(path, &got_len, &got_server, &got_chn);
+    check(got != NULL && ntohl(got->version) == 8 && got_len == len && got_chn == -1,
+          "newer list replaces the old one");
+    free(got);
+
+    // 改坏一个字节
+    fp = fopen(path, "r+b");
+    fseek(fp, sizeof(struct list_cache_hdr_st) + 10, SEEK_SET);
+    fputc(0x5A ^ ((uint8_t *)list)[10], fp);
+    fclose(fp);
+    check(list_cache_load(path, &got_len, &got_server, &got_chn) == NULL, "corrupt cache");
+    // 截断
+    check(list_cache_save(path, list, len, &server, 1) == 0, "save before truncate");
+    check(truncate(path, sizeof(struct list_cache_hdr_st) + len - 1) == 0, "truncate");
+    check(list_cache_load(path, &got_len, &got_server, &got_chn) == NULL, "truncated cache");
+    free(list);
+
+    // 没有 XDG_CACHE_HOME 时用 $HOME/.cache
+    unsetenv("XDG_CACHE_HOME");
+    setenv("HOME", dir, 1);
+    check(list_cache_path(path, sizeof(path), "239.1.1.1", "5000") == 0 &&
+          strncmp(path, dir, strlen(dir)) == 0 &&
+          strstr(path, "/.cache/netradio/239.1.1.1-5000.list") != NULL, "HOME fallback");
+    unsetenv("HOME");
+    check(list_cache_path(path, sizeof(path), "239.1.1.1", "5000") < 0, "no cache directory");
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0) fprintf(stderr, "cannot remove %s\n", dir);
+    printf("list_cache: failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
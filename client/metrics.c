@@ -0,0 +1,248 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "client.h"
+#include "metrics.h"
+
+#define METRICS_PREFIX "mcast_client_"
+#define METRICS_POLL_MS 500      // 多久检查一次停止标志
+#define METRICS_REQ_MAX 4096     // 请求头最多读这么多
+#define METRICS_IO_TIMEOUT_S 1   // 慢客户端不能卡住端点
+
+static void counter(FILE *fp, const char *name, const char *help, long v) {
+    fprintf(fp, "# HELP " METRICS_PREFIX "%s_total %s\n", name, help);
+    fprintf(fp, "# TYPE " METRICS_PREFIX "%s_total counter\n", name);
+    fprintf(fp, METRICS_PREFIX "%s_total %ld\n", name, v);
+}
+
+static void gauge(FILE *fp, const char *name, const char *help, long v) {
+    fprintf(fp, "# HELP " METRICS_PREFIX "%s %s\n", name, help);
+    fprintf(fp, "# TYPE " METRICS_PREFIX "%s gauge\n", name);
+    fprintf(fp, METRICS_PREFIX "%s %ld\n", name, v);
+}
+
+/*
+直方图的桶边界固定为 1, 2, 4 ... 2^max_log2，每次抓取都一样，
+Prometheus 才能跨时间计算 rate() 和 histogram_quantile()。
+*/
+static void histogram(FILE *fp, const char *name, const char *help, struct hist_st *h,
+                      int max_log2) {
+    unsigned long total = atomic_load_explicit(&h->total, memory_order_relaxed);
+
+    fprintf(fp, "# HELP " METRICS_PREFIX "%s %s\n", name, help);
+    fprintf(fp, "# TYPE " METRICS_PREFIX "%s histogram\n", name);
+    // 边界取 2 的幂附近的桶上界，跨在边界上的桶不会被漏掉或多算
+    for (int k = 0; k <= max_log2; k++) {
+        uint64_t le = hist_le_bound(1ULL << k);
+        fprintf(fp, METRICS_PREFIX "%s_bucket{le=\"%llu\"} %lu\n", name,
+                (unsigned long long)le, hist_count_le(h, le));
+    }
+    fprintf(fp, METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %lu\n", name, total);
+    fprintf(fp, METRICS_PREFIX "%s_sum %llu\n", name,
+            atomic_load_explicit(&h->sum, memory_order_relaxed));
+    fprintf(fp, METRICS_PREFIX "%s_count %lu\n", name, total);
+}
+
+void metrics_write(struct shared_data *shared, FILE *fp) {
+    struct recv_metrics_st *r = &shared->metrics.recv;
+    struct writer_metrics_st *w = &shared->metrics.writer;
+
+    gauge(fp, "channel", "Channel being played.", shared->chosen_channel);
+    gauge(fp, "latency_target_ms", "Jitter buffer target latency.", shared->latency_ms);
+    gauge(fp, "watermark_low_ms", "Player buffer level that triggers rebuffering.",
+          shared->low_ms);
+    gauge(fp, "watermark_high_ms", "Audio buffered before playback starts or resumes.",
+          shared->high_ms);
+    gauge(fp, "busy_poll_us", "Receiver spin budget, 0 when blocking.", shared->busy_poll_us);
+
+    counter(fp, "packets_received", "Data packets received on the channel.",
+            metric_get(&r->packets_received));
+    counter(fp, "packets_lost", "Packets missing from sequence gaps.",
+            metric_get(&r->packets_lost));
+    counter(fp, "packets_late", "Packets arriving behind the sequence (repairs, reordering).",
+            metric_get(&r->packets_late));
+    counter(fp, "packets_dropped", "Packets dropped because the ring buffer was full.",
+            metric_get(&r->packets_dropped));
+    counter(fp, "packets_kernel_dropped",
+            "Datagrams dropped by the kernel because the socket queue was full.",
+            metric_get(&r->packets_kernel_dropped));
+    counter(fp, "packets_filtered",
+            "Datagrams rejected by the kernel channel filter (other channels or senders).",
+            metric_get(&r->packets_filtered));
+    counter(fp, "rcvbuf_grows", "Socket receive buffer enlargements after kernel drops.",
+            metric_get(&r->rcvbuf_grows));
+    counter(fp, "packets_corrupt", "Packets failing header or CRC32C checks.",
+            metric_get(&r->packets_corrupt));
+    counter(fp, "packets_recovered", "Packets rebuilt by FEC.",
+            metric_get(&r->packets_recovered));
+    counter(fp, "packets_reordered", "Packets put back in order by the jitter buffer.",
+            metric_get(&r->packets_reordered));
+    counter(fp, "packets_duplicate", "Duplicate packets discarded by the jitter buffer.",
+            metric_get(&r->packets_duplicate));
+    counter(fp, "packets_skipped", "Packets still missing at their playout time.",
+            metric_get(&r->packets_skipped));
+    counter(fp, "nacks_sent", "Retransmission requests sent.", metric_get(&r->nacks_sent));
+    counter(fp, "resyncs", "Stream breaks realigned to the next MP3 frame header.",
+            metric_get(&r->resyncs));
+    counter(fp, "resync_skipped_bytes", "Bytes discarded before the next frame header.",
+            metric_get(&r->resync_skipped_bytes));
+    counter(fp, "received_bytes", "Bytes handed to the ring buffer.",
+            metric_get(&r->bytes_received));
+    counter(fp, "busy_poll_hits", "Receives satisfied while spinning.",
+            metric_get(&r->busy_poll_hits));
+    counter(fp, "busy_poll_misses", "Spin budgets exhausted before data arrived.",
+            metric_get(&r->busy_poll_misses));
+    counter(fp, "writes", "Writes to the player pipe.", metric_get(&w->packets_written));
+    counter(fp, "written_bytes", "Bytes written to the player pipe.",
+            metric_get(&w->bytes_written));
+    counter(fp, "underruns", "Times the player ran below the low watermark and rebuffered.",
+            metric_get(&w->underruns));
+    counter(fp, "zaps", "Channel switches.", metric_get(&w->zaps));
+
+    gauge(fp, "first_audio_ms", "Start (or channel choice) to first byte handed to the output.",
+          metric_get(&w->first_audio_ms));
+    gauge(fp, "prebuffering", "1 while waiting for the high watermark.",
+          metric_get(&w->prebuffering));
+    gauge(fp, "jitter_depth_packets", "Packets waiting in the jitter buffer.",
+          metric_get(&r->jitter_depth));
+    gauge(fp, "rcvbuf_bytes", "Socket receive buffer size.", metric_get(&r->rcvbuf_bytes));
+    gauge(fp, "ring_buffer_bytes", "Bytes waiting in the ring buffer.",
+          (long)ring_buffer_count(&shared->rb));
+
+    histogram(fp, "wakeup_latency_us", "Kernel receive to receiver thread wakeup.",
+              &r->wakeup_us, 20);
+    histogram(fp, "interarrival_jitter_us", "Deviation of arrival spacing from send spacing.",
+              &r->interarrival_jitter_us, 24);
+    histogram(fp, "gap_packets", "Length of sequence gaps.", &r->gap_packets, 12);
+    histogram(fp, "one_way_delay_us",
+              "Kernel receive time minus server send timestamp (includes clock offset).",
+              &r->one_way_delay_us, 24);
+    histogram(fp, "queue_delay_us", "Kernel receive to hand-off to the output, inside the client.",
+              &w->queue_delay_us, 24);
+    histogram(fp, "write_latency_us", "Duration of each write to the player pipe.",
+              &w->write_latency_us, 20);
+    histogram(fp, "zap_ms", "Channel switch command to first byte of the new channel.",
+              &w->zap_ms, 14);
+    histogram(fp, "ring_occupancy_bytes", "Ring buffer fill seen before each write.",
+              &w->ring_occupancy_bytes, 21);
+}
+
+int metrics_listen(const char *addr) {
+    int sd, one = 1;
+    struct stat st;
+
+    if (addr[0] == '/') {
+        struct sockaddr_un un = {.sun_family = AF_UNIX};
+        if (strlen(addr) >= sizeof(un.sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        strcpy(un.sun_path, addr);
+        sd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sd < 0) return -1;
+        // 只删上次运行留下的 socket 文件；路径写错指到普通文件时不动它，bind 报 EADDRINUSE
+        if (lstat(addr, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(addr);
+        if (bind(sd, (void *)&un, sizeof(un)) < 0) goto fail;
+    } else {
+        struct sockaddr_in in = {.sin_family = AF_INET};
+        const char *colon = strrchr(addr, ':');
+        char host[INET_ADDRSTRLEN] = "127.0.0.1";
+
+        if (colon != NULL) {
+            if (colon - addr >= (int)sizeof(host)) {
+                errno = EINVAL;
+                return -1;
+            }
+            memcpy(host, addr, colon - addr);
+            host[colon - addr] = '\0';
+            addr = colon + 1;
+        }
+        in.sin_port = htons(atoi(addr));
+        if (inet_pton(AF_INET, host, &in.sin_addr) != 1 || in.sin_port == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        sd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sd < 0) return -1;
+        setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(sd, (void *)&in, sizeof(in)) < 0) goto fail;
+    }
+    if (listen(sd, 16) < 0) goto fail;
+    return sd;
+
+fail:
+    close(sd);
+    return -1;
+}
+
+// 抓取端提前断开时不能让 SIGPIPE 杀掉客户端
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        buf += n;
+        len -= n;
+    }
+}
+
+// 读完请求头，只认 GET / 和 GET /metrics
+static void serve(struct shared_data *shared, int fd) {
+    char req[METRICS_REQ_MAX + 1], head[128];
+    struct timeval tv = {.tv_sec = METRICS_IO_TIMEOUT_S};
+    size_t got = 0, body_len = 0;
+    char *body = NULL;
+    ssize_t n;
+    FILE *fp;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    while (got < METRICS_REQ_MAX) {
+        n = read(fd, req + got, METRICS_REQ_MAX - got);
+        if (n <= 0) break;
+        got += n;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n") != NULL || strstr(req, "\n\n") != NULL) break;
+    }
+    req[got] = '\0';
+    if (strncmp(req, "GET / ", 6) != 0 && strncmp(req, "GET /metrics", 12) != 0) {
+        static const char nf[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        write_all(fd, nf, sizeof(nf) - 1);
+        return;
+    }
+
+    fp = open_memstream(&body, &body_len);
+    if (fp == NULL) return;
+    metrics_write(shared, fp);
+    fclose(fp);
+    n = snprintf(head, sizeof(head),
+                 "HTTP/1.0 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4\r\n"
+                 "Content-Length: %zu\r\n\r\n",
+                 body_len);
+    write_all(fd, head, n);
+    write_all(fd, body, body_len);
+    free(body);
+}
+
+void *metrics_thread(void *arg) {
+    struct shared_data *shared = arg;
+    struct pollfd pfd = {.fd = shared->metrics_fd, .events = POLLIN};
+
+    while (!shared->stop_flag) {
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) continue;
+        int fd = accept(shared->metrics_fd, NULL, NULL);
+        if (fd < 0) continue;
+        serve(shared, fd);
+        close(fd);
+    }
+    return NULL;
+}
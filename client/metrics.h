@@ -0,0 +1,81 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+#include <stdatomic.h>
+#include <stdio.h>
+#include "hist.h"
+#include "ring_buffer.h"
+
+/*
+客户端运行指标。每个线程只写自己的那一组，各组从独占的缓存行开始，
+不会和环形缓冲区的 head/tail 或别的线程的计数器伪共享。
+计数器（metric_add/metric_set）只有一个写者，用 relaxed 的读加写累加，不需要带锁前缀的原子加法；
+直方图（hist.h）允许多个线程记录，用的是 relaxed 的原子加法。
+统计线程和 metrics 端点随时读取，读到的都是完整的值。
+*/
+struct recv_metrics_st {
+    _Alignas(RING_CACHELINE) atomic_long packets_received; // 所选频道的数据包
+    atomic_long packets_lost;         // 序列号缺口里的包数（之后可能被修复）
+    atomic_long packets_late;         // 迟到的包（重传或乱序）
+    atomic_long packets_dropped;      // 环形缓冲区满而丢弃的包
+    atomic_long packets_kernel_dropped; // 套接字接收队列满，内核丢掉的报文（SO_RXQ_OVFL，见 rxq_drops.h）
+    atomic_long packets_filtered;     // 内核过滤器拒掉的报文（别的频道、别的来源）
+    atomic_long packets_corrupt;      // 校验失败的包
+    atomic_long packets_recovered;    // FEC 恢复出的包
+    atomic_long packets_reordered;    // 抖动缓冲区重新排序的包
+    atomic_long packets_duplicate;    // 抖动缓冲区丢弃的重复包
+    atomic_long packets_skipped;      // 到播放时刻仍缺失而跳过的包
+    atomic_long nacks_sent;           // 发出的重传请求
+    atomic_long resyncs;              // 字节流断开后重新对齐到帧头的次数
+    atomic_long resync_skipped_bytes; // 重新同步时丢掉的帧头之前的字节
+    atomic_long bytes_received;       // 交给环形缓冲区的字节
+    atomic_long busy_poll_hits;       // 自旋期间就等到数据的次数
+    atomic_long busy_poll_misses;     // 预算用完退回阻塞等待的次数
+    atomic_long jitter_depth;         // 抖动缓冲区中等待播放的包数
+    atomic_long rcvbuf_bytes;         // 套接字接收缓冲区的当前大小
+    atomic_long rcvbuf_grows;         // 因内核丢包加大接收缓冲区的次数
+    struct hist_st wakeup_us;         // 内核收到报文到接收线程拿到（微秒）
+    struct hist_st interarrival_jitter_us; // 相邻两包到达间隔与发送间隔之差（RFC 3550 的 D）
+    struct hist_st gap_packets;       // 每个序列号缺口的长度
+    struct hist_st one_way_delay_us;  // 内核收到的时刻减去服务端发送时间戳（含两端时钟偏差）
+};
+
+struct writer_metrics_st {
+    _Alignas(RING_CACHELINE) atomic_long packets_written; // 写入管道的次数
+    atomic_long bytes_written;
+    atomic_long underruns;            // 播放器手里的数据低于低水位、重新预缓冲的次数
+    atomic_long prebuffering;         // 1 表示正在攒高水位，还没开始写
+    atomic_long zaps;                 // 换台次数
+    struct hist_st zap_ms;            // 换台命令到新频道第一个字节交给播放器（毫秒）
+    atomic_long first_audio_ms;       // 启动（或选定频道）到第一个字节交给播放器（毫秒），0 表示还没有
+    struct hist_st write_latency_us;  // 每次 vmsplice/write 的耗时
+    struct hist_st ring_occupancy_bytes; // 每次写之前环形缓冲区里的数据量
+    struct hist_st queue_delay_us;    // 报文从内核收到到交给播放器，在客户端里排队的时间
+};
+
+struct metrics_st {
+    struct recv_metrics_st recv;
+    struct writer_metrics_st writer;
+};
+
+static inline void metric_add(atomic_long *c, long v) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + v,
+                          memory_order_relaxed);
+}
+
+static inline void metric_set(atomic_long *c, long v) {
+    atomic_store_explicit(c, v, memory_order_relaxed);
+}
+
+static inline long metric_get(atomic_long *c) {
+    return atomic_load_explicit(c, memory_order_relaxed);
+}
+
+struct shared_data;
+// 按 Prometheus 文本格式输出全部指标
+void metrics_write(struct shared_data *shared, FILE *fp);
+// 监听 "/path"（Unix socket）或 "[host:]port"（TCP，默认 127.0.0.1），返回监听描述符
+int metrics_listen(const char *addr);
+// metrics 端点线程：对每个 HTTP GET /metrics 回一份指标，参数是共享数据
+void *metrics_thread(void *arg);
+
+#endif
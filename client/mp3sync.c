@@ -0,0 +1,153 @@
+/*
+帧同步扫描。向量实现一次比较 16/32 字节：0xFF 后面跟着高 3 位全 1 的字节才是候选，
+压缩数据里大约每 2KB 才有一个，逐个再做完整的帧头检查。
+运行时检测 CPU，不支持时回退到逐字节的标量实现。
+*/
+#include <pthread.h>
+#include <stdbool.h>
+#include "mp3sync.h"
+
+#define HDR_SAME_STREAM 0xFFFE0C00u // 同一个流里相邻帧不变的位：同步字、版本、层、采样率
+
+// 码率（kbps），[MPEG-1?][层 I/II/III][码率序号]，序号 0（自由格式）和 15 无效
+static const uint16_t bitrate_kbps[2][3][15] = {
+    {{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}},
+    {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+     {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+     {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}},
+};
+
+// 采样率，[版本位：2.5/保留/2/1][采样率序号]
+static const uint32_t sample_rate[4][3] = {
+    {11025, 12000, 8000}, {0, 0, 0}, {22050, 24000, 16000}, {44100, 48000, 32000},
+};
+
+static size_t (*find_impl)(const uint8_t *, size_t);
+static pthread_once_t once_init = PTHREAD_ONCE_INIT;
+
+static uint32_t load_be32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+size_t mp3_frame_len(const uint8_t *p) {
+    uint32_t h = load_be32(p);
+    unsigned version = h >> 19 & 3, layer = h >> 17 & 3, br = h >> 12 & 15;
+    unsigned sr = h >> 10 & 3, pad = h >> 9 & 1, emphasis = h & 3;
+    bool v1 = version == 3;
+    uint32_t bitrate, rate;
+
+    if ((h & 0xFFE00000u) != 0xFFE00000u || version == 1 || layer == 0 || br == 0 ||
+        br == 15 || sr == 3 || emphasis == 2) {
+        return 0;
+    }
+    bitrate = bitrate_kbps[v1][3 - layer][br] * 1000;
+    rate = sample_rate[version][sr];
+    switch (layer) {
+    case 3: // 层 I，一个槽 4 字节
+        return (12 * bitrate / rate + pad) * 4;
+    case 2: // 层 II
+        return 144 * bitrate / rate + pad;
+    default: // 层 III，MPEG-2/2.5 每帧样本数减半
+        return (v1 ? 144 : 72) * bitrate / rate + pad;
+    }
+}
+
+// buf[i] 起是不是一个可信的帧头
+static bool frame_ok(const uint8_t *buf, size_t len, size_t i) {
+    size_t flen;
+
+    if (i + 4 > len || (flen = mp3_frame_len(buf + i)) == 0) return false;
+    if (i + flen + 4 > len) return true; // 下一帧不在这一块里，只能信这一个
+    return mp3_frame_len(buf + i + flen) != 0 &&
+           ((load_be32(buf + i) ^ load_be32(buf + i + flen)) & HDR_SAME_STREAM) == 0;
+}
+
+static size_t find_from(const uint8_t *buf, size_t len, size_t i) {
+    for (; i + 4 <= len; i++)
+        if (buf[i] == 0xFF && (buf[i + 1] & 0xE0) == 0xE0 && frame_ok(buf, len, i)) return i;
+    return len;
+}
+
+size_t mp3_sync_find_sw(const uint8_t *buf, size_t len) {
+    return find_from(buf, len, 0);
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static size_t find_sse2(const uint8_t *buf, size_t len) {
+    const __m128i ff = _mm_set1_epi8((char)0xFF), e0 = _mm_set1_epi8((char)0xE0);
+    size_t i = 0;
+
+    // 每次比较 buf[i..i+15] 和错开一个字节的 buf[i+1..i+16]
+    for (; i + 17 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(buf + i + 1));
+        unsigned m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, ff),
+                                                     _mm_cmpeq_epi8(_mm_and_si128(b, e0), e0)));
+        for (; m != 0; m &= m - 1) {
+            size_t j = i + __builtin_ctz(m);
+            if (frame_ok(buf, len, j)) return j;
+        }
+    }
+    return find_from(buf, len, i);
+}
+
+__attribute__((target("avx2")))
+static size_t find_avx2(const uint8_t *buf, size_t len) {
+    const __m256i ff = _mm256_set1_epi8((char)0xFF), e0 = _mm256_set1_epi8((char)0xE0);
+    size_t i = 0;
+
+    for (; i + 33 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(buf + i + 1));
+        unsigned m = _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, ff),
+                             _mm256_cmpeq_epi8(_mm256_and_si256(b, e0), e0)));
+        for (; m != 0; m &= m - 1) {
+            size_t j = i + __builtin_ctz(m);
+            if (frame_ok(buf, len, j)) return j;
+        }
+    }
+    return find_from(buf, len, i);
+}
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+static size_t find_neon(const uint8_t *buf, size_t len) {
+    const uint8x16_t e0 = vdupq_n_u8(0xE0);
+    size_t i = 0;
+
+    for (; i + 17 <= len; i += 16) {
+        uint8x16_t a = vld1q_u8(buf + i), b = vld1q_u8(buf + i + 1);
+        uint8x16_t eq = vandq_u8(vceqq_u8(a, vdupq_n_u8(0xFF)), vceqq_u8(vandq_u8(b, e0), e0));
+        // 每个字节压成 4 位的掩码，没有 movemask 时的常用做法
+        uint64_t m = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        for (; m != 0; m &= ~(0xFull << (__builtin_ctzll(m) & ~3))) {
+            size_t j = i + __builtin_ctzll(m) / 4;
+            if (frame_ok(buf, len, j)) return j;
+        }
+    }
+    return find_from(buf, len, i);
+}
+#endif
+
+static void module_load(void) {
+    find_impl = mp3_sync_find_sw;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        find_impl = find_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        find_impl = find_sse2;
+#elif defined(__aarch64__)
+    find_impl = find_neon;
+#endif
+}
+
+size_t mp3_sync_find(const uint8_t *buf, size_t len) {
+    pthread_once(&once_init, module_load);
+    return find_impl(buf, len);
+}
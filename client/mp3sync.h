@@ -0,0 +1,24 @@
+#ifndef MP3SYNC_H_
+#define MP3SYNC_H_
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+MPEG 音频帧同步：丢包之后接上的数据多半从一帧的中间开始，解码器要自己往后找同步字，
+期间可能把残帧当成音频放出来。接收线程发现序列号不连续时，先用这里的扫描
+找到下一个有效的帧头，把它之前的字节丢掉再交给播放器。
+*/
+
+// p 指向的 4 字节是有效帧头时返回整帧的字节数（含帧头），否则返回 0
+size_t mp3_frame_len(const uint8_t *p);
+/*
+找 buf 中第一个有效帧头的偏移，找不到返回 len。
+候选是 11 位同步字加上合法的版本、层、码率和采样率；
+下一帧的帧头也落在 buf 里时还要求它有效且版本、层、采样率相同。
+按 CPU 支持选择 AVX2/SSE2/NEON/标量实现。
+*/
+size_t mp3_sync_find(const uint8_t *buf, size_t len);
+// 标量实现，用于回退和测试对照
+size_t mp3_sync_find_sw(const uint8_t *buf, size_t len);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+帧同步扫描自测：各种版本、层和码率的帧长，从合成码流的任意偏移开始都找到下一帧的开头，
+向量实现与标量实现在随机数据和各种长度的尾部上结果一致，最后给出两者的扫描吞吐（GB/s）。
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "mp3sync.h"
+
+#define STREAM_FRAMES 400
+#define BENCH_SIZE (1 << 20)
+#define BENCH_ROUNDS 512
+
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// version: 3=MPEG-1 2=MPEG-2 0=MPEG-2.5，layer: 1=III 2=II 3=I，不带 CRC
+static uint32_t header(unsigned version, unsigned layer, unsigned br, unsigned sr, unsigned pad) {
+    return 0xFFE00000u | version << 19 | layer << 17 | 1u << 16 | br << 12 | sr << 10 | pad << 9;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static size_t frame_len_of(uint32_t h) {
+    uint8_t p[4];
+    put_be32(p, h);
+    return mp3_frame_len(p);
+}
+
+static void check_frame_len(void) {
+    check(frame_len_of(header(3, 1, 9, 0, 0)) == 417, "MPEG-1 layer III 128k 44.1k");
+    check(frame_len_of(header(3, 1, 9, 0, 1)) == 418, "padding adds one byte");
+    check(frame_len_of(header(2, 1, 8, 0, 0)) == 208, "MPEG-2 layer III 64k 22.05k");
+    check(frame_len_of(header(3, 2, 10, 1, 0)) == 576, "MPEG-1 layer II 192k 48k");
+    check(frame_len_of(header(3, 3, 1, 2, 0)) == 48, "MPEG-1 layer I 32k 32k");
+    check(frame_len_of(header(0, 1, 8, 2, 0)) == 576, "MPEG-2.5 layer III 64k 8k");
+    check(frame_len_of(header(1, 1, 9, 0, 0)) == 0, "reserved version");
+    check(frame_len_of(header(3, 0, 9, 0, 0)) == 0, "reserved layer");
+    check(frame_len_of(header(3, 1, 0, 0, 0)) == 0, "free format");
+    check(frame_len_of(header(3, 1, 15, 0, 0)) == 0, "bad bitrate");
+    check(frame_len_of(header(3, 1, 9, 3, 0)) == 0, "bad sample rate");
+    check(frame_len_of(header(3, 1, 9, 0, 0) | 2) == 0, "reserved emphasis");
+    check(frame_len_of(0x7FFB9000) == 0, "no sync word");
+}
+
+// 码率不停变化（VBR）的 MPEG-1 层 III 流，帧体是随机字节（里面会有假的同步字）
+static void check_resync(void) {
+    static uint8_t stream[STREAM_FRAMES * 1500];
+    static size_t start[STREAM_FRAMES + 1];
+    size_t len = 0, k = 0;
+
+    for (int f = 0; f < STREAM_FRAMES; f++) {
+        uint32_t h = header(3, 1, 1 + rand() % 14, 0, rand() & 1);
+        size_t flen = frame_len_of(h);
+        start[f] = len;
+        put_be32(stream + len, h);
+        for (size_t i = 4; i < flen; i++)
+            stream[len + i] = rand();
+        len += flen;
+    }
+    start[STREAM_FRAMES] = len;
+    // 从每个偏移开始（丢包后接上的位置），都应找到下一帧开头
+    for (size_t off = 0; off < start[STREAM_FRAMES - 1]; off++) {
+        while (start[k] < off) k++;
+        if (mp3_sync_find(stream + off, len - off) != start[k] - off ||
+            mp3_sync_find_sw(stream + off, len - off) != start[k] - off) {
+            fprintf(stderr, "FAIL: resync from offset %zu, want frame at %zu\n", off, start[k]);
+            failures++;
+            return;
+        }
+    }
+    printf("mp3sync: resync_offsets=%zu frames=%d\n", start[STREAM_FRAMES - 1], STREAM_FRAMES);
+}
+
+// 随机数据和所有短长度上，向量实现（含尾部处理）与标量实现一致
+static void check_matches_scalar(void) {
+    static uint8_t buf[4096];
+
+    for (int round = 0; round < 2000; round++) {
+        size_t len = round < 200 ? round : rand() % sizeof(buf);
+        for (size_t i = 0; i < len; i++)
+            buf[i] = rand() % 4 ? 0xFF : rand(); // 大量候选
+        if (len > 8 && round % 3 == 0)
+            put_be32(buf + rand() % (len - 4), header(3, 1, 9, 0, 0));
+        check(mp3_sync_find(buf, len) == mp3_sync_find_sw(buf, len), "vector scan differs");
+    }
+}
+
+static double bench(size_t (*fn)(const uint8_t *, size_t), const uint8_t *buf) {
+    volatile size_t sink = 0;
+    double start = now_sec();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+        sink += fn(buf, BENCH_SIZE);
+    return (double)BENCH_SIZE * BENCH_ROUNDS / (now_sec() - start) / 1e9;
+}
+
+int main(void) {
+    static uint8_t buf[BENCH_SIZE];
+
+    srand(1);
+    check_frame_len();
+    check_resync();
+    check_matches_scalar();
+    // 压缩数据近似随机：每 2KB 左右一个候选，基本都过不了帧头检查
+    for (size_t i = 0; i < BENCH_SIZE; i++)
+        buf[i] = rand();
+    for (size_t i = 0; i + 4 <= BENCH_SIZE; i++)
+        if (buf[i] == 0xFF && mp3_frame_len(buf + i) != 0) buf[i] = 0; // 整块都要扫完
+    printf("mp3sync: dispatch=%.2f GB/s scalar=%.2f GB/s\n", bench(mp3_sync_find, buf),
+           bench(mp3_sync_find_sw, buf));
+    printf("mp3sync: failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
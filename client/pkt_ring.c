@@ -0,0 +1,256 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "pkt_ring.h"
+
+#define REASM_MAX 65536              // IP 数据报的最大长度
+#define REASM_UNITS (REASM_MAX / 8)  // 分片偏移以 8 字节为单位
+
+// 一个正在重组的数据报；源和目的地址已经由过滤器固定，只按 IP 标识区分
+struct pkt_reasm_st {
+    uint64_t used;                   // 最近一次收到分片的 LRU 时钟，0 表示空闲
+    uint16_t id;
+    uint32_t total;                  // 数据报长度，0 表示还没收到最后一片
+    uint32_t units;                  // 已经收到的 8 字节单元数
+    uint64_t have[REASM_UNITS / 64];
+    uint8_t data[REASM_MAX];         // 从 UDP 头开始
+};
+
+/*
+SOCK_DGRAM 的包套接字上过滤器从 IP 头开始看报文：
+  ld  #proto            以太类型
+  jeq ETH_P_IP
+  ld  #type             发出的报文在回环网卡上还会再收一次，只留收到的那份
+  jeq PACKET_OUTGOING ? ld #hatype; jeq ARPHRD_LOOPBACK -> 丢弃
+  ld  [16]              目的地址
+  jeq dst_ip
+  ld  [12]              源地址
+  jeq src_ip
+  ldb [9]               协议
+  jeq IPPROTO_UDP
+  ldh [6]               不是第一片的分片没有 UDP 头，直接放行
+  jset 0x1fff           -> 放行
+  ldxb 4*([0]&0xf)
+  ldh [x + 0]           源端口
+  jeq src_port
+  ldh [x + 2]           目的端口
+  jeq dst_port          -> 放行
+  ret 0                 丢弃
+*/
+static int attach_filter(int fd, const struct sockaddr_in *dst, const struct sockaddr_in *src) {
+    struct sock_filter code[] = {
+        /* 0 */ BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+        /* 1 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 18),
+        /* 2 */ BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+        /* 3 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 0, 2),
+        /* 4 */ BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_HATYPE),
+        /* 5 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ARPHRD_LOOPBACK, 14, 0),
+        /* 6 */ BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct iphdr, daddr)),
+        /* 7 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(dst->sin_addr.s_addr), 0, 12),
+        /* 8 */ BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct iphdr, saddr)),
+        /* 9 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(src->sin_addr.s_addr), 0, 10),
+        /* 10 */ BPF_STMT(BPF_LD | BPF_B | BPF_ABS, offsetof(struct iphdr, protocol)),
+        /* 11 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 8),
+        /* 12 */ BPF_STMT(BPF_LD | BPF_H | BPF_ABS, offsetof(struct iphdr, frag_off)),
+        /* 13 */ BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, IP_OFFMASK, 5, 0),
+        /* 14 */ BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+        /* 15 */ BPF_STMT(BPF_LD | BPF_H | BPF_IND, offsetof(struct udphdr, source)),
+        /* 16 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(src->sin_port), 0, 3),
+        /* 17 */ BPF_STMT(BPF_LD | BPF_H | BPF_IND, offsetof(struct udphdr, dest)),
+        /* 18 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(dst->sin_port), 0, 1),
+        /* 19 */ BPF_STMT(BPF_RET | BPF_K, 0xffffffff), // 放行整个报文
+        /* 20 */ BPF_STMT(BPF_RET | BPF_K, 0),          // 丢弃
+    };
+    struct sock_fprog prog = {.len = sizeof(code) / sizeof(code[0]), .filter = code};
+
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+int pkt_ring_init(struct pkt_ring_st *r, const struct sockaddr_in *dst, const struct sockaddr_in *src) {
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    r->map = MAP_FAILED;
+    r->dst = *dst;
+    r->src = *src;
+    r->reasm = calloc(PKT_RING_REASM_SLOTS, sizeof(*r->reasm));
+    return r->reasm == NULL ? -1 : 0;
+}
+
+int pkt_ring_open(struct pkt_ring_st *r, const char *ifname, const struct sockaddr_in *dst,
+                  const struct sockaddr_in *src) {
+    struct tpacket_req3 req = {
+        .tp_block_size = PKT_RING_BLOCK_SIZE,
+        .tp_block_nr = PKT_RING_BLOCKS,
+        .tp_frame_size = PKT_RING_FRAME_SIZE,
+        .tp_frame_nr = PKT_RING_BLOCK_SIZE / PKT_RING_FRAME_SIZE * PKT_RING_BLOCKS,
+        .tp_retire_blk_tov = PKT_RING_BLOCK_MS,
+    };
+    struct sockaddr_ll ll = {.sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_ALL)};
+    int version = TPACKET_V3, err;
+
+    if (ifname != NULL && (ll.sll_ifindex = if_nametoindex(ifname)) == 0) return -1;
+    if (pkt_ring_init(r, dst, src) < 0) return -1;
+    // 协议先填 0，挂好过滤器和映射环之后再绑定，之前不会收进任何报文
+    r->fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (r->fd < 0 || attach_filter(r->fd, dst, src) < 0 ||
+        setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ||
+        setsockopt(r->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        goto fail;
+    }
+    r->map_len = (size_t)PKT_RING_BLOCK_SIZE * PKT_RING_BLOCKS;
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+    if (r->map == MAP_FAILED || bind(r->fd, (void *)&ll, sizeof(ll)) < 0) goto fail;
+    return 0;
+
+fail:
+    err = errno;
+    pkt_ring_close(r);
+    errno = err;
+    return -1;
+}
+
+void pkt_ring_close(struct pkt_ring_st *r) {
+    if (r->map != MAP_FAILED) munmap(r->map, r->map_len);
+    if (r->fd >= 0) close(r->fd);
+    free(r->reasm);
+    r->map = MAP_FAILED;
+    r->fd = -1;
+    r->reasm = NULL;
+}
+
+// 收下一个分片，数据报收齐时返回从 UDP 头开始的数据，*len 为它的长度
+static uint8_t *reasm_add(struct pkt_ring_st *r, const struct iphdr *iph, const uint8_t *frag,
+                          size_t flen, size_t *len) {
+    struct pkt_reasm_st *slot = NULL, *victim = &r->reasm[0];
+    unsigned frag_off = ntohs(iph->frag_off);
+    size_t off = (frag_off & IP_OFFMASK) * 8;
+    bool more = frag_off & IP_MF;
+
+    // 除最后一片外分片长度都是 8 的倍数
+    if (off + flen > REASM_MAX || (more && (flen == 0 || flen % 8 != 0))) {
+        r->malformed++;
+        return NULL;
+    }
+    for (int i = 0; i < PKT_RING_REASM_SLOTS; i++) {
+        struct pkt_reasm_st *s = &r->reasm[i];
+        if (s->used != 0 && s->id == iph->id) {
+            slot = s;
+            break;
+        }
+        if (s->used < victim->used) victim = s;
+    }
+    if (slot == NULL) {
+        // 没有空闲槽位时挤掉最久没有动静的数据报，它的分片多半已经丢了
+        if (victim->used != 0) r->reasm_dropped++;
+        slot = victim;
+        slot->id = iph->id;
+        slot->total = 0;
+        slot->units = 0;
+        memset(slot->have, 0, sizeof(slot->have));
+    }
+    slot->used = ++r->stamp;
+    memcpy(slot->data + off, frag, flen);
+    for (size_t u = off / 8; u < (off + flen + 7) / 8; u++) {
+        if (slot->have[u / 64] & 1ull << u % 64) continue;
+        slot->have[u / 64] |= 1ull << u % 64;
+        slot->units++;
+    }
+    if (!more) slot->total = off + flen;
+    if (slot->total == 0 || slot->units != (slot->total + 7) / 8) return NULL;
+    slot->used = 0;
+    r->reassembled++;
+    *len = slot->total;
+    return slot->data;
+}
+
+void pkt_ring_input(struct pkt_ring_st *r, uint8_t *ip, size_t len, const struct timespec *ts,
+                    pkt_ring_fn fn, void *arg) {
+    const struct iphdr *iph = (void *)ip;
+    struct udphdr *uh;
+    size_t hlen, tot, ulen;
+    uint8_t *body;
+
+    if (len < sizeof(*iph) || iph->version != 4 || iph->ihl < 5) {
+        r->malformed++;
+        return;
+    }
+    hlen = iph->ihl * 4;
+    tot = ntohs(iph->tot_len);
+    if (tot < hlen || tot > len) {
+        r->malformed++;
+        return;
+    }
+    // 过滤器已经挑过一遍，这里再核对一次（过滤器挂上之前排队的报文）
+    if (iph->daddr != r->dst.sin_addr.s_addr || iph->saddr != r->src.sin_addr.s_addr ||
+        iph->protocol != IPPROTO_UDP) {
+        return;
+    }
+    body = ip + hlen;
+    len = tot - hlen;
+    if (ntohs(iph->frag_off) & (IP_MF | IP_OFFMASK)) {
+        r->fragments++;
+        body = reasm_add(r, iph, body, len, &len);
+        if (body == NULL) return;
+    }
+
+    uh = (void *)body;
+    if (len < sizeof(*uh) || (ulen = ntohs(uh->len)) < sizeof(*uh) || ulen > len) {
+        r->malformed++;
+        return;
+    }
+    if (uh->source != r->src.sin_port || uh->dest != r->dst.sin_port) return;
+    r->packets++;
+    fn(arg, body + sizeof(*uh), ulen - sizeof(*uh), ts);
+}
+
+int pkt_ring_read(struct pkt_ring_st *r, int timeout_ms, pkt_ring_fn fn, void *arg) {
+    struct tpacket_block_desc *bd = (void *)(r->map + (size_t)r->cur * PKT_RING_BLOCK_SIZE);
+    struct pollfd pfd = {.fd = r->fd, .events = POLLIN | POLLERR};
+    struct tpacket3_hdr *ph;
+    unsigned n;
+
+    if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+        if (poll(&pfd, 1, timeout_ms) < 0) return errno == EINTR ? 0 : -1;
+        if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+            return 0;
+    }
+    n = bd->hdr.bh1.num_pkts;
+    ph = (void *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+    for (unsigned i = 0; i < n; i++) {
+        struct timespec ts = {.tv_sec = ph->tp_sec, .tv_nsec = ph->tp_nsec};
+        if (ph->tp_snaplen < ph->tp_len)
+            r->malformed++; // 被截断
+        else
+            pkt_ring_input(r, (uint8_t *)ph + ph->tp_net, ph->tp_snaplen, &ts, fn, arg);
+        ph = (void *)((uint8_t *)ph + ph->tp_next_offset);
+    }
+    // 整块还给内核
+    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    r->cur = (r->cur + 1) % PKT_RING_BLOCKS;
+    r->blocks++;
+    return n;
+}
+
+int pkt_ring_kernel_stats(struct pkt_ring_st *r, unsigned *packets, unsigned *drops) {
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+
+    if (getsockopt(r->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) < 0) return -1;
+    *packets = st.tp_packets;
+    *drops = st.tp_drops;
+    return 0;
+}
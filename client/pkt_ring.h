@@ -0,0 +1,62 @@
+#ifndef PKT_RING_H_
+#define PKT_RING_H_
+#include <netinet/in.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+AF_PACKET 映射环（TPACKET_V3）收包：内核把报文直接放进和用户态共享的内存块，
+一块攒满或者超过 PKT_RING_BLOCK_MS 就整块交给用户态，一次 poll 处理一整块报文，
+没有逐包的系统调用和拷贝。套接字上挂经典 BPF 过滤器，只留下 src 发往 dst 的 UDP 报文
+（含它们的 IP 分片），IP/UDP 头在用户态解析，分片在用户态重组。
+在 ETH_P_ALL 上收，本机发出的组播也能看到（本机既是服务端又是客户端时）；
+回环网卡上同一个报文出入各一次，过滤器丢掉发出的那份。
+需要 CAP_NET_RAW。
+*/
+#define PKT_RING_BLOCK_SIZE (1 << 20) // 每块 1MB
+#define PKT_RING_BLOCKS 64            // 共 64MB
+#define PKT_RING_FRAME_SIZE 2048
+#define PKT_RING_BLOCK_MS 10          // 块没满时最多等这么久就交给用户态
+#define PKT_RING_REASM_SLOTS 16       // 同时重组的数据报个数
+#define PKT_RING_HEADROOM 8           // 回调拿到的负载前面可以随便写的字节数（原来的 UDP 头）
+
+// 一个 UDP 负载；ts 是内核收到（或发出）它的时刻，CLOCK_REALTIME
+typedef void (*pkt_ring_fn)(void *arg, uint8_t *payload, size_t len, const struct timespec *ts);
+
+struct pkt_reasm_st;
+
+struct pkt_ring_st {
+    int fd;
+    uint8_t *map;
+    size_t map_len;
+    unsigned cur;                     // 下一个要看的块
+    struct sockaddr_in dst, src;
+    struct pkt_reasm_st *reasm;       // 分片重组槽位
+    uint64_t stamp;                   // 重组槽位的 LRU 时钟
+    // 统计（只由读的线程修改）
+    uint64_t blocks;                  // 处理过的块
+    uint64_t packets;                 // 交给回调的 UDP 负载
+    uint64_t fragments;               // 收到的 IP 分片
+    uint64_t reassembled;             // 重组完成的数据报
+    uint64_t reasm_dropped;           // 没等到全部分片就被挤掉的数据报
+    uint64_t malformed;               // 头部不对或者被截断的报文
+};
+
+// 只准备用户态的解析和重组状态，不打开套接字（pkt_ring_input 单独用时）
+int pkt_ring_init(struct pkt_ring_st *r, const struct sockaddr_in *dst, const struct sockaddr_in *src);
+// ifname 为 NULL 时收所有网卡；成功返回 0，失败返回 -1 并设置 errno
+int pkt_ring_open(struct pkt_ring_st *r, const char *ifname, const struct sockaddr_in *dst,
+                  const struct sockaddr_in *src);
+void pkt_ring_close(struct pkt_ring_st *r);
+/*
+等最多 timeout_ms 毫秒拿到一个交给用户态的块，对其中每个 UDP 负载调用 fn，
+然后把块还给内核。返回这一块的报文数，超时或者被信号打断返回 0，出错返回 -1。
+*/
+int pkt_ring_read(struct pkt_ring_st *r, int timeout_ms, pkt_ring_fn fn, void *arg);
+// 解析一个 IPv4 报文（环里的每个报文都走这里），必要时重组分片，得到完整的负载时调用 fn
+void pkt_ring_input(struct pkt_ring_st *r, uint8_t *ip, size_t len, const struct timespec *ts,
+                    pkt_ring_fn fn, void *arg);
+// 内核的统计（读一次清零一次）：过滤器放行的报文（含丢掉的）和因为环满丢掉的报文
+int pkt_ring_kernel_stats(struct pkt_ring_st *r, unsigned *packets, unsigned *drops);
+
+#endif
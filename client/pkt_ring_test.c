@@ -0,0 +1,231 @@
+/*
+映射环收包自测：先用手工构造的 IP 报文检查解析和分片重组（乱序、重复的分片，
+别的来源和端口，截断的报文，重组槽位被挤掉）；有 CAP_NET_RAW 时再在回环网卡上
+真正打开映射环，检查服务端的报文各收到一次、内容不变，陌生来源和别的端口被过滤掉。
+*/
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "pkt_ring.h"
+
+#define BIG_LEN 40000   // 在回环网卡上也不分片的大报文
+#define FRAG_LEN 3000   // 手工切成三片的数据报
+#define LIVE_PACKETS 200
+
+static int failures;
+
+struct got_st {
+    int count;
+    size_t bytes;
+    size_t last_len;
+    uint8_t last[BIG_LEN];
+    int bad_ts;
+};
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void on_payload(void *arg, uint8_t *payload, size_t len, const struct timespec *ts) {
+    struct got_st *got = arg;
+
+    got->count++;
+    got->bytes += len;
+    got->last_len = len;
+    if (len <= sizeof(got->last)) memcpy(got->last, payload, len);
+    if (ts->tv_sec == 0) got->bad_ts++;
+    memset(payload - PKT_RING_HEADROOM, 0xAA, PKT_RING_HEADROOM); // 允许写负载前面的字节
+}
+
+static uint8_t pattern(size_t i) {
+    return (uint8_t)(i * 7 + (i >> 8));
+}
+
+// 构造一个 IP 报文（或者一个分片），body 是 UDP 头和负载里 [off, off + len) 这一段
+static size_t build_ip(uint8_t *pkt, const struct sockaddr_in *src, const struct sockaddr_in *dst,
+                       uint16_t id, size_t off, bool more, const uint8_t *body, size_t len) {
+    struct iphdr *iph = (void *)pkt;
+
+    memset(iph, 0, sizeof(*iph));
+    iph->version = 4;
+    iph->ihl = 5;
+    iph->ttl = 1;
+    iph->protocol = IPPROTO_UDP;
+    iph->id = htons(id);
+    iph->saddr = src->sin_addr.s_addr;
+    iph->daddr = dst->sin_addr.s_addr;
+    iph->frag_off = htons(off / 8 | (more ? IP_MF : 0));
+    iph->tot_len = htons(sizeof(*iph) + len);
+    memcpy(pkt + sizeof(*iph), body + off, len);
+    return sizeof(*iph) + len;
+}
+
+// UDP 头加 plen 字节的负载
+static size_t build_udp(uint8_t *body, const struct sockaddr_in *src, const struct sockaddr_in *dst,
+                        size_t plen) {
+    struct udphdr *uh = (void *)body;
+
+    uh->source = src->sin_port;
+    uh->dest = dst->sin_port;
+    uh->len = htons(sizeof(*uh) + plen);
+    uh->check = 0;
+    for (size_t i = 0; i < plen; i++)
+        body[sizeof(*uh) + i] = pattern(i);
+    return sizeof(*uh) + plen;
+}
+
+static bool payload_ok(const struct got_st *got, size_t plen) {
+    if (got->last_len != plen) return false;
+    for (size_t i = 0; i < plen; i++)
+        if (got->last[i] != pattern(i)) return false;
+    return true;
+}
+
+static void check_input(void) {
+    static uint8_t body[FRAG_LEN + 8], pkt[FRAG_LEN + 64];
+    static struct got_st got;
+    struct sockaddr_in src = {.sin_family = AF_INET, .sin_port = htons(4000)};
+    struct sockaddr_in dst = {.sin_family = AF_INET, .sin_port = htons(1989)};
+    struct sockaddr_in other = src;
+    struct timespec ts = {.tv_sec = 1};
+    struct pkt_ring_st r;
+    size_t blen, n;
+
+    inet_pton(AF_INET, "192.0.2.1", &src.sin_addr);
+    inet_pton(AF_INET, "224.2.2.2", &dst.sin_addr);
+    inet_pton(AF_INET, "192.0.2.9", &other.sin_addr);
+    if (pkt_ring_init(&r, &dst, &src) < 0) {
+        perror("pkt_ring_init");
+        failures++;
+        return;
+    }
+
+    // 不分片的报文
+    blen = build_udp(body, &src, &dst, 1000);
+    n = build_ip(pkt, &src, &dst, 1, 0, false, body, blen);
+    pkt_ring_input(&r, pkt, n + 4, &ts, on_payload, &got); // 尾部填充被忽略
+    check(got.count == 1 && payload_ok(&got, 1000), "whole datagram");
+
+    // 三片，乱序，中间一片重复
+    blen = build_udp(body, &src, &dst, FRAG_LEN);
+    n = build_ip(pkt, &src, &dst, 2, 2400, false, body, blen - 2400);
+    pkt_ring_input(&r, pkt, n, &ts, on_payload, &got);
+    n = build_ip(pkt, &src, &dst, 2, 1200, true, body, 1200);
+    pkt_ring_input(&r, pkt, n, &ts, on_payload, &got);
+    pkt_ring_input(&r, pkt, n, &ts, on_payload, &got);
+    check(got.count == 1, "incomplete datagram must wait");
+    n = build_ip(pkt, &src, &dst, 2, 0, true, body, 1200);
+    pkt_ring_input(&r, pkt, n, &ts, on_payload, &got);
+    check(got.count == 2 && payload_ok(&got, FRAG_LEN), "reassembled datagram");
+    check(r.fragments == 4 && r.reassembled == 1, "fragment counters");
+
+    // 别的来源、别的端口
+    n = build_ip(pkt, &other, &dst, 3, 0, false, body, build_udp(body, &other, &dst, 100));
+    pkt_ring_input(&r, pkt, n, &ts, on_payload, &got);
+    other = src;
+    other.sin_port = htons(4001);
+    n = build_ip(pkt, &src, &dst, 4, 0, false, body, build_udp(body, &other, &dst, 100));
+    pkt_ring_input(&r, pkt, n, &ts, on_payload, &got);
+    check(got.count == 2, "foreign source and port must be ignored");
+
+    // 截断：IP 总长度超过收到的长度，UDP 长度超过 IP 负载
+    n = build_ip(pkt, &src, &dst, 5, 0, false, body, build_udp(body, &src, &dst, 100));
+    pkt_ring_input(&r, pkt, n - 1, &ts, on_payload, &got);
+    ((struct udphdr *)(pkt + sizeof(struct iphdr)))->len = htons(200);
+    pkt_ring_input(&r, pkt, n, &ts, on_payload, &got);
+    check(got.count == 2 && r.malformed == 2, "truncated packets");
+
+    // 槽位用完时挤掉最久没动静的数据报
+    blen = build_udp(body, &src, &dst, FRAG_LEN);
+    for (int id = 100; id <= 100 + PKT_RING_REASM_SLOTS; id++) {
+        n = build_ip(pkt, &src, &dst, id, 0, true, body, 1200);
+        pkt_ring_input(&r, pkt, n, &ts, on_payload, &got);
+    }
+    check(r.reasm_dropped == 1, "oldest partial datagram is evicted");
+    printf("pkt_ring input: fragments=%llu reassembled=%llu evicted=%llu malformed=%llu\n",
+           (unsigned long long)r.fragments, (unsigned long long)r.reassembled,
+           (unsigned long long)r.reasm_dropped, (unsigned long long)r.malformed);
+    pkt_ring_close(&r);
+}
+
+static int udp_socket(struct sockaddr_in *addr) {
+    socklen_t len = sizeof(*addr);
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (sd < 0 || bind(sd, (void *)addr, sizeof(*addr)) < 0 ||
+        getsockname(sd, (void *)addr, &len) < 0) {
+        perror("udp_socket");
+        return -1;
+    }
+    return sd;
+}
+
+static void check_live(void) {
+    static uint8_t buf[BIG_LEN];
+    static struct got_st got;
+    struct sockaddr_in raddr, saddr, faddr, oaddr;
+    int rsd = udp_socket(&raddr), server = udp_socket(&saddr), foreign = udp_socket(&faddr);
+    int other = udp_socket(&oaddr);
+    struct pkt_ring_st r;
+    unsigned kpackets = 0, kdrops = 0;
+
+    if (rsd < 0 || server < 0 || foreign < 0 || other < 0) {
+        failures++;
+        return;
+    }
+    if (pkt_ring_open(&r, "lo", &raddr, &saddr) < 0) {
+        if (errno == EPERM || errno == EACCES) {
+            printf("pkt_ring live: skipped, no CAP_NET_RAW\n");
+        } else {
+            perror("pkt_ring_open");
+            failures++;
+        }
+        return;
+    }
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = pattern(i);
+    for (int i = 0; i < LIVE_PACKETS; i++) {
+        sendto(server, buf, 1000, 0, (void *)&raddr, sizeof(raddr));
+        sendto(foreign, buf, 1000, 0, (void *)&raddr, sizeof(raddr));
+        sendto(server, buf, 1000, 0, (void *)&oaddr, sizeof(oaddr));
+    }
+    sendto(server, buf, BIG_LEN, 0, (void *)&raddr, sizeof(raddr));
+    // 等最后一块超时交出来
+    for (int i = 0; i < 50 && got.count < LIVE_PACKETS + 1; i++) {
+        if (pkt_ring_read(&r, 100, on_payload, &got) < 0) {
+            perror("pkt_ring_read");
+            break;
+        }
+    }
+    pkt_ring_read(&r, 3 * PKT_RING_BLOCK_MS, on_payload, &got); // 不应该再有重复的
+    pkt_ring_kernel_stats(&r, &kpackets, &kdrops);
+    printf("pkt_ring live: payloads=%d bytes=%zu blocks=%llu kernel_packets=%u drops=%u\n",
+           got.count, got.bytes, (unsigned long long)r.blocks, kpackets, kdrops);
+    check(got.count == LIVE_PACKETS + 1, "each server packet exactly once");
+    check(payload_ok(&got, BIG_LEN), "big datagram intact");
+    check(got.bad_ts == 0, "kernel timestamps");
+    pkt_ring_close(&r);
+    close(rsd);
+    close(server);
+    close(foreign);
+    close(other);
+}
+
+int main(void) {
+    check_input();
+    check_live();
+    printf("failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,487 @@
+#define _GNU_SOURCE          // recvmmsg()
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/packet.h"
+#include "chn_filter.h"
+#include "fec_dec.h"
+#include "metrics.h"
+#include "pkt_ring.h"
+#include "recorder.h"
+#include "relay.h"
+#include "ring_buffer.h"
+
+#define REC_BATCH 32          // 每次 recvmmsg() 最多收的报文数
+#define REC_POLL_MS 100       // 检查停止标志的间隔
+
+// 接收线程交给工作线程的记录：记录头 + 原始报文
+struct rec_hdr_st {
+    uint32_t len;             // 报文长度
+    uint32_t arrival;         // 到达时刻 packet_now_ms()
+};
+// 映射环交出的负载前面只有原来的 UDP 头可以用来放记录头
+_Static_assert(sizeof(struct rec_hdr_st) <= PKT_RING_HEADROOM, "record header must fit the UDP header");
+
+/*
+每个频道的状态，只由负责它的工作线程修改（overrun 由接收线程修改）。
+统计是原子的，每个只有一个写者，用 metric_add/metric_set，统计线程用 metric_get 读
+*/
+struct rec_chn_st {
+    int fd;                           // 录制文件，-1 表示还没打开或不录制
+    char *buf;                        // 攒批写入的缓冲区
+    size_t buflen;
+    struct fec_dec_st fec;
+    bool started;                     // expected 是否有效
+    uint32_t expected;                // 下一个期望的序列号
+    bool written;                     // next_write 是否有效
+    uint32_t next_write;              // 下一个要写入文件的序列号
+    bool have_transit;
+    int32_t transit;                  // 上一个包的 到达时刻 - 时间戳
+    double jitter;                    // RFC 3550 到达间隔抖动（毫秒，工作线程私有）
+    atomic_long jitter_us;            // 给统计线程看的 jitter（微秒）
+    atomic_long packets;
+    atomic_long bytes;
+    atomic_long lost;
+    atomic_long late;
+    atomic_long corrupt;
+    atomic_long recovered;
+    atomic_long overrun;              // 工作线程处理不过来，接收线程丢弃的包
+    long report_bytes;                // 上次输出统计时的 bytes（统计线程私有）
+};
+
+struct rec_worker_st {
+    pthread_t tid;
+    struct ring_buffer *rb;
+    bool dirty;                       // 这一批有没有写入（接收线程私有）
+};
+
+static const struct recorder_conf_st *rconf;
+static struct rec_chn_st chans[MAXCHNID + 1];
+static struct rec_worker_st workers[RECORDER_WORKERS_MAX];
+static volatile sig_atomic_t rec_stop;
+static atomic_bool rec_receiver_done; // release 置位，工作线程 acquire 读到后环形缓冲区里已是全部数据
+static int rec_sd;
+static struct sockaddr_in rec_server;
+static bool rec_use_ring;
+static struct pkt_ring_st rec_ring;
+static unsigned long long ring_kernel_packets, ring_kernel_drops; // 统计线程累加
+static bool rec_relay_on;
+static struct relay_st rec_relay;
+
+static void rec_sig_handler(int s) {
+    rec_stop = 1;
+}
+
+int recorder_parse_channels(const char *spec, bool *chn) {
+    char *copy, *tok, *save = NULL;
+    int lo, hi, n, ret = 0;
+
+    memset(chn, 0, sizeof(bool) * (MAXCHNID + 1));
+    if (strcmp(spec, "all") == 0) {
+        for (int i = MINCHNID; i <= MAXCHNID; i++) chn[i] = true;
+        return 0;
+    }
+    copy = strdup(spec);
+    if (copy == NULL) return -1;
+    for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        n = sscanf(tok, "%d-%d", &lo, &hi);
+        if (n == 1) hi = lo;
+        if (n < 1 || lo < MINCHNID || hi > MAXCHNID || lo > hi) {
+            ret = -1;
+            break;
+        }
+        for (int i = lo; i <= hi; i++) chn[i] = true;
+    }
+    free(copy);
+    return ret;
+}
+
+static void chn_flush(struct rec_chn_st *c) {
+    size_t pos = 0;
+    ssize_t n;
+
+    while (pos < c->buflen) {
+        n = write(c->fd, c->buf + pos, c->buflen - pos);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write recording");
+            break;
+        }
+        pos += n;
+    }
+    c->buflen = 0;
+}
+
+// FEC 解码器按序交付的数据（ordered）：做中继时发布出去；录制时攒进缓冲区，满了一次写出
+static void chn_deliver(void *arg, uint32_t seq, uint32_t ts, const uint8_t *data, size_t len) {
+    struct rec_chn_st *c = arg;
+    char path[4096];
+
+    if (c->written && (int32_t)(seq - c->next_write) < 0) return; // 迟到的重复包
+    c->written = true;
+    c->next_write = seq + 1;
+    if (rec_relay_on) relay_publish(&rec_relay, c - chans, data, len);
+    if (rconf->dir == NULL) return;
+    if (c->fd < 0) {
+        snprintf(path, sizeof(path), "%s/ch%03d.mp3", rconf->dir, (int)(c - chans));
+        c->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        c->buf = malloc(RECORDER_FILEBUF);
+        if (c->fd < 0 || c->buf == NULL) {
+            perror(path);
+            if (c->fd >= 0) close(c->fd);
+            free(c->buf);
+            c->fd = -1;
+            c->buf = NULL;
+            return;
+        }
+    }
+    if (c->buflen + len > RECORDER_FILEBUF) chn_flush(c);
+    memcpy(c->buf + c->buflen, data, len);
+    c->buflen += len;
+}
+
+// 工作线程处理一个频道报文：校验、统计、交给 FEC 解码器
+static void chn_packet(struct msg_channel_st *msg, int len, uint32_t arrival) {
+    struct rec_chn_st *c;
+    uint32_t seq, ts;
+    size_t data_len;
+    int32_t transit, d;
+
+    if (packet_verify(msg, len) != PACKET_OK) {
+        int chnid = ntohs(msg->hdr.channel_id);
+        if (chnid >= MINCHNID && chnid <= MAXCHNID) metric_add(&chans[chnid].corrupt, 1);
+        return;
+    }
+    c = &chans[ntohs(msg->hdr.channel_id)];
+    seq = ntohl(msg->hdr.sequence);
+    data_len = ntohs(msg->hdr.data_len);
+
+    if (ntohl(msg->hdr.magic) == PACKET_MAGIC_FEC) {
+        if (data_len >= sizeof(struct fec_header)) {
+            fec_dec_parity(&c->fec, seq, (struct fec_header *)msg->data,
+                           msg->data + sizeof(struct fec_header),
+                           data_len - sizeof(struct fec_header));
+            metric_set(&c->recovered, c->fec.recovered);
+        }
+        return;
+    }
+
+    metric_add(&c->packets, 1);
+    metric_add(&c->bytes, data_len);
+    if (!c->started) {
+        c->started = true;
+        c->expected = seq + 1;
+    } else if ((int32_t)(seq - c->expected) < 0) {
+        metric_add(&c->late, 1); // 重传或乱序
+    } else {
+        metric_add(&c->lost, seq - c->expected);
+        c->expected = seq + 1;
+    }
+
+    // RFC 3550 的到达间隔抖动，时间戳是服务端发送时刻
+    ts = ntohl(msg->hdr.timestamp);
+    transit = (int32_t)(arrival - ts);
+    if (c->have_transit) {
+        d = transit - c->transit;
+        if (d < 0) d = -d;
+        c->jitter += (d - c->jitter) / 16.0;
+        metric_set(&c->jitter_us, c->jitter * 1000);
+    }
+    c->transit = transit;
+    c->have_transit = true;
+
+    fec_dec_data(&c->fec, seq, ts, msg->data, data_len);
+    metric_set(&c->recovered, c->fec.recovered);
+}
+
+// 从环形缓冲区读出 len 字节（可能绕回），接收线程结束且没有数据时返回 -1
+static int ring_read(struct ring_buffer *rb, void *dst, size_t len) {
+    size_t got = 0, n;
+    char *p;
+
+    while (got < len) {
+        n = ring_buffer_read_peek(rb, 0, &p, REC_POLL_MS);
+        if (n == 0) {
+            // 看到结束标志之后再看一次，接收线程最后提交的数据不会漏掉
+            if (atomic_load_explicit(&rec_receiver_done, memory_order_acquire) &&
+                ring_buffer_read_peek(rb, 0, &p, 0) == 0)
+                return -1;
+            continue;
+        }
+        if (n > len - got) n = len - got;
+        memcpy((char *)dst + got, p, n);
+        ring_buffer_read_commit(rb, n);
+        got += n;
+    }
+    return 0;
+}
+
+static void *rec_worker(void *arg) {
+    struct rec_worker_st *w = arg;
+    struct rec_hdr_st hdr;
+    char *pkt = malloc(MSG_CHANNEL_MAX);
+
+    if (pkt == NULL) {
+        perror("malloc in rec_worker");
+        return NULL;
+    }
+    while (ring_read(w->rb, &hdr, sizeof(hdr)) == 0 &&
+           ring_read(w->rb, pkt, hdr.len) == 0) {
+        chn_packet((struct msg_channel_st *)pkt, hdr.len, hdr.arrival);
+    }
+    free(pkt);
+    return NULL;
+}
+
+// 按频道号把报文分给工作线程；msg 前面要留出记录头的位置，整条记录一次放进环形缓冲区
+static void rec_dispatch(struct msg_channel_st *msg, int len, uint32_t arrival) {
+    struct rec_hdr_st *hdr = (void *)((char *)msg - sizeof(*hdr));
+    struct rec_worker_st *w;
+    int chnid;
+
+    if (len < (int)sizeof(struct packet_header) || *(chnid_t *)msg == LISTCHNID) return;
+    chnid = ntohs(msg->hdr.channel_id);
+    if (chnid < MINCHNID || chnid > MAXCHNID || !rconf->chn[chnid]) return;
+    w = &workers[chnid % rconf->workers];
+    hdr->len = len;
+    hdr->arrival = arrival;
+    if (ring_buffer_stage(w->rb, hdr, sizeof(*hdr) + len) < 0)
+        metric_add(&chans[chnid].overrun, 1);
+    else
+        w->dirty = true;
+}
+
+// 每个工作线程每批只提交、唤醒一次
+static void rec_commit(void) {
+    for (int i = 0; i < rconf->workers; i++) {
+        if (workers[i].dirty) {
+            ring_buffer_write_commit(workers[i].rb, 0);
+            workers[i].dirty = false;
+        }
+    }
+}
+
+// 接收线程：批量收包，只看来源和频道号，按频道分给工作线程
+static void *rec_receiver(void *arg) {
+    struct mmsghdr msgs[REC_BATCH];
+    struct iovec iov[REC_BATCH];
+    struct sockaddr_in raddr[REC_BATCH];
+    struct pollfd pfd = {.fd = rec_sd, .events = POLLIN};
+    const size_t slot_size = (sizeof(struct rec_hdr_st) + MSG_CHANNEL_MAX + 7) & ~(size_t)7;
+    char *slots = malloc(REC_BATCH * slot_size);
+    int n;
+
+    if (slots == NULL) {
+        perror("malloc in rec_receiver");
+        rec_stop = 1;
+        atomic_store_explicit(&rec_receiver_done, true, memory_order_release);
+        return NULL;
+    }
+    // 每个槽位前面留出记录头，整条记录一次放进环形缓冲区
+    for (int i = 0; i < REC_BATCH; i++) {
+        iov[i].iov_base = slots + i * slot_size + sizeof(struct rec_hdr_st);
+        iov[i].iov_len = MSG_CHANNEL_MAX;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &raddr[i];
+    }
+
+    while (!rec_stop) {
+        if (poll(&pfd, 1, REC_POLL_MS) <= 0) continue;
+        for (int i = 0; i < REC_BATCH; i++)
+            msgs[i].msg_hdr.msg_namelen = sizeof(raddr[i]);
+        n = recvmmsg(rec_sd, msgs, REC_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            perror("recvmmsg in rec_receiver");
+            rec_stop = 1;
+            break;
+        }
+        uint32_t now = packet_now_ms();
+        for (int i = 0; i < n; i++) {
+            if (raddr[i].sin_addr.s_addr != rec_server.sin_addr.s_addr ||
+                raddr[i].sin_port != rec_server.sin_port) {
+                continue;
+            }
+            rec_dispatch(iov[i].iov_base, msgs[i].msg_len, now);
+        }
+        rec_commit();
+    }
+    free(slots);
+    atomic_store_explicit(&rec_receiver_done, true, memory_order_release);
+    return NULL;
+}
+
+// 映射环交出的一个负载，到达时刻用内核时间戳，不受整块交付的延迟影响
+static void rec_ring_payload(void *arg, uint8_t *payload, size_t len, const struct timespec *ts) {
+    rec_dispatch((void *)payload, len, (uint32_t)((uint64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000));
+}
+
+// 映射环版本的接收线程：一次处理内核交出的一整块，每块提交一次
+static void *rec_receiver_ring(void *arg) {
+    while (!rec_stop) {
+        if (pkt_ring_read(&rec_ring, REC_POLL_MS, rec_ring_payload, NULL) < 0) {
+            perror("pkt_ring_read in rec_receiver_ring");
+            rec_stop = 1;
+            break;
+        }
+        rec_commit();
+    }
+    atomic_store_explicit(&rec_receiver_done, true, memory_order_release);
+    return NULL;
+}
+
+// 输出每个频道的统计；码率是这段时间的平均值，最终报告用整个运行时间的平均值
+static void report(int interval, bool final) {
+    long tot_packets = 0, tot_lost = 0, tot_bytes = 0;
+    int active = 0;
+
+    printf("%s\n", final ? "== final report ==" : "== channel report ==");
+    printf("chn      kbps   packets     lost    late recovered corrupt overrun jitter_ms\n");
+    for (int i = MINCHNID; i <= MAXCHNID; i++) {
+        struct rec_chn_st *c = &chans[i];
+        long bytes = metric_get(&c->bytes), packets = metric_get(&c->packets);
+        long lost = metric_get(&c->lost);
+        if (!rconf->chn[i] || packets == 0) continue;
+        printf("%3d %9.1f %9ld %8ld %7ld %9ld %7ld %7ld %9.1f\n", i,
+               (final ? bytes : bytes - c->report_bytes) * 8.0 / 1000 / (interval ? interval : 1),
+               packets, lost, metric_get(&c->late), metric_get(&c->recovered),
+               metric_get(&c->corrupt), metric_get(&c->overrun), metric_get(&c->jitter_us) / 1000.0);
+        c->report_bytes = bytes;
+        tot_packets += packets;
+        tot_lost += lost;
+        tot_bytes += bytes;
+        active++;
+    }
+    printf("active channels %d, packets %ld, lost %ld, bytes %ld\n",
+           active, tot_packets, tot_lost, tot_bytes);
+    if (rec_use_ring) {
+        unsigned kpackets, kdrops;
+        if (pkt_ring_kernel_stats(&rec_ring, &kpackets, &kdrops) == 0) {
+            ring_kernel_packets += kpackets;
+            ring_kernel_drops += kdrops;
+        }
+        printf("packet ring: blocks %llu, packets %llu, kernel drops %llu/%llu, "
+               "fragments %llu, reassembled %llu, evicted %llu, malformed %llu\n",
+               (unsigned long long)rec_ring.blocks, (unsigned long long)rec_ring.packets,
+               ring_kernel_drops, ring_kernel_packets, (unsigned long long)rec_ring.fragments,
+               (unsigned long long)rec_ring.reassembled, (unsigned long long)rec_ring.reasm_dropped,
+               (unsigned long long)rec_ring.malformed);
+    }
+    fflush(stdout);
+}
+
+int recorder_run(int sd, const struct sockaddr_in *server, const struct recorder_conf_st *conf) {
+    struct sigaction sa;
+    pthread_t rtid;
+    time_t start = time(NULL), last_report;
+    int nworker = 0, ret = 0;
+
+    rconf = conf;
+    rec_sd = sd;
+    rec_server = *server;
+    for (int i = 0; i <= MAXCHNID; i++) {
+        chans[i].fd = -1;
+        fec_dec_init(&chans[i].fec, chn_deliver, &chans[i]);
+        chans[i].fec.ordered = true; // 没有抖动缓冲区，文件和中继都要按序的数据
+    }
+
+    if (conf->relay) {
+        if (relay_open(&rec_relay, conf->relay, conf->list, conf->list_len) < 0) {
+            perror(conf->relay);
+            return 1;
+        }
+        rec_relay_on = true;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = rec_sig_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (conf->ring) {
+        if (pkt_ring_open(&rec_ring, conf->ring_if, &conf->group, server) == 0) {
+            rec_use_ring = true;
+        } else {
+            perror("pkt_ring_open, falling back to recvmmsg");
+        }
+    }
+    // 用映射环时 UDP 套接字只用来保持组播成员关系，报文在内核里全部丢掉，省得再拷一份
+    if (rec_use_ring) {
+        if (chn_filter_drop_all(sd) < 0) perror("chn_filter_drop_all");
+    } else if (chn_filter_attach(sd, server, CHN_FILTER_ALL) < 0) {
+        perror("chn_filter_attach");
+    }
+
+    for (; nworker < conf->workers; nworker++) {
+        struct rec_worker_st *w = &workers[nworker];
+        w->rb = aligned_alloc(RING_CACHELINE, sizeof(struct ring_buffer));
+        if (w->rb == NULL || ring_buffer_init(w->rb) < 0) {
+            perror("recorder ring buffer");
+            free(w->rb);
+            ret = 1;
+            break;
+        }
+        if (pthread_create(&w->tid, NULL, rec_worker, w) != 0) {
+            perror("pthread_create worker");
+            ring_buffer_destroy(w->rb);
+            free(w->rb);
+            ret = 1;
+            break;
+        }
+    }
+    if (ret == 0 &&
+        pthread_create(&rtid, NULL, rec_use_ring ? rec_receiver_ring : rec_receiver, NULL) != 0) {
+        perror("pthread_create receiver");
+        ret = 1;
+    }
+    if (ret != 0) {
+        rec_stop = 1;
+        atomic_store_explicit(&rec_receiver_done, true, memory_order_release);
+    } else {
+        fprintf(stderr, "Recorder started: %d workers, %s, %s%s%s\n", conf->workers,
+                conf->dir ? conf->dir : "monitor only", rec_use_ring ? "packet ring" : "recvmmsg",
+                rec_relay_on ? ", relay on " : "", rec_relay_on ? conf->relay : "");
+        last_report = time(NULL);
+        while (!rec_stop) {
+            usleep(REC_POLL_MS * 1000);
+            if (rec_relay_on) relay_serve(&rec_relay);
+            if (time(NULL) - last_report >= conf->report_sec) {
+                report(time(NULL) - last_report, false);
+                last_report = time(NULL);
+            }
+        }
+        pthread_join(rtid, NULL);
+    }
+
+    // 工作线程处理完环形缓冲区中剩下的数据后退出
+    for (int i = 0; i < nworker; i++) {
+        pthread_join(workers[i].tid, NULL);
+        ring_buffer_destroy(workers[i].rb);
+        free(workers[i].rb);
+    }
+    for (int i = MINCHNID; i <= MAXCHNID; i++) {
+        struct rec_chn_st *c = &chans[i];
+        if (c->fd >= 0) {
+            chn_flush(c);
+            close(c->fd);
+        }
+        free(c->buf);
+        fec_dec_destroy(&c->fec);
+    }
+    if (ret == 0) report(time(NULL) - start, true);
+    if (rec_use_ring) pkt_ring_close(&rec_ring);
+    if (rec_relay_on) relay_close(&rec_relay);
+    return ret;
+}
@@ -0,0 +1,38 @@
+#ifndef RECORDER_H_
+#define RECORDER_H_
+#include <netinet/in.h>
+#include <stdbool.h>
+#include "../include/proto.h"
+
+#define RECORDER_WORKERS_MAX 32
+#define RECORDER_REPORT_SEC 5          // 默认统计输出间隔
+#define RECORDER_FILEBUF (256 * 1024)  // 每个频道攒够这么多再写文件
+
+/*
+无界面的多频道录制/监控模式：一个接收线程用 recvmmsg 收所有频道的报文，
+按频道号分给若干工作线程（每个工作线程一个无锁环形缓冲区），
+也可以改用 AF_PACKET 映射环（pkt_ring.h）整块收包，省掉逐包的系统调用；
+工作线程做 CRC 校验、FEC 恢复、丢包和抖动统计，
+录制时把每个频道按序写到 dir/chNNN.mp3（大块批量写入），
+做本机中继时把每个频道按序发布到共享内存（relay.h），
+主线程定期输出每个频道的码率、丢包和抖动。
+*/
+struct recorder_conf_st {
+    const char *dir;                   // 录制目录，NULL 表示只监控不录制
+    bool chn[MAXCHNID + 1];            // 要订阅的频道
+    int workers;                       // 工作线程数
+    int report_sec;                    // 统计输出间隔
+    bool ring;                         // 用映射环收包，打不开时退回 recvmmsg
+    const char *ring_if;               // 映射环绑定的网卡，NULL 表示所有网卡
+    struct sockaddr_in group;          // 组播组地址和端口，映射环按它过滤
+    const char *relay;                 // 本机中继的 unix 套接字，非 NULL 时把每个频道发布到共享内存
+    const void *list;                  // 节目单，中继交给读者
+    int list_len;
+};
+
+// 解析频道列表："all" 或者 "1,3,10-20"，成功返回 0
+int recorder_parse_channels(const char *spec, bool *chn);
+// 运行到收到 SIGINT/SIGTERM 为止，返回进程退出码
+int recorder_run(int sd, const struct sockaddr_in *server, const struct recorder_conf_st *conf);
+
+#endif
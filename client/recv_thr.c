@@ -1,143 +1,713 @@
+#define _GNU_SOURCE          // recvmmsg(), pthread_setaffinity_np()
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>          // 新增：memcpy()
 #include <errno.h>           // 新增：errno, EINTR等
 #include <time.h>            // 新增：clock_gettime(), struct timespec
 #include <pthread.h>         // 新增：pthread相关函数
-#include <sys/socket.h>      // 新增：recvfrom()
+#include <sys/socket.h>      // 新增：recvmmsg()
 #include <netinet/in.h>      // 新增：struct sockaddr_in
 #include <arpa/inet.h>       // 新增：inet_ntop()
+#include <poll.h>
+#include <sched.h>
 #include "../include/proto.h" // 新增：MSG_CHANNEL_MAX, struct msg_channel_st等
+#include "../include/packet.h"
 #include "recv_thr.h"        // 修正：应该是 recv_thr.h 而不是 recv.h
 #include "client.h"
+#include "fec_dec.h"
+#include "jitter_buf.h"
+#include "hist.h"
+#include "chn_filter.h"
+#include "mp3sync.h"
+#include "rxq_drops.h"
 
 
-// 添加序列号跟踪
-uint32_t expected_seq = 0;
-bool first_packet = true;
-int packet_loss_count = 0;
+// 添加序列号跟踪（丢包数记在 metrics 里）
+static uint32_t expected_seq = 0;
+static bool first_packet = true;
 
 
-// 写入环形缓冲区（生产者）
-int ring_buffer_write(struct ring_buffer *rb, const void *data, size_t len) {
-    pthread_mutex_lock(&rb->mutex);
+static uint32_t nack_next; // 小于它的序列号已经请求过重传
+
+// 向服务端单播 NACK，请求重传 seqs 中还没有请求过的序列号
+static void send_nack(struct shared_data *shared, const uint32_t *seqs, int n) {
+    char buf[sizeof(struct msg_nack_st) + NACK_MAX_SEQ * sizeof(uint32_t)];
+    struct msg_nack_st *nack = (void *)buf;
+    int count = 0;
+    
+    for (int i = 0; i < n && count < NACK_MAX_SEQ; i++) {
+        if ((int32_t)(seqs[i] - nack_next) < 0) continue;
+        nack->seq[count++] = htonl(seqs[i]);
+        nack_next = seqs[i] + 1;
+    }
+    if (count == 0) return;
+    nack->magic = htonl(PACKET_MAGIC_NACK);
+    nack->channel_id = htons(shared->chosen_channel);
+    nack->count = htons(count);
+    if (sendto(shared->socket_fd, nack, sizeof(*nack) + (count - 1) * sizeof(uint32_t), 0,
+               (void *)&shared->server_addr, sizeof(shared->server_addr)) < 0) {
+        perror("sendto nack");
+        return;
+    }
+    metric_add(&shared->metrics.recv.nacks_sent, 1);
+}
+
+#define RECV_BATCH 16 // 每次 recvmmsg() 最多收的报文数
+#define RECV_IDLE_MS 100 // 没有数据时多久检查一次换台请求
+
+static struct jitter_buf_st jitter; // FEC 解码器和环形缓冲区之间的抖动缓冲区
+static struct fec_dec_st fec;
+static struct list_asm_st list_asm;
+static struct rxq_drops_st rxq;     // 内核丢包计数的拆分
+
+/*
+交给播放器的字节流断开之后（开始收听、换台、丢包跳过或缓冲区满丢包），
+下一个包多半从一帧的中间开始。先丢掉下一个帧头之前的字节，解码器不用自己找同步，
+也不会把残帧放出来。RESYNC_MAX_BYTES 之内一直找不到帧头就不是 MP3，原样交出去。
+*/
+#define RESYNC_MAX_BYTES (256 * 1024)
+
+/*
+每个数据包的内核到达时刻按序列号记下来，经过 FEC 和抖动缓冲区交付时再作为标记
+随数据放进环形缓冲区，写入线程交给播放器时算出在客户端里排了多久的队。
+FEC 恢复的包和换台预收缓存里的包没有到达时刻，不打标记。
+*/
+#define ARRIVAL_SLOTS 256
+
+static struct {
+    uint32_t seq;
+    int64_t ns;                   // 0 表示没有记录
+} arrival[ARRIVAL_SLOTS];
+
+static bool resync_pending = true;
+static size_t resync_skipped;     // 这次重新同步已经丢掉的字节
+static uint32_t deliver_next;     // 下一个应交付的序列号
+
+// 抖动缓冲区到了播放时刻的数据暂存进环形缓冲区，一批报文处理完再统一提交
+static void deliver_to_ring(void *arg, uint32_t seq, const uint8_t *data, size_t len) {
+    struct shared_data *shared = arg;
+    struct recv_metrics_st *m = &shared->metrics.recv;
+    size_t skip;
+    
+    if (seq != deliver_next) resync_pending = true;
+    deliver_next = seq + 1;
+    if (resync_pending) {
+        skip = mp3_sync_find(data, len);
+        if (skip == len && resync_skipped + len < RESYNC_MAX_BYTES) {
+            resync_skipped += len;
+            metric_add(&m->resync_skipped_bytes, len);
+            return;
+        }
+        if (skip == len) skip = 0; // 放弃同步
+        metric_add(&m->resync_skipped_bytes, skip);
+        metric_add(&m->resyncs, 1);
+        data += skip;
+        len -= skip;
+        resync_pending = false;
+        resync_skipped = 0;
+    }
+    if (ring_buffer_stage(&shared->rb, data, len) == 0) {
+        metric_add(&m->bytes_received, len);
+        if (arrival[seq % ARRIVAL_SLOTS].seq == seq && arrival[seq % ARRIVAL_SLOTS].ns != 0)
+            ring_buffer_mark(&shared->rb, arrival[seq % ARRIVAL_SLOTS].ns);
+    } else {
+        metric_add(&m->packets_dropped, 1);
+        fprintf(stderr, "Buffer full, dropped packet (seq: %u)\n", seq);
+        resync_pending = true;
+    }
+}
+
+// FEC 解码器交付的数据放进抖动缓冲区，按服务端时间戳排队播放
+static void deliver_to_jitter(void *arg, uint32_t seq, uint32_t ts, const uint8_t *data,
+                              size_t len) {
+    uint32_t now = packet_now_ms();
+    jitter_put(&jitter, seq, ts, data, len, now);
+    jitter_release(&jitter, now);
+}
+
+// 校验包要等分组结束才到，分组比抖动缓冲区的目标延迟还长时恢复出来的包都赶不上播放，提示一次
+static void check_fec_latency(struct shared_data *shared) {
+    static int warned_n;
+
+    if (fec.group_ms == 0 || fec.n == warned_n || fec.group_ms <= (uint32_t)shared->latency_ms)
+        return;
+    warned_n = fec.n;
+    fprintf(stderr, "FEC groups of %d packets span about %u ms, longer than the %d ms latency; "
+            "recovered packets will be too late (raise -L)\n",
+            fec.n, fec.group_ms, shared->latency_ms);
+}
+
+static void update_jitter_stats(struct shared_data *shared) {
+    metric_set(&shared->metrics.recv.packets_reordered, jitter.reordered);
+    metric_set(&shared->metrics.recv.packets_duplicate, jitter.duplicates);
+    metric_set(&shared->metrics.recv.packets_skipped, jitter.skipped);
+    metric_set(&shared->metrics.recv.jitter_depth, jitter.count);
+}
+
+static void confirm_server(struct shared_data *shared);
+
+/*
+检查报文来源，同一个陌生地址只提示一次，避免每个包都做地址转换和打印。
+服务器地址来自缓存还没确认时，原地址来的第一个报文确认它；
+别的地址发来节目单说明服务端换了地址（重启后源端口会变），改用新地址。
+*/
+static bool check_source(struct shared_data *shared, const struct sockaddr_in *raddr,
+                         const void *msg, int len) {
+    static struct sockaddr_in last_foreign;
+    char ipstr_raddr[30];
+    char ipstr_server_addr[30];
+    
+    if (raddr->sin_addr.s_addr == shared->server_addr.sin_addr.s_addr &&
+        raddr->sin_port == shared->server_addr.sin_port) {
+        if (!shared->server_confirmed) confirm_server(shared);
+        return true;
+    }
+    if (!shared->server_confirmed && len >= (int)MSG_LIST_HDR && *(const chnid_t *)msg == LISTCHNID) {
+        inet_ntop(AF_INET, &raddr->sin_addr.s_addr, ipstr_raddr, sizeof(ipstr_raddr));
+        fprintf(stderr, "Server moved to %s:%d, following it\n", ipstr_raddr, ntohs(raddr->sin_port));
+        shared->server_addr = *raddr;
+        confirm_server(shared);
+        return true;
+    }
+    if (raddr->sin_addr.s_addr != last_foreign.sin_addr.s_addr ||
+        raddr->sin_port != last_foreign.sin_port) {
+        last_foreign = *raddr;
+        inet_ntop(AF_INET, &raddr->sin_addr.s_addr, ipstr_raddr, sizeof(ipstr_raddr));
+        inet_ntop(AF_INET, &shared->server_addr.sin_addr.s_addr, ipstr_server_addr, sizeof(ipstr_server_addr));
+        fprintf(stderr, "Ignore: addr not match. raddr:%s:%d server_addr:%s:%d\n",
+                ipstr_raddr, ntohs(raddr->sin_port),
+                ipstr_server_addr, ntohs(shared->server_addr.sin_port));
+    }
+    return false;
+}
+
+// 节目单包（首字节为 LISTCHNID）：版本没变就忽略，变了才接收完整节目单
+static void handle_list(struct shared_data *shared, struct msg_list_st *msg_list, int len) {
+    struct msg_list_st *whole_list;
+    int whole_len;
+    
+    if (len >= (int)MSG_LIST_HDR && msg_list->type == LIST_TYPE_FULL &&
+        ntohl(msg_list->version) != shared->list_version &&
+        list_asm_add(&list_asm, msg_list, len, &whole_list, &whole_len) == 1) {
+        shared->list_version = ntohl(whole_list->version);
+        printf("Programme list updated (version %u):\n", shared->list_version);
+        list_print(whole_list, whole_len);
+        free(shared->list);
+        shared->list = whole_list;
+        shared->list_len = whole_len;
+    }
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+到达抖动（RFC 3550 的 D）：相邻两个按序到达的包，到达间隔和服务端时间戳间隔之差。
+服务端时间戳只有毫秒精度，所以这里的下限也是毫秒级。
+*/
+static void record_interarrival(struct shared_data *shared, uint32_t ts, int64_t arrival_ns) {
+    static int64_t last_arrival_ns;
+    static uint32_t last_ts;
+    int64_t d;
+    
+    if (ts != 0 && last_arrival_ns != 0) {
+        d = (arrival_ns - last_arrival_ns) / 1000 - (int64_t)(int32_t)(ts - last_ts) * 1000;
+        hist_record(&shared->metrics.recv.interarrival_jitter_us, d < 0 ? -d : d);
+    }
+    last_arrival_ns = arrival_ns;
+    last_ts = ts;
+}
+
+/*
+单向时延：内核收到的时刻减去服务端发送时的时间戳。两台机器的时钟不同步时带着固定的偏差
+（为负时记为 0），绝对值未必可信，但它的变化反映网络排队的增减。
+*/
+static void record_one_way(struct shared_data *shared, uint32_t ts, int64_t arrival_ns) {
+    int64_t d;
+    
+    if (ts == 0) return;
+    // 服务端时间戳是截断成 32 位的毫秒数，按同样的方式回绕相减
+    d = (int64_t)(int32_t)((uint32_t)(arrival_ns / 1000000) - ts) * 1000 +
+        arrival_ns / 1000 % 1000;
+    hist_record(&shared->metrics.recv.one_way_delay_us, d < 0 ? 0 : d);
+}
+
+#define ZAP_CACHE_PKTS 2      // 每个相邻频道保留最近几个数据包（服务端约每秒一包）
+
+/*
+换台预收：相邻频道的数据包也放进来（过滤器放行），每个频道只滚动保留最近几个
+序列号连续的包。换到这些频道时先把缓存的包交给播放器，不必等新频道的下一个包
+和抖动缓冲区的目标延迟。
+*/
+struct zap_cache_st {
+    int chnid;                        // -1 表示空闲
+    int count;
+    uint32_t seq[ZAP_CACHE_PKTS];
+    size_t len[ZAP_CACHE_PKTS];
+    uint8_t *data[ZAP_CACHE_PKTS];    // 第一次用到时分配，每个 MAX_DATA 字节
+};
+
+static struct zap_cache_st zap_cache[2 * ZAP_NEIGHBORS_MAX];
+
+static struct zap_cache_st *zap_cache_find(int chnid) {
+    for (int i = 0; i < 2 * ZAP_NEIGHBORS_MAX; i++)
+        if (zap_cache[i].chnid == chnid) return &zap_cache[i];
+    return NULL;
+}
+
+static void zap_cache_put(struct zap_cache_st *zc, uint32_t seq, const uint8_t *data,
+                          size_t len) {
+    uint8_t *slot;
+    
+    if (len > MAX_DATA) return;
+    // 只保留连续的一段，乱序、重传或缺口时重新开始
+    if (zc->count > 0 && seq != zc->seq[zc->count - 1] + 1) zc->count = 0;
+    if (zc->count == ZAP_CACHE_PKTS) {
+        slot = zc->data[0];
+        memmove(zc->seq, zc->seq + 1, (ZAP_CACHE_PKTS - 1) * sizeof(zc->seq[0]));
+        memmove(zc->len, zc->len + 1, (ZAP_CACHE_PKTS - 1) * sizeof(zc->len[0]));
+        memmove(zc->data, zc->data + 1, (ZAP_CACHE_PKTS - 1) * sizeof(zc->data[0]));
+        zc->data[--zc->count] = slot;
+    }
+    if (zc->data[zc->count] == NULL && (zc->data[zc->count] = malloc(MAX_DATA)) == NULL) return;
+    memcpy(zc->data[zc->count], data, len);
+    zc->seq[zc->count] = seq;
+    zc->len[zc->count] = len;
+    zc->count++;
+}
+
+// 按新选的频道重新安排要预收的相邻频道（环绕），仍是邻居的频道保留缓存，并挂上过滤器
+static void zap_cache_retarget(struct shared_data *shared) {
+    int chn[CHN_FILTER_MAX], n = 0, nchn = MAXCHNID - MINCHNID + 1;
+    int neighbors = shared->zap_neighbors;
+    
+    if (2 * neighbors >= nchn) neighbors = (nchn - 1) / 2;
+    chn[n++] = shared->chosen_channel;
+    for (int d = 1; d <= neighbors; d++) {
+        chn[n++] = MINCHNID + (shared->chosen_channel - MINCHNID + d) % nchn;
+        chn[n++] = MINCHNID + (shared->chosen_channel - MINCHNID - d + nchn) % nchn;
+    }
+    for (int i = 0; i < 2 * ZAP_NEIGHBORS_MAX; i++) {
+        bool keep = false;
+        for (int j = 1; j < n; j++)
+            keep |= zap_cache[i].chnid == chn[j];
+        if (!keep) {
+            zap_cache[i].chnid = -1;
+            zap_cache[i].count = 0;
+        }
+    }
+    for (int j = 1; j < n; j++) {
+        if (zap_cache_find(chn[j]) != NULL) continue;
+        struct zap_cache_st *zc = zap_cache_find(-1);
+        zc->chnid = chn[j];
+        zc->count = 0;
+    }
+    // 其他频道和其他来源的报文在内核里就丢掉，失败时仍会在用户态过滤；
+    // 服务器地址还没确认时不挂，免得把换了地址的服务端也挡在外面
+    if (shared->server_confirmed &&
+        chn_filter_attach_set(shared->socket_fd, &shared->server_addr, chn, n) < 0) {
+        perror("chn_filter_attach_set");
+    }
+}
+
+// 服务器地址确认下来：挂上内核过滤器，任意源加入的收窄成源特定
+static void confirm_server(struct shared_data *shared) {
+    shared->server_confirmed = true;
+    zap_cache_retarget(shared);
+    if (!shared->ssm) {
+        if (mcast_narrow(shared->socket_fd, &shared->group, shared->ifindex,
+                         &shared->server_addr) == 0) {
+            shared->ssm = true;
+        } else {
+            perror("setsourcefilter, staying on any-source join");
+        }
+    }
+    fprintf(stderr, "server confirmed, multicast join: %s\n",
+            shared->ssm ? "source-specific" : "any-source");
+}
+
+/*
+换台：先标出旧频道数据在环形缓冲区里的结尾，让写入线程丢掉它们（连同管道里的），
+再清空 FEC、抖动缓冲区和序列号跟踪，换过滤器。新频道在预收缓存里有包时直接交给播放器。
+*/
+static void zap(struct shared_data *shared, int chnid) {
+    struct zap_cache_st *zc = zap_cache_find(chnid);
+    
+    ring_buffer_write_commit(&shared->rb, 0);
+    atomic_store(&shared->flush_to, ring_buffer_write_pos(&shared->rb));
+    atomic_fetch_add(&shared->flush_gen, 1);
+    
+    fec_dec_reset(&fec);
+    jitter_destroy(&jitter);
+    jitter_init(&jitter, shared->latency_ms, deliver_to_ring, shared);
+    first_packet = true;
+    resync_pending = true;
+    resync_skipped = 0;
+    memset(arrival, 0, sizeof(arrival)); // 新频道的序列号空间不同
+    shared->chosen_channel = chnid;
+    printf("Switching to channel %d%s\n", chnid,
+           zc != NULL && zc->count > 0 ? " (playing from neighbour cache)" : "");
     
-    // 等待缓冲区有空间，但设置超时避免永久阻塞
-    struct timespec timeout;
-    clock_gettime(CLOCK_REALTIME, &timeout);
-    timeout.tv_nsec += 10000000; // 10ms超时
-    if (timeout.tv_nsec >= 1000000000) {
-        timeout.tv_sec += 1;
-        timeout.tv_nsec -= 1000000000;
+    if (zc != NULL && zc->count > 0) {
+        for (int i = 0; i < zc->count; i++)
+            deliver_to_ring(shared, zc->seq[i], zc->data[i], zc->len[i]);
+        ring_buffer_write_commit(&shared->rb, 0);
+        // 后面的包从缓存之后接着检查连续性
+        expected_seq = zc->seq[zc->count - 1] + 1;
+        nack_next = expected_seq;
+        first_packet = false;
+        zc->count = 0;
     }
+    zap_cache_retarget(shared);
+}
+
+// 处理一个已经通过校验的频道报文，arrival_ns 是它到达的时刻
+static void handle_channel(struct shared_data *shared, struct msg_channel_st *msg_channel,
+                           int64_t arrival_ns) {
+    uint32_t nack_seqs[NACK_MAX_SEQ];
+    int nack_count;
     
-    while (rb->count + len > RING_BUFFER_SIZE) {  //rb->count 当前缓冲区中的数据字节数
-      /*pthread_cond_timedwait 是 POSIX 线程库（pthreads）中用于条件变量的函数，带有超时功能。
-      它的作用是：
-      等待一个条件变量（rb->not_full）满足，同时自动解锁互斥锁（rb->mutex）；
-      如果条件变量在超时时间（timeout）内被唤醒，就继续执行；
-      如果超时了还没被唤醒，则返回超时错误。
-      */
-        if (pthread_cond_timedwait(&rb->not_full, &rb->mutex, &timeout) != 0) {
-            pthread_mutex_unlock(&rb->mutex);
-            return -1; // 超时，丢弃数据
+    if (ntohs(msg_channel->hdr.channel_id) != shared->chosen_channel) {
+        // 相邻频道的数据包只留最近几个，换台时立即播放
+        struct zap_cache_st *zc = zap_cache_find(ntohs(msg_channel->hdr.channel_id));
+        if (zc != NULL && ntohl(msg_channel->hdr.magic) == PACKET_MAGIC) {
+            zap_cache_put(zc, ntohl(msg_channel->hdr.sequence), msg_channel->data,
+                          ntohs(msg_channel->hdr.data_len));
         }
+        return;
+    }
+    
+    // 校验包交给 FEC 解码器，恢复出的数据按序写入环形缓冲区
+    if (ntohl(msg_channel->hdr.magic) == PACKET_MAGIC_FEC) {
+        size_t fec_len = ntohs(msg_channel->hdr.data_len);
+        if (fec_len >= sizeof(struct fec_header)) {
+            fec_dec_parity(&fec, ntohl(msg_channel->hdr.sequence),
+                           (struct fec_header *)msg_channel->data,
+                           msg_channel->data + sizeof(struct fec_header),
+                           fec_len - sizeof(struct fec_header));
+            metric_set(&shared->metrics.recv.packets_recovered, fec.recovered);
+            // FEC 覆盖不了的丢包才请求重传
+            nack_count = fec_dec_missing(&fec, nack_seqs, NACK_MAX_SEQ);
+            send_nack(shared, nack_seqs, nack_count);
+        }
+        return;
+    }
+    
+    uint32_t seq = ntohl(msg_channel->hdr.sequence);
+    metric_add(&shared->metrics.recv.packets_received, 1);
+    arrival[seq % ARRIVAL_SLOTS].seq = seq;
+    arrival[seq % ARRIVAL_SLOTS].ns = arrival_ns;
+    
+    // 检查序列号连续性
+    if (first_packet) {
+        expected_seq = seq + 1;
+        nack_next = seq; // 换台后序列号空间不同，从头开始记
+        first_packet = false;
+    } else if ((int32_t)(seq - expected_seq) < 0) {
+        // 迟到的包（重传或乱序），不影响序列号跟踪
+        metric_add(&shared->metrics.recv.packets_late, 1);
+    } else {
+        if (seq != expected_seq) {
+            fprintf(stderr, "Warning: Sequence gap! Expected %u, got %u (lost %d packets)\n", 
+                    expected_seq, seq, 
+                    seq - expected_seq);
+            metric_add(&shared->metrics.recv.packets_lost, seq - expected_seq);
+            hist_record(&shared->metrics.recv.gap_packets, seq - expected_seq);
+            // 没有 FEC 时直接请求重传缺口，有 FEC 时等校验包到达后再决定
+            if (fec.n == 0) {
+                nack_count = 0;
+                for (uint32_t s = expected_seq; s != seq && nack_count < NACK_MAX_SEQ; s++)
+                    nack_seqs[nack_count++] = s;
+                send_nack(shared, nack_seqs, nack_count);
+            }
+        }
+        expected_seq = seq + 1;
+        record_interarrival(shared, ntohl(msg_channel->hdr.timestamp), arrival_ns);
+        record_one_way(shared, ntohl(msg_channel->hdr.timestamp), arrival_ns);
+    }
+    
+    // 经过 FEC 解码器和抖动缓冲区，按序、按播放时刻写入环形缓冲区
+    fec_dec_data(&fec, seq, ntohl(msg_channel->hdr.timestamp), msg_channel->data,
+                 ntohs(msg_channel->hdr.data_len));
+    metric_set(&shared->metrics.recv.packets_recovered, fec.recovered);
+    check_fec_latency(shared);
+}
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+// 每个报文的控制消息缓冲区，放 SO_TIMESTAMPNS 的内核接收时间和 SO_RXQ_OVFL 的丢包计数
+#define RECV_CTRL_LEN (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)))
+#define RCVBUF_GROW_MS 1000 // 两次加大接收缓冲区至少间隔这么久，一阵丢包只加一次
+
+// 内核记的是两倍（含簿记开销），换回设置时的口径
+static int rcvbuf_get(int sd) {
+    int got = 0;
+    socklen_t len = sizeof(got);
+    
+    if (getsockopt(sd, SOL_SOCKET, SO_RCVBUF, &got, &len) < 0) return 0;
+    return got / 2;
+}
+
+int recv_set_rcvbuf(int sd, int bytes) {
+    if (setsockopt(sd, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) < 0 &&
+        setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) < 0) {
+        perror("setsockopt SO_RCVBUF");
     }
+    return rcvbuf_get(sd);
+}
+
+/*
+忙轮询模式的准备工作：请求内核在 recv 时轮询网卡队列（SO_BUSY_POLL，
+需要 CAP_NET_ADMIN，驱动不支持 NAPI 时没有效果），并把接收线程绑到指定 CPU。
+都失败也不要紧，接收线程照样在用户态自旋。
+*/
+static void setup_busy_poll(struct shared_data *shared) {
+    int usec = shared->busy_poll_us, one = 1;
     
-    // 写入数据
-    size_t available = RING_BUFFER_SIZE - rb->tail; //写指针：指向下一个要写入的位置
-    if (len <= available) {
-        memcpy(&rb->data[rb->tail], data, len);
-        rb->tail = (rb->tail + len) % RING_BUFFER_SIZE;
-    } else { //空间不够，需要“绕回到头部”写：
-        memcpy(&rb->data[rb->tail], data, available);//// 先写到缓冲区尾
-        memcpy(&rb->data[0], (const char*)data + available, len - available);//// 再从头写剩下的部分
-        rb->tail = len - available;//tail 更新为写入结束后的新位置（从 0 开始偏移）
+    if (usec > 0) {
+        if (setsockopt(shared->socket_fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0 ||
+            setsockopt(shared->socket_fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) < 0) {
+            perror("setsockopt SO_BUSY_POLL (spinning in user space only)");
+        }
     }
+    if (shared->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(shared->cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            fprintf(stderr, "pthread_setaffinity_np cpu %d: %s\n", shared->cpu, strerror(err));
+        }
+    }
+}
+
+// 非阻塞地收一批报文，没有数据返回 0，出错返回 -1；sample 时先记下接收队列满没满
+static int recv_batch(struct shared_data *shared, struct mmsghdr *msgs, struct sockaddr_in *raddr,
+                      bool sample) {
+    int n;
     
-    rb->count += len;
-    pthread_cond_signal(&rb->not_empty);
-    pthread_mutex_unlock(&rb->mutex);
+    if (sample) rxq_drops_sample(&rxq, shared->socket_fd);
+    for (int i = 0; i < RECV_BATCH; i++) {
+        msgs[i].msg_hdr.msg_namelen = sizeof(raddr[i]);
+        msgs[i].msg_hdr.msg_controllen = RECV_CTRL_LEN;
+    }
+    n = recvmmsg(shared->socket_fd, msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        perror("recvmmsg in receiver_thread");
+        return -1;
+    }
+    return n;
+}
+
+// 在预算内自旋接收，不超过抖动缓冲区下一次到期的时刻
+static int spin_recv(struct shared_data *shared, struct mmsghdr *msgs, struct sockaddr_in *raddr,
+                     int timeout_ms) {
+    int64_t budget_ns = (int64_t)shared->busy_poll_us * 1000;
+    int64_t deadline;
+    int n;
+    
+    if (timeout_ms >= 0 && (int64_t)timeout_ms * 1000000 < budget_ns) {
+        budget_ns = (int64_t)timeout_ms * 1000000;
+    }
+    deadline = now_ns() + budget_ns;
+    // 队列只在我们处理上一批的时候变长，只有第一次收之前需要看它满没满
+    bool sample = true;
+    do {
+        n = recv_batch(shared, msgs, raddr, sample);
+        if (n != 0) return n;
+        sample = false;
+    } while (!shared->stop_flag && now_ns() < deadline);
     return 0;
 }
 
+/*
+内核丢掉的报文（SO_RXQ_OVFL），按 rxq_drops.h 分成队列满丢的和过滤器拒掉的。
+我们来不及收、队列满了才算内核丢包，和网络丢包、环形缓冲区满区分开；
+这时加倍接收缓冲区，到 RECV_RCVBUF_MAX 或内核不再给为止。
+*/
+static void account_kernel_drops(struct shared_data *shared, struct mmsghdr *msgs, int n) {
+    static int64_t last_grow_ns;
+    static bool stuck;
+    struct recv_metrics_st *m = &shared->metrics.recv;
+    uint32_t counter = rxq.last, drops;
+    int64_t now;
+    int cur, want, got;
+    
+    for (int i = 0; i < n; i++)
+        rxq_ovfl(&msgs[i].msg_hdr, &counter);
+    drops = rxq_drops_account(&rxq, counter);
+    metric_set(&m->packets_filtered, rxq.filtered);
+    if (drops == 0) return;
+    metric_add(&m->packets_kernel_dropped, drops);
+    
+    now = now_ns();
+    cur = metric_get(&m->rcvbuf_bytes);
+    if (stuck || cur >= RECV_RCVBUF_MAX || now - last_grow_ns < RCVBUF_GROW_MS * 1000000LL) return;
+    last_grow_ns = now;
+    want = cur * 2 > RECV_RCVBUF_MAX ? RECV_RCVBUF_MAX : cur * 2;
+    got = recv_set_rcvbuf(shared->socket_fd, want);
+    if (got <= cur) {
+        fprintf(stderr, "Kernel has dropped %llu packets, receive buffer stuck at %d bytes "
+                "(raise net.core.rmem_max or grant CAP_NET_ADMIN)\n",
+                (unsigned long long)rxq.overflow, cur);
+        stuck = true;
+        return;
+    }
+    metric_set(&m->rcvbuf_bytes, got);
+    metric_add(&m->rcvbuf_grows, 1);
+    fprintf(stderr, "Kernel has dropped %llu packets, receive buffer grown to %d bytes\n",
+            (unsigned long long)rxq.overflow, got);
+}
+
+// 报文的内核接收时间（SO_TIMESTAMPNS），没有时返回 0
+static int64_t rx_time_ns(struct mmsghdr *msg) {
+    struct cmsghdr *cmsg;
+    
+    for (cmsg = CMSG_FIRSTHDR(&msg->msg_hdr); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg->msg_hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        }
+    }
+    return 0;
+}
+
+// 没有数据到达时也要按时把到期的包交给播放器，并及时响应换台请求
+static int recv_timeout(void) {
+    int timeout = jitter_timeout(&jitter, packet_now_ms());
+    return timeout < 0 || timeout > RECV_IDLE_MS ? RECV_IDLE_MS : timeout;
+}
+
 // UDP接收线程 这三个线程的参数都是共享数据
 void* receiver_thread(void* arg) {
     struct shared_data *shared = (struct shared_data*)arg;
-    struct msg_channel_st *msg_channel;
-    struct sockaddr_in raddr;
-    socklen_t raddr_len = sizeof(raddr);
-    int len;
-    char ipstr_raddr[30];
-    char ipstr_server_addr[30];
+    struct mmsghdr msgs[RECV_BATCH];
+    struct iovec iov[RECV_BATCH];
+    struct sockaddr_in raddr[RECV_BATCH];
+    char ctrl[RECV_BATCH][RECV_CTRL_LEN];
+    char *slots;
+    int n, timeout, one = 1;
     
-    msg_channel = malloc(MSG_CHANNEL_MAX);
-    if (msg_channel == NULL) {
+    // 一批报文的接收槽位，每个槽位放得下一个完整的频道包
+    slots = malloc((size_t)RECV_BATCH * MSG_CHANNEL_MAX);
+    if (slots == NULL) {
         perror("malloc in receiver_thread");
         pthread_exit(NULL);
     }
+    for (int i = 0; i < RECV_BATCH; i++) {
+        iov[i].iov_base = slots + (size_t)i * MSG_CHANNEL_MAX;
+        iov[i].iov_len = MSG_CHANNEL_MAX;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &raddr[i];
+        msgs[i].msg_hdr.msg_control = ctrl[i];
+    }
+    if (setsockopt(shared->socket_fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0) {
+        perror("setsockopt SO_TIMESTAMPNS");
+    }
+    if (setsockopt(shared->socket_fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0) {
+        perror("setsockopt SO_RXQ_OVFL");
+    }
+    metric_set(&shared->metrics.recv.rcvbuf_bytes, rcvbuf_get(shared->socket_fd));
+    setup_busy_poll(shared);
     
-    printf("Receiver thread started\n");
+    jitter_init(&jitter, shared->latency_ms, deliver_to_ring, shared);
+    fec_dec_init(&fec, deliver_to_jitter, shared);
+    memset(&list_asm, 0, sizeof(list_asm));
+    for (int i = 0; i < 2 * ZAP_NEIGHBORS_MAX; i++)
+        zap_cache[i].chnid = -1;
+    zap_cache_retarget(shared);
+    struct pollfd pfd = {.fd = shared->socket_fd, .events = POLLIN};
+    printf("Receiver thread started (%s)\n", shared->busy_poll_us > 0 ? "busy-poll" : "blocking");
     shared->receiver_ready = true;
     
     while (!shared->stop_flag) {
-        len = recvfrom(shared->socket_fd, msg_channel, MSG_CHANNEL_MAX, 0, 
-                      (void *)&raddr, &raddr_len);
-        
-        if (len < 0) {
-            if (errno == EINTR) continue;
-            perror("recvfrom in receiver_thread");
-            break;
+        int chnid = atomic_exchange(&shared->zap_request, -1);
+        if (chnid >= 0 && chnid != shared->chosen_channel) {
+            zap(shared, chnid);
         }
         
-        // 验证发送者地址
-        if (raddr.sin_addr.s_addr != shared->server_addr.sin_addr.s_addr) {
-            inet_ntop(AF_INET, &raddr.sin_addr.s_addr, ipstr_raddr, sizeof(ipstr_raddr));
-            inet_ntop(AF_INET, &shared->server_addr.sin_addr.s_addr, ipstr_server_addr, sizeof(ipstr_server_addr));
-            fprintf(stderr, "Ignore: addr not match. raddr:%s server_addr:%s\n",
-                    ipstr_raddr, ipstr_server_addr);
-            continue;
+        timeout = recv_timeout();
+        n = 0;
+        if (shared->busy_poll_us > 0) {
+            // 先自旋，预算用完还没有数据再退回阻塞等待
+            n = spin_recv(shared, msgs, raddr, timeout);
+            if (n > 0) {
+                metric_add(&shared->metrics.recv.busy_poll_hits, 1);
+            } else if (n == 0) {
+                metric_add(&shared->metrics.recv.busy_poll_misses, 1);
+                timeout = recv_timeout();
+            }
         }
-        
-        if (raddr.sin_port != shared->server_addr.sin_port) {
-            fprintf(stderr, "Ignore: port not match\n");
-            continue;
+        if (n == 0) {
+            int ready = poll(&pfd, 1, timeout);
+            if (ready < 0 && errno != EINTR) {
+                perror("poll in receiver_thread");
+                break;
+            }
+            if (ready > 0) {
+                n = recv_batch(shared, msgs, raddr, true);
+            }
         }
-        
-        if (len < sizeof(struct msg_channel_st)) {
-            fprintf(stderr, "Ignore: message too short\n");
-            continue;
+        if (n < 0) {
+            break;
+        }
+        // 唤醒延迟：批中第一个报文（把我们叫醒的那个）从内核收到到这里的时间
+        int64_t now = now_ns(), rx;
+        if (n > 0 && (rx = rx_time_ns(&msgs[0])) != 0) {
+            int64_t delay = now - rx;
+            hist_record(&shared->metrics.recv.wakeup_us, delay > 0 ? delay / 1000 : 0);
         }
+        if (n > 0) {
+            account_kernel_drops(shared, msgs, n);
+        }
+        jitter_release(&jitter, packet_now_ms());
         
-        if (msg_channel->chnid == shared->chosen_channel) {
-            shared->packets_received++;
+        for (int i = 0; i < n; i++) {
+            struct msg_channel_st *msg_channel = iov[i].iov_base;
+            int len = msgs[i].msg_len;
             
-            // 检查序列号连续性
-            if (first_packet) {
-                expected_seq = msg_channel->seq + 1;
-                first_packet = false;
-            } else {
-                if (msg_channel->seq != expected_seq) {
-                    fprintf(stderr, "Warning: Sequence gap! Expected %u, got %u (lost %d packets)\n", 
-                            expected_seq, msg_channel->seq, 
-                            msg_channel->seq - expected_seq);
-                    packet_loss_count += (msg_channel->seq - expected_seq);
-                }
-                expected_seq = msg_channel->seq + 1;
+            if (!check_source(shared, &raddr[i], msg_channel, len)) {
+                continue;
             }
-            
-            // 写入环形缓冲区
-            size_t data_len = len - sizeof(chnid_t) - sizeof(uint32_t);
-            if (ring_buffer_write(&shared->rb, msg_channel->data, data_len) == 0) {
-                shared->bytes_received += data_len;
-            } else {
-                shared->packets_dropped++;
-                fprintf(stderr, "Buffer full, dropped packet (seq: %u)\n", msg_channel->seq);
+            if (len > 0 && *(chnid_t *)msg_channel == LISTCHNID) {
+                handle_list(shared, (struct msg_list_st *)msg_channel, len);
+                continue;
             }
+            // 校验包头和 CRC32C，损坏或来历不明的包不送给解码器
+            int err = packet_verify(msg_channel, len);
+            if (err != PACKET_OK) {
+                metric_add(&shared->metrics.recv.packets_corrupt, 1);
+                fprintf(stderr, "Ignore: bad packet (%d), len %d\n", err, len);
+                continue;
+            }
+            int64_t arrival = rx_time_ns(&msgs[i]);
+            handle_channel(shared, msg_channel, arrival != 0 ? arrival : now);
         }
+        
+        // 这一批交付的数据一次提交给写入线程
+        ring_buffer_write_commit(&shared->rb, 0);
+        update_jitter_stats(shared);
     }
     
-    free(msg_channel);
+    fec_dec_destroy(&fec);
+    jitter_destroy(&jitter);
+    list_asm_free(&list_asm);
+    for (int i = 0; i < 2 * ZAP_NEIGHBORS_MAX; i++)
+        for (int j = 0; j < ZAP_CACHE_PKTS; j++)
+            free(zap_cache[i].data[j]);
+    free(slots);
     printf("Receiver thread exiting\n");
     pthread_exit(NULL);
 }
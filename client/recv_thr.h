@@ -4,13 +4,13 @@
 #include "client.h"          // 新增：包含client.h以获取struct ring_buffer定义
 
 
-// 添加序列号跟踪
-extern  uint32_t expected_seq ;
-extern  bool first_packet ;
-extern  int packet_loss_count ;
+#define ZAP_NEIGHBORS_MAX 4  // 换台预收：每侧最多预收的相邻频道数
+#define RECV_RCVBUF_INIT (2 * 1024 * 1024)  // 套接字接收缓冲区的初始大小
+#define RECV_RCVBUF_MAX (64 * 1024 * 1024)  // 内核丢包时最多长到这么大
 
 void* receiver_thread(void* arg);
-int ring_buffer_write(struct ring_buffer *rb, const void *data, size_t len);
+// 设置接收缓冲区，有 CAP_NET_ADMIN 时用 SO_RCVBUFFORCE 越过 rmem_max，返回内核实际给的大小
+int recv_set_rcvbuf(int sd, int bytes);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,285 @@
+#define _GNU_SOURCE          // memfd_create(), accept4()
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "relay.h"
+
+#define RELAY_CHNS (MAXCHNID + 1)
+
+static size_t data_off(void) {
+    return (sizeof(struct relay_hdr_st) + 4095) & ~(size_t)4095;
+}
+
+static uint8_t *chn_data(uint8_t *map, const struct relay_hdr_st *hdr, int chnid) {
+    return map + hdr->data_off + (size_t)chnid * hdr->chn_size;
+}
+
+static int unix_addr(struct sockaddr_un *sun, const char *path) {
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sun->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(sun->sun_path, path);
+    return 0;
+}
+
+int relay_open(struct relay_st *r, const char *path, const void *list, size_t list_len) {
+    struct sockaddr_un sun;
+    struct stat st;
+    char proc[32];
+    int seals, err;
+
+    memset(r, 0, sizeof(*r));
+    r->memfd = r->ro_fd = r->listen_fd = -1;
+    r->map = MAP_FAILED;
+    if (list_len > RELAY_LIST_MAX || unix_addr(&sun, path) < 0) {
+        if (list_len > RELAY_LIST_MAX) errno = EMSGSIZE;
+        return -1;
+    }
+
+    // 频道区是稀疏的，只有真正写过的频道占内存
+    r->map_len = data_off() + (size_t)RELAY_CHNS * RELAY_CHN_SIZE;
+    r->memfd = memfd_create("relay", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (r->memfd < 0 || ftruncate(r->memfd, r->map_len) < 0) goto fail;
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->memfd, 0);
+    if (r->map == MAP_FAILED) goto fail;
+    r->hdr = (void *)r->map;
+    r->hdr->magic = RELAY_MAGIC;
+    r->hdr->version = RELAY_VERSION;
+    r->hdr->chn_size = RELAY_CHN_SIZE;
+    r->hdr->data_off = data_off();
+    r->hdr->list_len = list_len;
+    memcpy(r->hdr->list, list, list_len);
+    // 不能再改大小，也不能再新建可写映射，我们自己已有的映射不受影响；F_SEAL_SEAL 之后什么都加不上了，
+    // 所以所有封条一次加上
+    seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+#ifdef F_SEAL_FUTURE_WRITE
+    seals |= F_SEAL_FUTURE_WRITE;
+#endif
+    if (fcntl(r->memfd, F_ADD_SEALS, seals) < 0) goto fail;
+    // 交给读者的 fd 只读打开，对它的可写映射直接失败，不依赖封条
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", r->memfd);
+    r->ro_fd = open(proc, O_RDONLY | O_CLOEXEC);
+    if (r->ro_fd < 0) goto fail;
+
+    r->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (r->listen_fd < 0) goto fail;
+    // 上次没有正常退出留下的套接字；不是套接字的文件不动，让 bind 报错
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+    if (bind(r->listen_fd, (void *)&sun, sizeof(sun)) < 0) goto fail;
+    snprintf(r->path, sizeof(r->path), "%s", path); // 绑上了才归我们删
+    if (listen(r->listen_fd, 16) < 0) goto fail;
+    return 0;
+
+fail:
+    err = errno;
+    relay_close(r);
+    errno = err;
+    return -1;
+}
+
+void relay_close(struct relay_st *r) {
+    if (r->listen_fd >= 0) close(r->listen_fd);
+    if (r->path[0] != '\0') unlink(r->path);
+    r->path[0] = '\0';
+    while (r->npeers > 0)
+        close(r->peer[--r->npeers]);
+    if (r->map != MAP_FAILED) munmap(r->map, r->map_len);
+    if (r->ro_fd >= 0) close(r->ro_fd);
+    if (r->memfd >= 0) close(r->memfd);
+    r->listen_fd = r->memfd = r->ro_fd = -1;
+    r->map = MAP_FAILED;
+}
+
+void relay_publish(struct relay_st *r, int chnid, const void *data, size_t len) {
+    struct relay_chn_st *c = &r->hdr->chn[chnid];
+    uint8_t *base = chn_data(r->map, r->hdr, chnid);
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_relaxed), tail;
+    size_t off, first;
+
+    if (len > RELAY_CHN_SIZE) { // 只留最后一整环
+        data = (const uint8_t *)data + len - RELAY_CHN_SIZE;
+        head += len - RELAY_CHN_SIZE;
+        len = RELAY_CHN_SIZE;
+    }
+    // 先推进 tail 再覆盖：读者看到 tail 还没越过自己，就说明它读到的数据没被改过
+    if (head + len > RELAY_CHN_SIZE) {
+        tail = head + len - RELAY_CHN_SIZE;
+        atomic_store_explicit(&c->tail, tail, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+    off = head % RELAY_CHN_SIZE;
+    first = len < RELAY_CHN_SIZE - off ? len : RELAY_CHN_SIZE - off;
+    memcpy(base + off, data, first);
+    memcpy(base, (const uint8_t *)data + first, len - first);
+    atomic_store_explicit(&c->head, head + len, memory_order_release);
+
+    atomic_fetch_add_explicit(&c->futex, 1, memory_order_release);
+    syscall(SYS_futex, &c->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+int relay_serve(struct relay_st *r) {
+    char cbuf[CMSG_SPACE(sizeof(int))] = {0}, byte = 0;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = cbuf,
+                         .msg_controllen = sizeof(cbuf)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    struct pollfd pfd = {.events = POLLIN};
+    int fd, served = 0;
+
+    // 读者从不往连接上写，可读就是对端关了
+    for (int i = 0; i < r->npeers;) {
+        pfd.fd = r->peer[i];
+        if (poll(&pfd, 1, 0) != 0) {
+            close(r->peer[i]);
+            r->peer[i] = r->peer[--r->npeers];
+        } else {
+            i++;
+        }
+    }
+
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &r->ro_fd, sizeof(int));
+    while ((fd = accept4(r->listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+        // 满了就什么也不给，读者收到空消息
+        if (r->npeers < RELAY_PEERS_MAX && sendmsg(fd, &msg, MSG_NOSIGNAL) == 1) {
+            r->peer[r->npeers++] = fd;
+            served++;
+        } else {
+            close(fd);
+        }
+    }
+    return served;
+}
+
+int relay_attach(struct relay_rd_st *rd, const char *path) {
+    char cbuf[CMSG_SPACE(sizeof(int))], byte;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = cbuf,
+                         .msg_controllen = sizeof(cbuf)};
+    struct cmsghdr *cmsg;
+    struct sockaddr_un sun;
+    struct stat st;
+    ssize_t n;
+    int err;
+
+    memset(rd, 0, sizeof(*rd));
+    rd->sd = rd->memfd = -1;
+    rd->map = MAP_FAILED;
+    if (unix_addr(&sun, path) < 0) return -1;
+    // 连接一直留着，中继没了时 relay_alive() 看到挂断
+    rd->sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (rd->sd < 0) return -1;
+    if (connect(rd->sd, (void *)&sun, sizeof(sun)) < 0 ||
+        (n = recvmsg(rd->sd, &msg, MSG_CMSG_CLOEXEC)) < 0) {
+        goto fail;
+    }
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (n == 0 || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        errno = n == 0 ? EUSERS : EPROTO;
+        goto fail;
+    }
+    memcpy(&rd->memfd, CMSG_DATA(cmsg), sizeof(int));
+
+    if (fstat(rd->memfd, &st) < 0) goto fail;
+    rd->map_len = st.st_size;
+    rd->map = mmap(NULL, rd->map_len, PROT_READ, MAP_SHARED, rd->memfd, 0);
+    if (rd->map == MAP_FAILED) goto fail;
+    rd->hdr = (const void *)rd->map;
+    // 只相信自己核对过的布局
+    if (rd->map_len < sizeof(struct relay_hdr_st) || rd->hdr->magic != RELAY_MAGIC ||
+        rd->hdr->version != RELAY_VERSION || rd->hdr->chn_size != RELAY_CHN_SIZE ||
+        rd->hdr->list_len > RELAY_LIST_MAX ||
+        rd->hdr->data_off + (uint64_t)RELAY_CHNS * RELAY_CHN_SIZE > rd->map_len) {
+        relay_detach(rd);
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+
+fail:
+    err = errno;
+    relay_detach(rd);
+    errno = err;
+    return -1;
+}
+
+void relay_detach(struct relay_rd_st *rd) {
+    if (rd->map != MAP_FAILED) munmap(rd->map, rd->map_len);
+    if (rd->memfd >= 0) close(rd->memfd);
+    if (rd->sd >= 0) close(rd->sd);
+    rd->sd = rd->memfd = -1;
+    rd->map = MAP_FAILED;
+    rd->hdr = NULL;
+}
+
+bool relay_alive(const struct relay_rd_st *rd) {
+    struct pollfd pfd = {.fd = rd->sd, .events = POLLIN};
+    int n = poll(&pfd, 1, 0);
+
+    // 中继交完 fd 就不再写了，可读、挂断或出错都说明对端关了
+    return n == 0 || (n < 0 && errno == EINTR);
+}
+
+const void *relay_list(const struct relay_rd_st *rd, int *len) {
+    *len = rd->hdr->list_len;
+    return rd->hdr->list;
+}
+
+// 写到 head 时读者还能安全开始使用的最老位置
+static uint64_t safe_tail(uint64_t head) {
+    return head > RELAY_CHN_SIZE - RELAY_SLACK ? head - (RELAY_CHN_SIZE - RELAY_SLACK) : 0;
+}
+
+uint64_t relay_start(const struct relay_rd_st *rd, int chnid, size_t preroll) {
+    const struct relay_chn_st *c = &rd->hdr->chn[chnid];
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_acquire);
+    uint64_t oldest = safe_tail(head);
+
+    return head - oldest > preroll ? head - preroll : oldest;
+}
+
+ssize_t relay_peek(const struct relay_rd_st *rd, int chnid, uint64_t pos, const uint8_t **p,
+                   int timeout_ms) {
+    const struct relay_chn_st *c = &rd->hdr->chn[chnid];
+    struct timespec ts = {timeout_ms / 1000, timeout_ms % 1000 * 1000000L};
+    uint32_t seen = atomic_load_explicit(&c->futex, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_acquire);
+    size_t off, n;
+
+    if (head <= pos) {
+        // 计数在 head 之前读：中间有发布的话计数已经变了，FUTEX_WAIT 立即返回
+        syscall(SYS_futex, &c->futex, FUTEX_WAIT, seen, &ts, NULL, 0);
+        head = atomic_load_explicit(&c->head, memory_order_acquire);
+        if (head <= pos) return 0;
+    }
+    if (pos < safe_tail(head)) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    off = pos % RELAY_CHN_SIZE;
+    n = head - pos;
+    if (n > RELAY_CHN_SIZE - off) n = RELAY_CHN_SIZE - off;
+    *p = chn_data(rd->map, rd->hdr, chnid) + off;
+    return n;
+}
+
+bool relay_valid(const struct relay_rd_st *rd, int chnid, uint64_t pos) {
+    atomic_thread_fence(memory_order_acquire);
+    return pos >= atomic_load_explicit(&rd->hdr->chn[chnid].tail, memory_order_relaxed);
+}
@@ -0,0 +1,98 @@
+#ifndef RELAY_H_
+#define RELAY_H_
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "../include/proto.h"
+
+/*
+本机扇出中继：一个进程收组播（多频道录制/监控的那套流水线），把每个频道按序的音频数据
+发布到一块共享内存（memfd）里；本机的播放器进程接入后直接从共享内存读，
+N 个消费者只花一份网络接收、FEC 和校验。
+
+共享内存里每个频道一个环，一个写者多个读者：
+  位置是只增不减的 64 位字节序号，head 是下一个要写的字节，
+  tail 是还有效的最老字节；写者在覆盖旧数据之前先推进 tail，写完再推进 head。
+  读者自己记位置，写者从不等读者。读者用完 relay_peek() 给的数据后用 relay_valid()
+  确认这段数据没有在使用期间被覆盖（seqlock 的做法），落后太多时 relay_peek() 报 EOVERFLOW，
+  读者跳到最新的数据重新开始。
+  每次发布把频道的 futex 计数加一并唤醒，读者在上面等（跨进程的 futex）。
+读者通过 unix 套接字拿到 memfd（SCM_RIGHTS）：交出去的是经 /proc/self/fd 以只读重新打开的 fd，
+读者映射不成可写的；memfd 还封住了大小和新的可写映射。
+读者的连接一直开着，中继退出（包括崩溃）时内核关掉它，读者用 relay_alive() 发现中继没了。
+*/
+#define RELAY_MAGIC 0x52454C59u      // "RELY"
+#define RELAY_VERSION 1
+#define RELAY_CHN_SIZE (1 << 20)     // 每个频道的环，128kbps 约一分钟
+#define RELAY_SLACK (64 * 1024)      // 离被覆盖不到这么多字节就算落后，留出读者使用数据的时间
+#define RELAY_LIST_MAX (256 * 1024)  // 节目单最大长度
+#define RELAY_PREROLL (64 * 1024)    // 接入或换台时从最新数据往回这么多字节开始，播放器立即有数据
+#define RELAY_PEERS_MAX 64           // 最多同时接入的读者
+
+struct relay_chn_st {
+    _Alignas(64) _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    _Atomic uint32_t futex;          // 每次发布加一
+};
+
+struct relay_hdr_st {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chn_size;
+    uint32_t list_len;
+    uint64_t data_off;               // 频道数据区在 memfd 里的偏移，频道 i 在 data_off + i * chn_size
+    struct relay_chn_st chn[MAXCHNID + 1];
+    uint8_t list[RELAY_LIST_MAX];    // 中继启动时的节目单（拼好的整张）
+};
+
+// 写者（中继进程）
+struct relay_st {
+    int memfd;
+    int ro_fd;                       // 交给读者的只读 fd
+    int listen_fd;                   // 读者来这里拿 memfd
+    int peer[RELAY_PEERS_MAX];       // 接入的读者连接，读者走了才关
+    int npeers;
+    uint8_t *map;
+    size_t map_len;
+    struct relay_hdr_st *hdr;
+    char path[108];
+};
+
+// 读者（播放器进程）
+struct relay_rd_st {
+    int sd;                          // 到中继的连接，中继没了时挂断
+    int memfd;                       // 只读的
+    uint8_t *map;
+    size_t map_len;
+    const struct relay_hdr_st *hdr;
+};
+
+// 创建共享内存并在 unix 套接字 path 上等读者，list 是节目单；失败返回 -1 并设置 errno
+int relay_open(struct relay_st *r, const char *path, const void *list, size_t list_len);
+void relay_close(struct relay_st *r);
+// 追加一个频道的数据并唤醒读者；每个频道只能有一个线程发布
+void relay_publish(struct relay_st *r, int chnid, const void *data, size_t len);
+// 关掉已经走了的读者的连接，把 memfd 交给所有新连上来的读者，不阻塞；返回交出去的个数
+int relay_serve(struct relay_st *r);
+
+// 接入失败返回 -1 并设置 errno，读者已满时为 EUSERS
+int relay_attach(struct relay_rd_st *rd, const char *path);
+void relay_detach(struct relay_rd_st *rd);
+// 中继进程还在（连接没有挂断）返回 true，不阻塞
+bool relay_alive(const struct relay_rd_st *rd);
+// 中继的节目单，*len 为长度
+const void *relay_list(const struct relay_rd_st *rd, int *len);
+// 开始读的位置：最新数据往回 preroll 字节，不早于还安全的最老数据
+uint64_t relay_start(const struct relay_rd_st *rd, int chnid, size_t preroll);
+/*
+等 pos 处有数据（最多 timeout_ms），*p 指向共享内存里从 pos 开始连续的数据，返回字节数；
+超时返回 0；pos 已经（或马上要）被覆盖返回 -1 且 errno 为 EOVERFLOW。
+*/
+ssize_t relay_peek(const struct relay_rd_st *rd, int chnid, uint64_t pos, const uint8_t **p,
+                   int timeout_ms);
+// 用完 relay_peek() 给的数据之后调用：pos 处的数据在这期间没有被覆盖返回 true
+bool relay_valid(const struct relay_rd_st *rd, int chnid, uint64_t pos);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+中继自测：在一个线程里发布一段确定的字节流（块长随机，远大于环），另一个线程作为读者
+经 unix 套接字接入，按位置核对读到的每个字节；读者跟不上时应收到 EOVERFLOW 并从最新数据接着读，
+通过 relay_valid() 的数据一个字节都不能错。另外检查节目单、空频道超时和落后检测，
+读者拿到的 fd 映射不成可写的，中继关掉之后读者能发现，以及只删残留的套接字、不删别的文件。
+*/
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "relay.h"
+
+#define CHN 5
+#define STREAM_BYTES (32 * RELAY_CHN_SIZE)
+#define MAX_CHUNK 40000
+
+static int failures;
+static struct relay_st relay;
+static char path[64];
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static uint8_t stream_byte(uint64_t pos) {
+    return (uint8_t)(pos * 131 + (pos >> 13));
+}
+
+static void *producer(void *arg) {
+    static uint8_t chunk[MAX_CHUNK];
+    uint64_t pos = 0;
+    unsigned seed = 7;
+
+    while (relay_serve(&relay) == 0)
+        usleep(1000);
+    while (pos < STREAM_BYTES) {
+        size_t len = 1 + rand_r(&seed) % MAX_CHUNK;
+        if (len > STREAM_BYTES - pos) len = STREAM_BYTES - pos;
+        for (size_t i = 0; i < len; i++)
+            chunk[i] = stream_byte(pos + i);
+        relay_publish(&relay, CHN, chunk, len);
+        pos += len;
+        if (rand_r(&seed) % 8 == 0) usleep(100); // 时快时慢，读者有时跟得上有时跟不上
+    }
+    return NULL;
+}
+
+int main(void) {
+    static const char list[] = "program list";
+    struct relay_rd_st rd;
+    pthread_t tid;
+    const uint8_t *p;
+    uint64_t pos, checked = 0, mismatches = 0;
+    long lags = 0, invalid = 0;
+    struct timespec t0, t1;
+    struct sockaddr_un sun = {0};
+    ssize_t n;
+    int len, stale;
+
+    snprintf(path, sizeof(path), "/tmp/relay_test.%d", (int)getpid());
+    if (relay_open(&relay, path, list, sizeof(list)) < 0) {
+        perror("relay_open");
+        return 1;
+    }
+    pthread_create(&tid, NULL, producer, NULL);
+    if (relay_attach(&rd, path) < 0) {
+        perror("relay_attach");
+        return 1;
+    }
+    check(memcmp(relay_list(&rd, &len), list, sizeof(list)) == 0 && len == sizeof(list),
+          "program list");
+    // 读者只能读
+    p = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, rd.memfd, 0);
+    check(p == MAP_FAILED, "writable mmap of the attached fd must fail");
+    if (p != MAP_FAILED) munmap((void *)p, 4096);
+    check(mprotect(rd.map, 4096, PROT_READ | PROT_WRITE) < 0, "reader map cannot be made writable");
+    check(relay_alive(&rd), "relay is alive while open");
+
+    pos = relay_start(&rd, CHN, RELAY_PREROLL);
+    while (pos < STREAM_BYTES) {
+        n = relay_peek(&rd, CHN, pos, &p, 1000);
+        if (n < 0) {
+            check(errno == EOVERFLOW, "peek error must be EOVERFLOW");
+            lags++;
+            pos = relay_start(&rd, CHN, RELAY_PREROLL);
+            continue;
+        }
+        if (n == 0) {
+            fprintf(stderr, "FAIL: no data at %llu\n", (unsigned long long)pos);
+            failures++;
+            break;
+        }
+        uint64_t bad = 0;
+        for (ssize_t i = 0; i < n; i++)
+            if (p[i] != stream_byte(pos + i)) bad++;
+        // 用数据的时候被覆盖了就不算数
+        if (!relay_valid(&rd, CHN, pos)) {
+            invalid++;
+            pos = relay_start(&rd, CHN, RELAY_PREROLL);
+            continue;
+        }
+        mismatches += bad;
+        checked += n;
+        pos += n;
+    }
+    pthread_join(tid, NULL);
+    printf("relay: checked=%llu mismatches=%llu lags=%ld invalid=%ld\n",
+           (unsigned long long)checked, (unsigned long long)mismatches, lags, invalid);
+    check(mismatches == 0, "validated data must match the stream");
+    check(checked > RELAY_CHN_SIZE, "reader must see a good part of the stream");
+
+    // 落后一整环以上的位置
+    errno = 0;
+    check(relay_peek(&rd, CHN, 0, &p, 0) < 0 && errno == EOVERFLOW, "stale position must overflow");
+    check(!relay_valid(&rd, CHN, 0), "stale position is not valid");
+    pos = relay_start(&rd, CHN, RELAY_PREROLL);
+    check(pos == STREAM_BYTES - RELAY_PREROLL, "start is preroll bytes before the head");
+
+    // 空频道等到超时
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    check(relay_peek(&rd, CHN + 1, 0, &p, 50) == 0, "empty channel times out");
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    check((t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000 >= 40,
+          "peek must wait for the timeout");
+
+    relay_close(&relay);
+    check(access(path, F_OK) != 0, "socket path removed on close");
+    check(!relay_alive(&rd), "reader sees the relay gone");
+    relay_detach(&rd);
+
+    // 残留的套接字换掉，普通文件不动
+    stale = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    sun.sun_family = AF_UNIX;
+    snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", path);
+    check(bind(stale, (void *)&sun, sizeof(sun)) == 0, "leave a stale socket");
+    close(stale);
+    check(relay_open(&relay, path, list, sizeof(list)) == 0, "reopen over a stale socket");
+    relay_close(&relay);
+    fclose(fopen(path, "w"));
+    check(relay_open(&relay, path, list, sizeof(list)) < 0, "refuse to replace a regular file");
+    check(access(path, F_OK) == 0, "regular file left alone");
+    unlink(path);
+    printf("relay: failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "client.h"
+#include "mp3sync.h"
+#include "relay.h"
+#include "relay_thr.h"
+
+/*
+接入本机中继时的读者线程：中继已经做完校验、FEC 和排序，共享内存里就是按序的音频，
+这里不再经过环形缓冲区，直接从共享内存交给输出端。
+接入、换台和落后之后都从最新数据往回 RELAY_PREROLL 字节开始，先对齐到下一个帧头。
+所有频道都在共享内存里，换台不用等网络。没有数据时顺便看中继是否还在，中继没了就退出。
+*/
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void* relay_reader_thread(void* arg) {
+    struct shared_data *shared = (struct shared_data*)arg;
+    struct relay_rd_st *rd = shared->relay;
+    struct sink_st *sink = &shared->sink;
+    struct writer_metrics_st *m = &shared->metrics.writer;
+    int chn = shared->chosen_channel, zap;
+    uint64_t pos = relay_start(rd, chn, RELAY_PREROLL);
+    bool sync = true, zapping = false;
+    const uint8_t *p;
+    ssize_t n, w;
+    int64_t start;
+
+    // vmsplice 挂进管道的是共享内存的页，中继之后会覆盖它们，只能用 write() 拷进去
+    sink->splice = false;
+    while (!shared->stop_flag) {
+        zap = atomic_exchange(&shared->zap_request, -1);
+        if (zap >= MINCHNID) {
+            chn = shared->chosen_channel = zap;
+            sink_discard(sink);
+            pos = relay_start(rd, chn, RELAY_PREROLL);
+            sync = zapping = true;
+        }
+        n = relay_peek(rd, chn, pos, &p, RELAY_POLL_MS);
+        if (n < 0) {
+            fprintf(stderr, "fell behind the relay on channel %d, skipping to live\n", chn);
+            pos = relay_start(rd, chn, RELAY_PREROLL);
+            sync = true;
+            continue;
+        }
+        if (n == 0) {
+            if (!relay_alive(rd)) {
+                // 主线程还在等标准输入，用停止信号打断它（只有主线程接收）
+                fprintf(stderr, "relay is gone, exiting\n");
+                kill(getpid(), SIGTERM);
+                break;
+            }
+            continue;
+        }
+        if (sync) {
+            // 跨在环尾的帧头找不到，丢掉这一段从下一帧对齐
+            size_t skip = mp3_sync_find(p, n);
+            pos += skip;
+            if (skip == (size_t)n) continue;
+            p += skip;
+            n -= skip;
+            sync = false;
+        }
+
+        start = now_us();
+        w = sink_write(sink, (const char *)p, n);
+        if (w < 0) {
+            if (errno != EAGAIN) {
+                perror("write to output");
+                break;
+            }
+            if (sink_wait(sink, RELAY_POLL_MS) < 0) {
+                fprintf(stderr, "Player exited\n");
+                break;
+            }
+            continue;
+        }
+        // 拷贝途中被中继覆盖了的话交出去的数据是坏的，从最新数据重新对齐
+        if (!relay_valid(rd, chn, pos)) {
+            fprintf(stderr, "relay overwrote data in use on channel %d, skipping to live\n", chn);
+            pos = relay_start(rd, chn, RELAY_PREROLL);
+            sync = true;
+            continue;
+        }
+        pos += w;
+        hist_record(&m->write_latency_us, now_us() - start);
+        if (metric_get(&m->bytes_written) == 0) {
+            long ms = (now_us() - shared->start_us) / 1000;
+            metric_set(&m->first_audio_ms, ms > 0 ? ms : 1);
+            printf("First audio on channel %d in %ld ms\n", chn, ms);
+        }
+        metric_add(&m->packets_written, 1);
+        metric_add(&m->bytes_written, w);
+        if (zapping) {
+            long ms = (now_us() - atomic_load(&shared->zap_start_us)) / 1000;
+            hist_record(&m->zap_ms, ms);
+            metric_add(&m->zaps, 1);
+            printf("Zapped to channel %d in %ld ms\n", chn, ms);
+            zapping = false;
+        }
+    }
+    shared->stop_flag = true;
+    return NULL;
+}
@@ -0,0 +1,9 @@
+#ifndef RELAYTHR_H
+#define RELAYTHR_H
+
+#define RELAY_POLL_MS 20      // 没有数据时多久检查一次停止标志和换台请求，也是换台最多多等的时间
+
+// 接入本机中继（-A）时代替接收线程和写入线程，参数是共享数据
+void* relay_reader_thread(void* arg);
+
+#endif
@@ -0,0 +1,216 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "ring_buffer.h"
+
+#define RING_MASK (RING_BUFFER_SIZE - 1)
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void wake(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+}
+
+// 睡在 eventfd 上，被唤醒返回 1，超时返回 0
+static int sleep_on(int fd, int timeout_ms) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    uint64_t v;
+
+    if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+    while (read(fd, &v, sizeof(v)) < 0 && errno == EINTR)
+        ;
+    return 1;
+}
+
+// 先发布自己的等待标志再检查对方的位置，与对方"先提交位置再检查标志"配对，不会丢失唤醒
+static void wake_if_waiting(atomic_int *waiting, int fd) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiting, memory_order_relaxed) &&
+        atomic_exchange(waiting, 0))
+        wake(fd);
+}
+
+int ring_buffer_init(struct ring_buffer *rb) {
+    atomic_init(&rb->head, 0);
+    atomic_init(&rb->tail, 0);
+    atomic_init(&rb->reader_waiting, 0);
+    atomic_init(&rb->reader_want, 1);
+    atomic_init(&rb->writer_waiting, 0);
+    atomic_init(&rb->mark_head, 0);
+    atomic_init(&rb->mark_tail, 0);
+    rb->staged = 0;
+    rb->data_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (rb->data_fd < 0) return -1;
+    rb->space_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (rb->space_fd < 0) {
+        close(rb->data_fd);
+        return -1;
+    }
+    return 0;
+}
+
+void ring_buffer_destroy(struct ring_buffer *rb) {
+    close(rb->data_fd);
+    close(rb->space_fd);
+}
+
+size_t ring_buffer_count(struct ring_buffer *rb) {
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    return atomic_load_explicit(&rb->tail, memory_order_acquire) - head;
+}
+
+size_t ring_buffer_write_reserve(struct ring_buffer *rb, char **p) {
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed) + rb->staged;
+    size_t space = RING_BUFFER_SIZE - (tail - head);
+    size_t contig = RING_BUFFER_SIZE - (tail & RING_MASK);
+
+    *p = &rb->data[tail & RING_MASK];
+    return space < contig ? space : contig;
+}
+
+void ring_buffer_write_commit(struct ring_buffer *rb, size_t len) {
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+
+    len += rb->staged;
+    rb->staged = 0;
+    if (len == 0) return;
+    atomic_store_explicit(&rb->tail, tail + len, memory_order_release);
+    // 消费者要的数据还没攒够就不叫醒它
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&rb->reader_waiting, memory_order_relaxed) &&
+        tail + len - atomic_load_explicit(&rb->head, memory_order_relaxed) >=
+            atomic_load_explicit(&rb->reader_want, memory_order_relaxed) &&
+        atomic_exchange(&rb->reader_waiting, 0))
+        wake(rb->data_fd);
+}
+
+// 暂存之后的空闲字节数
+static size_t stage_space(struct ring_buffer *rb) {
+    return RING_BUFFER_SIZE - ring_buffer_count(rb) - rb->staged;
+}
+
+int ring_buffer_stage(struct ring_buffer *rb, const void *data, size_t len) {
+    int64_t deadline = 0;
+    size_t tail, off, first;
+
+    if (len > RING_BUFFER_SIZE) return -1;
+    // 空间不够时短暂等待消费者，超时就丢弃，不让接收线程长时间阻塞
+    while (stage_space(rb) < len) {
+        int64_t now = now_ms();
+        if (deadline == 0) {
+            deadline = now + RING_WRITE_TIMEOUT_MS;
+            ring_buffer_write_commit(rb, 0); // 消费者可能正在等这些数据
+        }
+        if (now >= deadline) return -1;
+        atomic_store(&rb->writer_waiting, 1);
+        if (stage_space(rb) >= len) {
+            atomic_store(&rb->writer_waiting, 0);
+            break;
+        }
+        sleep_on(rb->space_fd, deadline - now);
+        atomic_store(&rb->writer_waiting, 0);
+    }
+
+    // 写入数据，空间不够连续时绕回到头部
+    tail = atomic_load_explicit(&rb->tail, memory_order_relaxed) + rb->staged;
+    off = tail & RING_MASK;
+    first = RING_BUFFER_SIZE - off < len ? RING_BUFFER_SIZE - off : len;
+    memcpy(&rb->data[off], data, first);
+    memcpy(&rb->data[0], (const char *)data + first, len - first);
+    rb->staged += len;
+    return 0;
+}
+
+int ring_buffer_write(struct ring_buffer *rb, const void *data, size_t len) {
+    if (ring_buffer_stage(rb, data, len) < 0) return -1;
+    ring_buffer_write_commit(rb, 0);
+    return 0;
+}
+
+size_t ring_buffer_write_pos(struct ring_buffer *rb) {
+    return atomic_load_explicit(&rb->tail, memory_order_relaxed);
+}
+
+void ring_buffer_discard_until(struct ring_buffer *rb, size_t pos) {
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+
+    if ((ptrdiff_t)(pos - head) > 0) ring_buffer_read_commit(rb, pos - head);
+}
+
+int ring_buffer_mark(struct ring_buffer *rb, int64_t tag) {
+    size_t t = atomic_load_explicit(&rb->mark_tail, memory_order_relaxed);
+
+    if (t - atomic_load_explicit(&rb->mark_head, memory_order_acquire) == RING_MARKS) return -1;
+    rb->marks[t % RING_MARKS].pos = atomic_load_explicit(&rb->tail, memory_order_relaxed) + rb->staged;
+    rb->marks[t % RING_MARKS].tag = tag;
+    atomic_store_explicit(&rb->mark_tail, t + 1, memory_order_release);
+    return 0;
+}
+
+int ring_buffer_mark_pop(struct ring_buffer *rb, size_t pos, int64_t *tag) {
+    size_t h = atomic_load_explicit(&rb->mark_head, memory_order_relaxed);
+    struct ring_mark_st *m = &rb->marks[h % RING_MARKS];
+
+    if (h == atomic_load_explicit(&rb->mark_tail, memory_order_acquire) ||
+        (ptrdiff_t)(m->pos - pos) > 0) {
+        return 0;
+    }
+    *tag = m->tag;
+    atomic_store_explicit(&rb->mark_head, h + 1, memory_order_release);
+    return 1;
+}
+
+size_t ring_buffer_read_pos(struct ring_buffer *rb) {
+    return atomic_load_explicit(&rb->head, memory_order_relaxed);
+}
+
+size_t ring_buffer_read_wait(struct ring_buffer *rb, size_t want, int timeout_ms) {
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    size_t count;
+    int64_t deadline = timeout_ms > 0 ? now_ms() + timeout_ms : 0;
+
+    if (want > RING_BUFFER_SIZE) want = RING_BUFFER_SIZE;
+    while ((count = atomic_load_explicit(&rb->tail, memory_order_acquire) - head) < want) {
+        if (timeout_ms == 0) return count;
+        atomic_store(&rb->reader_want, want);
+        atomic_store(&rb->reader_waiting, 1);
+        if (atomic_load(&rb->tail) - head >= want) {
+            atomic_store(&rb->reader_waiting, 0);
+            continue;
+        }
+        // 超时后再检查一次，仍然不够就返回当前的字节数
+        if (!sleep_on(rb->data_fd, timeout_ms)) timeout_ms = 0;
+        atomic_store(&rb->reader_waiting, 0);
+        if (timeout_ms > 0 && (timeout_ms = deadline - now_ms()) <= 0) timeout_ms = 0;
+    }
+    return count;
+}
+
+size_t ring_buffer_read_peek(struct ring_buffer *rb, size_t skip, char **p, int timeout_ms) {
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed) + skip;
+    size_t tail, contig;
+
+    if (ring_buffer_read_wait(rb, skip + 1, timeout_ms) <= skip) return 0;
+    tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    contig = RING_BUFFER_SIZE - (head & RING_MASK);
+    *p = &rb->data[head & RING_MASK];
+    return tail - head < contig ? tail - head : contig;
+}
+
+void ring_buffer_read_commit(struct ring_buffer *rb, size_t len) {
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+
+    atomic_store_explicit(&rb->head, head + len, memory_order_release);
+    wake_if_waiting(&rb->writer_waiting, rb->space_fd);
+}
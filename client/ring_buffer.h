@@ -0,0 +1,79 @@
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RING_BUFFER_SIZE (2 * 1024 * 1024) // 2MB环形缓冲区大小（2的幂）
+#define RING_CACHELINE 64
+#define RING_WRITE_TIMEOUT_MS 10          // 缓冲区满时生产者最多等待的时间
+#define RING_MARKS 256                    // 最多同时在缓冲区里的时间标记（每个报文一个）
+
+/*
+单生产者/单消费者环形缓冲区：接收线程写，写入线程读，不加锁。
+head/tail 是只增不减的字节计数，各自独占一条缓存行，只由一方写；
+数据量 = tail - head。读写都是零拷贝的预留/提交：
+先拿到一段连续的空间或数据，直接在缓冲区里读写，再提交长度。
+生产者也可以先暂存多段数据，处理完一批报文后一次提交，消费者只被唤醒一次。
+只有在对方确实睡着时才通过 eventfd 唤醒，平时不进内核；
+消费者可以要求攒够一定字节数才被唤醒，减少小块写入和上下文切换。
+缓冲区里只有音频字节；每个报文的到达时刻作为标记另放在一个小队列里，
+记着它在字节流里的结束位置，消费者把数据交出去时按位置取出。
+*/
+struct ring_mark_st {
+    size_t pos;                                  // 标记的数据在字节流里的结束位置
+    int64_t tag;
+};
+
+struct ring_buffer {
+    _Alignas(RING_CACHELINE) atomic_size_t head; // 读位置：只有消费者（写入线程）修改
+    atomic_int reader_waiting;                   // 消费者在等数据而睡眠
+    atomic_size_t reader_want;                   // 消费者要等到缓冲区里有这么多字节才醒
+    int data_fd;                                 // eventfd：唤醒消费者
+    atomic_size_t mark_head;                     // 标记队列的读位置
+
+    _Alignas(RING_CACHELINE) atomic_size_t tail; // 写位置：只有生产者（接收线程）修改
+    size_t staged;                               // 已写入 tail 之后但还没提交的字节数（生产者私有）
+    atomic_int writer_waiting;                   // 生产者因为缓冲区满而睡眠
+    int space_fd;                                // eventfd：唤醒生产者
+    atomic_size_t mark_tail;                     // 标记队列的写位置
+
+    _Alignas(RING_CACHELINE) struct ring_mark_st marks[RING_MARKS];
+    _Alignas(RING_CACHELINE) char data[RING_BUFFER_SIZE]; // 实际存储音频数据的缓冲区数组
+};
+
+int ring_buffer_init(struct ring_buffer *rb);
+void ring_buffer_destroy(struct ring_buffer *rb);
+// 当前缓冲区中的数据字节数（统计用，任何线程都可以调用）
+size_t ring_buffer_count(struct ring_buffer *rb);
+
+// 生产者：预留暂存数据之后连续的空闲空间，返回可写字节数，*p 指向写入位置
+size_t ring_buffer_write_reserve(struct ring_buffer *rb, char **p);
+// 生产者：提交暂存的数据和新写入的 len 字节，缓冲区由空变为非空时唤醒消费者
+void ring_buffer_write_commit(struct ring_buffer *rb, size_t len);
+// 暂存 len 字节（可能绕回）但不提交，空间不足时先提交已暂存的数据，
+// 再最多等待 RING_WRITE_TIMEOUT_MS，超时返回 -1 丢弃
+int ring_buffer_stage(struct ring_buffer *rb, const void *data, size_t len);
+// 写入并立即提交 len 字节
+int ring_buffer_write(struct ring_buffer *rb, const void *data, size_t len);
+
+// 生产者：已提交数据的结束位置（只增不减的字节计数），换台时标记旧频道数据的结尾
+size_t ring_buffer_write_pos(struct ring_buffer *rb);
+// 消费者：丢弃 pos 之前的所有数据，读位置已经越过 pos 时什么也不做
+void ring_buffer_discard_until(struct ring_buffer *rb, size_t pos);
+// 生产者：在暂存数据的当前结尾打一个标记（比如报文的到达时刻），标记队列满时丢掉它返回 -1
+int ring_buffer_mark(struct ring_buffer *rb, int64_t tag);
+// 消费者：取出下一个结束位置不超过 pos 的标记，成功返回 1，没有返回 0
+int ring_buffer_mark_pop(struct ring_buffer *rb, size_t pos, int64_t *tag);
+// 消费者：读位置（只增不减的字节计数）
+size_t ring_buffer_read_pos(struct ring_buffer *rb);
+
+// 消费者：等到缓冲区里至少有 want 字节（最多 timeout_ms，-1 一直等），返回当前字节数
+size_t ring_buffer_read_wait(struct ring_buffer *rb, size_t want, int timeout_ms);
+// 消费者：等待 head + skip 之后的数据（最多 timeout_ms，-1 一直等），
+// 返回从那里开始连续的可读字节数，*p 指向数据。skip 是已经交出去但还不能释放的字节
+size_t ring_buffer_read_peek(struct ring_buffer *rb, size_t skip, char **p, int timeout_ms);
+// 消费者：释放已经读完的 len 字节，生产者在等空间时唤醒它
+void ring_buffer_read_commit(struct ring_buffer *rb, size_t len);
+
+#endif
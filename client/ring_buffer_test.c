@@ -0,0 +1,182 @@
+/*
+无锁环形缓冲区自测：一个生产者线程按不等长的块写入确定的字节流
+（交替使用 ring_buffer_write 和零拷贝的预留/提交），
+一个消费者线程用预留/提交读出并逐字节核对，最后报告吞吐量；
+再检查消费者按水位等待时，数据攒够了才醒、不够时按期限返回，
+以及到达标记按字节流的位置取出、队列满时丢弃。
+*/
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "ring_buffer.h"
+
+#define TOTAL_BYTES (256L * 1024 * 1024)
+#define MAX_CHUNK 40960 // 与频道包的数据长度相当
+
+static struct ring_buffer rb;
+static long mismatches;
+static long write_drops;
+
+static uint8_t stream_byte(size_t i) {
+    return (uint8_t)(i * 131 + (i >> 11));
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *producer(void *arg) {
+    static uint8_t chunk[MAX_CHUNK];
+    uint32_t seed = 12345;
+    size_t pos = 0;
+
+    while (pos < TOTAL_BYTES) {
+        seed = seed * 1103515245 + 12345;
+        size_t len = 1 + (seed >> 8) % MAX_CHUNK;
+        if (len > TOTAL_BYTES - pos) len = TOTAL_BYTES - pos;
+        if (seed & 0x10000) {
+            for (size_t i = 0; i < len; i++)
+                chunk[i] = stream_byte(pos + i);
+            if (ring_buffer_write(&rb, chunk, len) < 0) {
+                write_drops++; // 缓冲区满超时，重试同一块
+                continue;
+            }
+        } else {
+            char *p;
+            size_t n = ring_buffer_write_reserve(&rb, &p);
+            if (n == 0) continue;
+            if (len > n) len = n;
+            for (size_t i = 0; i < len; i++)
+                p[i] = stream_byte(pos + i);
+            ring_buffer_write_commit(&rb, len);
+        }
+        pos += len;
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    size_t pos = 0;
+    char *p;
+
+    while (pos < TOTAL_BYTES) {
+        size_t n = ring_buffer_read_peek(&rb, 0, &p, 1000);
+        for (size_t i = 0; i < n; i++)
+            if ((uint8_t)p[i] != stream_byte(pos + i)) mismatches++;
+        ring_buffer_read_commit(&rb, n);
+        pos += n;
+    }
+    return NULL;
+}
+
+#define TRICKLE_CHUNK 1000
+#define TRICKLE_CHUNKS 20
+
+// 每毫秒写一小块，模拟逐包到达
+static void *trickle(void *arg) {
+    static char chunk[TRICKLE_CHUNK];
+
+    for (int i = 0; i < TRICKLE_CHUNKS; i++) {
+        usleep(1000);
+        ring_buffer_write(&rb, chunk, sizeof(chunk));
+    }
+    return NULL;
+}
+
+static int check_watermark(void) {
+    pthread_t tp;
+    size_t want = TRICKLE_CHUNK * TRICKLE_CHUNKS / 2, n;
+    double start;
+    int failures = 0;
+
+    pthread_create(&tp, NULL, trickle, NULL);
+    n = ring_buffer_read_wait(&rb, want, 1000);
+    if (n < want) {
+        fprintf(stderr, "FAIL: read_wait woke with %zu bytes, wanted %zu\n", n, want);
+        failures++;
+    }
+    pthread_join(tp, NULL);
+
+    start = now_sec();
+    n = ring_buffer_read_wait(&rb, RING_BUFFER_SIZE, 50);
+    if (n != TRICKLE_CHUNK * TRICKLE_CHUNKS || now_sec() - start < 0.045) {
+        fprintf(stderr, "FAIL: read_wait must time out with what is there\n");
+        failures++;
+    }
+    ring_buffer_read_commit(&rb, n);
+    return failures;
+}
+
+static int check_marks(void) {
+    static char chunk[TRICKLE_CHUNK];
+    size_t base = ring_buffer_write_pos(&rb);
+    int64_t tag;
+    int failures = 0, dropped = 0;
+
+    // 三个报文，暂存后一起提交
+    for (int i = 0; i < 3; i++) {
+        ring_buffer_stage(&rb, chunk, sizeof(chunk));
+        ring_buffer_mark(&rb, 100 + i);
+    }
+    ring_buffer_write_commit(&rb, 0);
+    if (ring_buffer_mark_pop(&rb, base + TRICKLE_CHUNK - 1, &tag)) {
+        fprintf(stderr, "FAIL: mark popped before its packet was handed out\n");
+        failures++;
+    }
+    if (!ring_buffer_mark_pop(&rb, base + 2 * TRICKLE_CHUNK, &tag) || tag != 100 ||
+        !ring_buffer_mark_pop(&rb, base + 2 * TRICKLE_CHUNK, &tag) || tag != 101 ||
+        ring_buffer_mark_pop(&rb, base + 2 * TRICKLE_CHUNK, &tag)) {
+        fprintf(stderr, "FAIL: marks must come out in order up to the position\n");
+        failures++;
+    }
+    ring_buffer_discard_until(&rb, ring_buffer_write_pos(&rb));
+    while (ring_buffer_mark_pop(&rb, ring_buffer_read_pos(&rb), &tag))
+        ;
+    for (int i = 0; i < RING_MARKS + 10; i++)
+        dropped += ring_buffer_mark(&rb, i) < 0;
+    if (dropped != 10) {
+        fprintf(stderr, "FAIL: full mark queue must drop, dropped %d\n", dropped);
+        failures++;
+    }
+    while (ring_buffer_mark_pop(&rb, ring_buffer_read_pos(&rb), &tag))
+        ;
+    return failures;
+}
+
+int main(void) {
+    pthread_t tp, tc;
+    double start, elapsed;
+    int failures = 0;
+
+    if (ring_buffer_init(&rb) < 0) {
+        perror("ring_buffer_init");
+        return 1;
+    }
+    start = now_sec();
+    pthread_create(&tc, NULL, consumer, NULL);
+    pthread_create(&tp, NULL, producer, NULL);
+    pthread_join(tp, NULL);
+    pthread_join(tc, NULL);
+    elapsed = now_sec() - start;
+
+    printf("ring_buffer: bytes=%ld seconds=%.3f MB/s=%.1f write_timeouts=%ld mismatches=%ld\n",
+           TOTAL_BYTES, elapsed, TOTAL_BYTES / elapsed / 1e6, write_drops, mismatches);
+    if (mismatches) {
+        fprintf(stderr, "FAIL: consumer saw corrupted data\n");
+        failures++;
+    }
+    if (ring_buffer_count(&rb) != 0) {
+        fprintf(stderr, "FAIL: ring not empty after transfer\n");
+        failures++;
+    }
+    failures += check_watermark();
+    failures += check_marks();
+    ring_buffer_destroy(&rb);
+    printf("failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
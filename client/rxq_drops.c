@@ -0,0 +1,50 @@
+#include <linux/sock_diag.h>
+#include <string.h>
+#include <time.h>
+#include "rxq_drops.h"
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool rxq_ovfl(const struct msghdr *msg, uint32_t *counter) {
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR((struct msghdr *)msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(counter, CMSG_DATA(cmsg), sizeof(*counter));
+            return true;
+        }
+    }
+    return false;
+}
+
+void rxq_drops_sample(struct rxq_drops_st *d, int sd) {
+    uint32_t mem[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(mem);
+    uint32_t slack;
+
+    if (getsockopt(sd, SOL_SOCKET, SO_MEMINFO, mem, &len) < 0 ||
+        len <= SK_MEMINFO_RCVBUF * sizeof(mem[0])) {
+        return;
+    }
+    // 队列只有我们读才会变短，收之前看到满，说明之前这段时间里满过
+    slack = mem[SK_MEMINFO_RCVBUF] / 8;
+    if (slack > RXQ_FULL_SLACK_MAX) slack = RXQ_FULL_SLACK_MAX;
+    if (mem[SK_MEMINFO_RMEM_ALLOC] + slack >= mem[SK_MEMINFO_RCVBUF]) d->full_ns = now_ns();
+}
+
+uint32_t rxq_drops_account(struct rxq_drops_st *d, uint32_t counter) {
+    uint32_t delta = counter - d->last;
+
+    if (delta == 0) return 0;
+    d->last = counter;
+    if (d->full_ns != 0 && now_ns() - d->full_ns <= RXQ_FULL_WINDOW_MS * 1000000LL) {
+        d->overflow += delta;
+        return delta;
+    }
+    d->filtered += delta;
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef RXQ_DROPS_H_
+#define RXQ_DROPS_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/*
+区分套接字的内核丢包：SO_RXQ_OVFL 报上来的是 sk_drops，接收队列满丢掉的和挂在套接字上的
+过滤器（chn_filter）拒掉的都算在里面，只看它的增量会把别的频道、别的来源的报文都当成丢包，
+还会白白加大接收缓冲区。
+队列满不满用 SO_MEMINFO 看：每次处理完一批回来、收下一批之前记一次队列占用，
+只有最近 RXQ_FULL_WINDOW_MS 内见过队列（差不多）满了，计数的增量才算队列满丢的包，
+否则算过滤器拒掉的。计数是随丢包之后入队的下一个报文带上来的，可能在队列收空之后才读到，
+所以按时间窗口而不是按当时的占用判断；窗口里过滤器拒掉的少量报文会一起算成队列满。
+*/
+#define RXQ_FULL_WINDOW_MS 1000          // 见到队列满之后这么久之内的增量都算队列满
+#define RXQ_FULL_SLACK_MAX (256 * 1024)  // 离上限不到 min(接收缓冲区的 1/8, 它) 就算满，大过一个分片报文的 truesize
+
+struct rxq_drops_st {
+    uint32_t last;                       // 上一次看到的 SO_RXQ_OVFL 累计值
+    int64_t full_ns;                     // 最近一次见到队列满的时刻（CLOCK_MONOTONIC），0 表示没见过
+    uint64_t overflow;                   // 队列满丢掉的报文
+    uint64_t filtered;                   // 过滤器拒掉的报文
+};
+
+// 从一个报文的控制消息里取 SO_RXQ_OVFL 的累计值，没有时返回 false（为 0 时内核不带）
+bool rxq_ovfl(const struct msghdr *msg, uint32_t *counter);
+// 收一批之前调用（每次唤醒或处理完一批回来只需一次）：记下接收队列是否满了
+void rxq_drops_sample(struct rxq_drops_st *d, int sd);
+/*
+一批报文收完之后调用，counter 是这一批里最后一个带 SO_RXQ_OVFL 的值（都没带时传 d->last）。
+返回这次算作队列满的丢包数，大于 0 时调用者应该加大接收缓冲区。
+*/
+uint32_t rxq_drops_account(struct rxq_drops_st *d, uint32_t counter);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+内核丢包拆分自测：在回环地址上
+挂着频道过滤器时发一批被拒的报文（别的频道、陌生来源），SO_RXQ_OVFL 会涨，
+但不能算成队列满的丢包，也不该要求加大接收缓冲区；
+不挂过滤器、接收缓冲区很小时灌满队列，丢掉的报文要一个不差地算成队列满，
+哪怕计数是在队列收空之后才随下一个报文带上来的。
+*/
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../include/proto.h"
+#include "chn_filter.h"
+#include "rxq_drops.h"
+
+#define REJECTED 10
+#define FLOOD 200
+
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static int udp_socket(struct sockaddr_in *addr) {
+    socklen_t len = sizeof(*addr);
+    int sd = socket(AF_INET, SOCK_DGRAM, 0), one = 1;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (sd < 0 || bind(sd, (void *)addr, sizeof(*addr)) < 0 ||
+        getsockname(sd, (void *)addr, &len) < 0 ||
+        setsockopt(sd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0) {
+        perror("udp_socket");
+        return -1;
+    }
+    return sd;
+}
+
+static void send_data(int from, const struct sockaddr_in *to, int chnid, int len) {
+    static char buf[MSG_CHANNEL_MAX];
+    struct msg_channel_st *msg = (void *)buf;
+
+    memset(buf, 0, sizeof(buf));
+    msg->hdr.magic = htonl(PACKET_MAGIC);
+    msg->hdr.channel_id = htons(chnid);
+    sendto(from, buf, sizeof(struct packet_header) + len, 0, (void *)to, sizeof(*to));
+}
+
+// 和接收线程一样：收之前看一眼队列，收空之后把计数交给 rxq_drops_account，返回收到的报文数
+static int receive(int sd, struct rxq_drops_st *d, uint32_t *overflow) {
+    static char buf[MSG_CHANNEL_MAX];
+    char ctrl[CMSG_SPACE(sizeof(uint32_t))];
+    struct iovec iov = {.iov_base = buf, .iov_len = sizeof(buf)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    uint32_t counter = d->last;
+    int n = 0;
+
+    usleep(10000);
+    rxq_drops_sample(d, sd);
+    for (;;) {
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+        if (recvmsg(sd, &msg, MSG_DONTWAIT) < 0) break;
+        rxq_ovfl(&msg, &counter);
+        n++;
+    }
+    *overflow = rxq_drops_account(d, counter);
+    return n;
+}
+
+static int rcvbuf(int sd) {
+    int v = 0;
+    socklen_t len = sizeof(v);
+    getsockopt(sd, SOL_SOCKET, SO_RCVBUF, &v, &len);
+    return v;
+}
+
+// 过滤器拒掉的报文不算丢包
+static void check_filtered(void) {
+    struct rxq_drops_st d = {0};
+    struct sockaddr_in raddr, saddr, faddr;
+    int rsd = udp_socket(&raddr), server = udp_socket(&saddr), foreign = udp_socket(&faddr);
+    int before, got = 0;
+    uint32_t overflow, total = 0;
+
+    if (rsd < 0 || server < 0 || foreign < 0) {
+        failures++;
+        return;
+    }
+    before = rcvbuf(rsd);
+    check(chn_filter_attach(rsd, &saddr, 5) == 0, "attach filter");
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < REJECTED / 2; i++) {
+            send_data(server, &raddr, 6, 1000);
+            send_data(foreign, &raddr, 5, 1000);
+        }
+        send_data(server, &raddr, 5, 1000); // 带上计数
+        got += receive(rsd, &d, &overflow);
+        total += overflow;
+    }
+    printf("rxq filtered: received=%d counter=%u overflow=%llu filtered=%llu\n", got, d.last,
+           (unsigned long long)d.overflow, (unsigned long long)d.filtered);
+    check(got == 3, "only the chosen channel passes");
+    check(d.last == 3 * REJECTED, "SO_RXQ_OVFL counts filter rejects");
+    check(total == 0 && d.overflow == 0, "filter rejects are not kernel drops");
+    check(d.filtered == 3 * REJECTED, "filter rejects are counted as filtered");
+    check(rcvbuf(rsd) == before, "receive buffer untouched");
+    close(rsd);
+    close(server);
+    close(foreign);
+}
+
+// 队列满丢掉的报文都算上，计数晚到也一样
+static void check_overflow(void) {
+    struct rxq_drops_st d = {0};
+    struct sockaddr_in raddr, saddr;
+    int rsd = udp_socket(&raddr), server = udp_socket(&saddr), small = 16384, got;
+    uint32_t overflow, total;
+
+    if (rsd < 0 || server < 0) {
+        failures++;
+        return;
+    }
+    setsockopt(rsd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    for (int i = 0; i < FLOOD; i++)
+        send_data(server, &raddr, 5, 1000);
+    got = receive(rsd, &d, &total);
+    check(got < FLOOD, "small queue must overflow");
+    // 计数随收空之后入队的下一个报文才带上来
+    send_data(server, &raddr, 5, 1000);
+    got += receive(rsd, &d, &overflow);
+    total += overflow;
+    printf("rxq overflow: sent=%d received=%d counter=%u overflow=%llu filtered=%llu\n",
+           FLOOD + 1, got, d.last, (unsigned long long)d.overflow,
+           (unsigned long long)d.filtered);
+    check(d.last == (uint32_t)(FLOOD + 1 - got), "SO_RXQ_OVFL counts the overflow");
+    check(total == d.last && d.overflow == d.last, "overflow drops are reported");
+    check(d.filtered == 0, "overflow drops are not counted as filtered");
+    close(rsd);
+    close(server);
+}
+
+int main(void) {
+    check_filtered();
+    check_overflow();
+    printf("rxq_drops: failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+#define _GNU_SOURCE          // vmsplice(), pipe2(), O_DIRECT
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>       // FIONREAD
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include "sink.h"
+
+#define SINK_PIPE_SIZE (1024 * 1024) // 播放器管道的容量
+#define SINK_ARGV_MAX 32
+
+extern char **environ;
+
+/*
+按空白把命令行拆成参数，直接 posix_spawnp，不经过 /bin/sh：
+少一次 fork/exec，也不会把频道名之类的字符串交给 shell 解释。
+因此不支持重定向和管道，需要时写一个包装脚本。
+*/
+static int open_player(struct sink_st *s, const char *cmd) {
+    char *line, *argv[SINK_ARGV_MAX + 1], *save = NULL;
+    int argc = 0, pd[2], err;
+    posix_spawn_file_actions_t fa;
+
+    line = strdup(cmd);
+    if (line == NULL) return -1;
+    for (char *tok = strtok_r(line, " \t", &save); tok != NULL && argc < SINK_ARGV_MAX;
+         tok = strtok_r(NULL, " \t", &save)) {
+        argv[argc++] = tok;
+    }
+    argv[argc] = NULL;
+    if (argc == 0) {
+        free(line);
+        errno = EINVAL;
+        return -1;
+    }
+    // 两端都不让子进程继承，dup2 到标准输入的那份除外
+    if (pipe2(pd, O_CLOEXEC) < 0) {
+        free(line);
+        return -1;
+    }
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, pd[0], 0);
+    err = posix_spawnp(&s->pid, argv[0], &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    free(line);
+    if (err != 0) {
+        close(pd[0]);
+        close(pd[1]);
+        errno = err;
+        return -1;
+    }
+
+    // 只有写端非阻塞；读端的文件状态标志和播放器的标准输入是共享的
+    fcntl(pd[1], F_SETFL, fcntl(pd[1], F_GETFL) | O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+    fcntl(pd[1], F_SETPIPE_SZ, SINK_PIPE_SIZE);
+#endif
+    s->fd = pd[1];
+    s->rd = pd[0];                   // 留着，换台时从这里丢掉管道里旧频道的数据
+    s->pipe = s->splice = true;
+    return 0;
+}
+
+// 数据走原来的标准输出，程序自己打印的信息改到标准错误，不混进音频流
+static int open_stdout(struct sink_st *s) {
+    struct stat st;
+
+    fflush(stdout);
+    s->fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (s->fd < 0) return -1;
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        close(s->fd);
+        return -1;
+    }
+    s->pipe = s->splice = fstat(s->fd, &st) == 0 && S_ISFIFO(st.st_mode);
+    return 0;
+}
+
+// 能用 O_DIRECT 就绕过页缓存（tmpfs 等不支持时退回普通写）
+static int open_file(struct sink_st *s, const char *path) {
+    s->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+    if (s->fd < 0 && errno == EINVAL)
+        s->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (s->fd < 0) return -1;
+    if (posix_memalign((void **)&s->buf, SINK_FILE_ALIGN, SINK_FILE_BUF) != 0) {
+        close(s->fd);
+        s->fd = -1;
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+int sink_open(struct sink_st *s, const char *spec, const char *player_cmd) {
+    memset(s, 0, sizeof(*s));
+    s->fd = s->rd = -1;
+    s->pid = -1;
+
+    if (strcmp(spec, "player") == 0) {
+        s->type = SINK_PLAYER;
+        return open_player(s, player_cmd);
+    }
+    if (strcmp(spec, "stdout") == 0 || strcmp(spec, "-") == 0) {
+        s->type = SINK_STDOUT;
+        return open_stdout(s);
+    }
+    if (strcmp(spec, "null") == 0) {
+        s->type = SINK_NULL;
+        return 0;
+    }
+    if (strncmp(spec, "file:", 5) == 0 && spec[5] != '\0') {
+        s->type = SINK_FILE;
+        return open_file(s, spec + 5);
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+// 把文件缓冲区写出去；O_DIRECT 要求长度对齐，不整的尾巴只在关闭时去掉 O_DIRECT 再写
+static int file_flush(struct sink_st *s) {
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < s->fill) {
+        n = write(s->fd, s->buf + off, s->fill - off);
+        if (n < 0 && errno == EINVAL && (fcntl(s->fd, F_GETFL) & O_DIRECT)) {
+            // 文件系统对齐要求更严，以后都走页缓存
+            fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) & ~O_DIRECT);
+            continue;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        off += n;
+    }
+    s->fill = 0;
+    return 0;
+}
+
+void sink_close(struct sink_st *s) {
+    if (s->type == SINK_FILE && s->fd >= 0) {
+        fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) & ~O_DIRECT);
+        if (file_flush(s) < 0) perror("sink file");
+    }
+    if (s->fd >= 0) close(s->fd);    // 播放器读到文件结束，放完自己退出
+    if (s->rd >= 0) close(s->rd);
+    if (s->pid > 0) waitpid(s->pid, NULL, 0);
+    free(s->buf);
+    s->fd = s->rd = -1;
+    s->pid = -1;
+    s->buf = NULL;
+}
+
+ssize_t sink_write(struct sink_st *s, const char *data, size_t len) {
+    ssize_t n;
+
+    switch (s->type) {
+    case SINK_NULL:
+        return len;
+    case SINK_FILE:
+        n = len < SINK_FILE_BUF - s->fill ? len : SINK_FILE_BUF - s->fill;
+        memcpy(s->buf + s->fill, data, n);
+        s->fill += n;
+        if (s->fill == SINK_FILE_BUF && file_flush(s) < 0) return -1;
+        return n;
+    default:
+        break;
+    }
+
+    if (s->splice) {
+        // 直接把调用者的页挂进管道，不经过任何拷贝
+        struct iovec iov = {.iov_base = (void *)data, .iov_len = len};
+        n = vmsplice(s->fd, &iov, 1, SPLICE_F_NONBLOCK);
+        if (n >= 0 || (errno != EINVAL && errno != ENOSYS && errno != EBADF)) return n;
+        fprintf(stderr, "vmsplice not supported on output, falling back to write()\n");
+        s->splice = false;
+        return 0;                    // 调用者要先等已经挂进去的页被读完
+    }
+    return write(s->fd, data, len);
+}
+
+int sink_wait(struct sink_st *s, int timeout_ms) {
+    struct pollfd pfd = {.fd = s->fd, .events = POLLOUT};
+
+    // 我们自己拿着读端，播放器退出后写端不会报 EPIPE，只会一直满着
+    if (s->pid > 0 && waitpid(s->pid, NULL, WNOHANG) == s->pid) {
+        s->pid = -1;
+        errno = EPIPE;
+        return -1;
+    }
+    if (s->fd < 0 || s->type == SINK_FILE) return 0;
+    return poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR ? -1 : 0;
+}
+
+size_t sink_unread(struct sink_st *s) {
+    int unread;
+
+    if (!s->pipe || ioctl(s->fd, FIONREAD, &unread) < 0) return 0;
+    return unread;
+}
+
+bool sink_realtime(const struct sink_st *s) {
+    return s->type == SINK_PLAYER || s->type == SINK_STDOUT;
+}
+
+void sink_discard(struct sink_st *s) {
+    static int devnull = -1;
+
+    if (s->rd < 0) return;           // 只有播放器管道的读端在我们手里
+    // SPLICE_F_NONBLOCK 只对这次调用有效，不影响播放器那一端的阻塞读
+    if (devnull < 0) devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    while (devnull >= 0 &&
+           splice(s->rd, NULL, devnull, NULL, 1 << 20, SPLICE_F_NONBLOCK) > 0)
+        ;
+}
@@ -0,0 +1,50 @@
+#ifndef SINK_H_
+#define SINK_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+写入线程的输出端。写入线程只管从环形缓冲区取数据交给 sink_write()，
+输出到哪里由 -o 决定：
+  player      用 posix_spawnp 直接启动播放器（不经过 shell），数据经管道 vmsplice 过去
+  stdout      标准输出，是管道时同样 vmsplice；程序自己的输出改到标准错误
+  null        直接丢掉，用来测接收链路本身的吞吐量
+  file:PATH   攒成大块、按页对齐写文件（能用 O_DIRECT 时绕过页缓存）
+*/
+enum sink_type {
+    SINK_PLAYER,
+    SINK_STDOUT,
+    SINK_NULL,
+    SINK_FILE,
+};
+
+#define SINK_FILE_BUF (1024 * 1024) // 文件输出每次写的块大小
+#define SINK_FILE_ALIGN 4096        // O_DIRECT 要求的对齐
+
+struct sink_st {
+    enum sink_type type;
+    int fd;                         // 输出描述符，null 为 -1
+    int rd;                         // 播放器管道的读端（换台时丢掉没播放的数据），没有为 -1
+    pid_t pid;                      // 播放器进程，没有为 -1
+    bool pipe;                      // fd 是管道，可以用 FIONREAD 看对方还没读走多少
+    bool splice;                    // vmsplice 零拷贝：交出去的页在 sink_unread() 归零前不能覆盖
+    char *buf;                      // 文件输出的对齐缓冲区
+    size_t fill;
+};
+
+// 按 spec 打开输出端，player_cmd 是播放器命令行（按空白拆分参数），失败返回 -1
+int sink_open(struct sink_st *s, const char *spec, const char *player_cmd);
+void sink_close(struct sink_st *s);
+// 交出最多 len 字节，返回接受的字节数；暂时写不进返回 -1 且 errno 为 EAGAIN
+ssize_t sink_write(struct sink_st *s, const char *data, size_t len);
+// 等输出端可写，最多 timeout_ms；播放器已经退出返回 -1
+int sink_wait(struct sink_st *s, int timeout_ms);
+// 已经交出去、消费端还没读走的字节数
+size_t sink_unread(struct sink_st *s);
+// 输出端有播放时钟（会欠载），null 和文件没有
+bool sink_realtime(const struct sink_st *s);
+// 换台：丢掉已经交出去但还没播放的数据
+void sink_discard(struct sink_st *s);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+输出端自测：文件输出按不整齐的块写入一段确定的字节流，关闭后逐字节读回核对
+（长度不是页的整数倍，检查关闭时写出的尾巴）；null 输出全部接受；
+播放器退出后 sink_wait 报 EPIPE；不认识的输出端打开失败。
+*/
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sink.h"
+
+#define FILE_BYTES (3 * SINK_FILE_BUF + 12345)
+#define MAX_CHUNK 40960
+
+static uint8_t stream_byte(size_t i) {
+    return (uint8_t)(i * 131 + (i >> 11));
+}
+
+static int check_file(void) {
+    static uint8_t chunk[MAX_CHUNK];
+    char path[] = "/tmp/sink_test.XXXXXX", spec[64];
+    struct sink_st s;
+    size_t pos = 0, len, mismatches = 0;
+    uint32_t seed = 12345;
+    ssize_t n;
+    FILE *fp;
+    int fd, c, failures = 0;
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    snprintf(spec, sizeof(spec), "file:%s", path);
+    if (sink_open(&s, spec, NULL) < 0) {
+        perror("sink_open file");
+        unlink(path);
+        return 1;
+    }
+    while (pos < FILE_BYTES) {
+        seed = seed * 1103515245 + 12345;
+        len = 1 + (seed >> 8) % MAX_CHUNK;
+        if (len > FILE_BYTES - pos) len = FILE_BYTES - pos;
+        for (size_t i = 0; i < len; i++)
+            chunk[i] = stream_byte(pos + i);
+        for (size_t off = 0; off < len; off += n) {
+            n = sink_write(&s, (char *)chunk + off, len - off);
+            if (n <= 0) {
+                perror("sink_write file");
+                sink_close(&s);
+                unlink(path);
+                return 1;
+            }
+        }
+        pos += len;
+    }
+    sink_close(&s);
+
+    fp = fopen(path, "rb");
+    pos = 0;
+    while (fp != NULL && (c = getc(fp)) != EOF) {
+        if ((uint8_t)c != stream_byte(pos)) mismatches++;
+        pos++;
+    }
+    if (fp != NULL) fclose(fp);
+    unlink(path);
+    printf("sink file: bytes=%zu mismatches=%zu\n", pos, mismatches);
+    if (pos != FILE_BYTES || mismatches) {
+        fprintf(stderr, "FAIL: file sink wrote %zu bytes, %zu wrong\n", pos, mismatches);
+        failures++;
+    }
+    return failures;
+}
+
+static int check_null(void) {
+    static char chunk[MAX_CHUNK];
+    struct sink_st s;
+    int failures = 0;
+
+    if (sink_open(&s, "null", NULL) < 0 || sink_realtime(&s) ||
+        sink_write(&s, chunk, sizeof(chunk)) != sizeof(chunk) || sink_unread(&s) != 0) {
+        fprintf(stderr, "FAIL: null sink must accept everything\n");
+        failures++;
+    }
+    sink_close(&s);
+    return failures;
+}
+
+// 播放器退出后我们还拿着读端，写端不会报错，要靠 sink_wait 发现
+static int check_player_exit(void) {
+    struct sink_st s;
+    int failures = 0, ret = 0;
+
+    if (sink_open(&s, "player", "true") < 0) {
+        perror("sink_open player");
+        return 1;
+    }
+    if (!sink_realtime(&s) || !s.splice) {
+        fprintf(stderr, "FAIL: player sink must be a realtime pipe\n");
+        failures++;
+    }
+    for (int i = 0; i < 100 && ret == 0; i++) {
+        usleep(10000);
+        ret = sink_wait(&s, 0);
+    }
+    if (ret != -1 || errno != EPIPE) {
+        fprintf(stderr, "FAIL: sink_wait must report the exited player\n");
+        failures++;
+    }
+    sink_close(&s);
+
+    if (sink_open(&s, "player", "/nonexistent/player -") == 0) {
+        fprintf(stderr, "FAIL: missing player must fail to open\n");
+        sink_close(&s);
+        failures++;
+    }
+    return failures;
+}
+
+int main(void) {
+    struct sink_st s;
+    int failures = 0;
+
+    failures += check_file();
+    failures += check_null();
+    failures += check_player_exit();
+    if (sink_open(&s, "speaker", NULL) == 0 || errno != EINVAL) {
+        fprintf(stderr, "FAIL: unknown output must be rejected\n");
+        failures++;
+    }
+    printf("failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
@@ -3,16 +3,18 @@
 #include <unistd.h>
 #include "stat_thr.h"
 #include "client.h"
-// 统计线程
+// 统计线程：没有开启 metrics 端点时，每5秒在终端打印一次摘要
 void* stats_thread(void* arg) {
     struct shared_data *shared = (struct shared_data*)arg;
+    struct recv_metrics_st *r = &shared->metrics.recv;
+    struct writer_metrics_st *w = &shared->metrics.writer;
     long last_received = 0, last_written = 0;//上次统计的收发包总数，便于计算速率。
     
     while (!shared->stop_flag) {
         sleep(5); // 每5秒输出一次统计
         
-        long current_received = shared->packets_received;
-        long current_written = shared->packets_written;
+        long current_received = metric_get(&r->packets_received);
+        long current_written = metric_get(&w->packets_written);
         /*
         总共收到多少包；
         每秒接收速度；
@@ -20,13 +22,37 @@ void* stats_thread(void* arg) {
         每秒写入速度；
         丢弃了多少包（可能是因为缓冲区满）
         */
-        printf("Stats: Received %ld packets (%ld/s), Written %ld packets (%ld/s), Dropped %ld\n",
+        printf("Stats: Received %ld packets (%ld/s), Written %ld packets (%ld/s), Dropped %ld, Corrupt %ld, Recovered %ld\n",
                current_received, (current_received - last_received) / 5,
                current_written, (current_written - last_written) / 5,
-               shared->packets_dropped);
+               metric_get(&r->packets_dropped), metric_get(&r->packets_corrupt),
+               metric_get(&r->packets_recovered));
+        printf("       Repair: Lost %ld, NACKs sent %ld, Late packets %ld, Resyncs %ld (%ld bytes skipped)\n",
+               metric_get(&r->packets_lost), metric_get(&r->nacks_sent),
+               metric_get(&r->packets_late), metric_get(&r->resyncs),
+               metric_get(&r->resync_skipped_bytes));
+        printf("       Jitter: Depth %ld, Reordered %ld, Duplicate %ld, Skipped %ld, ",
+               metric_get(&r->jitter_depth), metric_get(&r->packets_reordered),
+               metric_get(&r->packets_duplicate), metric_get(&r->packets_skipped));
+        hist_print_summary(&r->interarrival_jitter_us, stdout, "D", "us");
+        printf("       Wakeup: %s, spin hits %ld, misses %ld, ",
+               shared->busy_poll_us > 0 ? "busy-poll" : "blocking",
+               metric_get(&r->busy_poll_hits), metric_get(&r->busy_poll_misses));
+        hist_print_summary(&r->wakeup_us, stdout, "latency", "us");
+        printf("       Delay: ");
+        hist_print_summary(&r->one_way_delay_us, stdout, "one-way", "us");
+        printf("              ");
+        hist_print_summary(&w->queue_delay_us, stdout, "queueing", "us");
+        printf("       Write: Underruns %ld%s, ", metric_get(&w->underruns),
+               metric_get(&w->prebuffering) ? " (prebuffering)" : "");
+        hist_print_summary(&w->write_latency_us, stdout, "latency", "us");
         printf("       Bytes: Received %ld, Written %ld, Buffer usage: %zu/%d\n",
-               shared->bytes_received, shared->bytes_written,
-               shared->rb.count, RING_BUFFER_SIZE);
+               metric_get(&r->bytes_received), metric_get(&w->bytes_written),
+               ring_buffer_count(&shared->rb), RING_BUFFER_SIZE);
+        printf("       Socket: Kernel drops %ld, Filtered %ld, Receive buffer %ld bytes (grown %ld times)\n",
+               metric_get(&r->packets_kernel_dropped), metric_get(&r->packets_filtered),
+               metric_get(&r->rcvbuf_bytes),
+               metric_get(&r->rcvbuf_grows));
         
         last_received = current_received;
         last_written = current_written;
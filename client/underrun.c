@@ -0,0 +1,20 @@
+#include "underrun.h"
+
+void underrun_reset(struct underrun_st *u) {
+    u->low = false;
+    u->since_us = 0;
+}
+
+bool underrun_check(struct underrun_st *u, bool low, int64_t now_us, int hold_ms) {
+    if (!low) {
+        u->low = false;
+        return false;
+    }
+    if (!u->low) {
+        u->low = true;
+        u->since_us = now_us;
+    }
+    if (now_us - u->since_us <= (int64_t)hold_ms * 1000) return false;
+    u->low = false;
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef UNDERRUN_H_
+#define UNDERRUN_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+欠载判断的迟滞：服务端每个频道大约一秒发一个 40KB 的包，播放器手里数据量的估计
+在两次到达之间几乎每次都会碰到低水位（默认 0），一碰到就算欠载的话会反复重新攒高水位。
+估计值连续不高于低水位超过 hold_ms（写入线程用攒批时间）才算一次欠载。
+*/
+struct underrun_st {
+    bool low;                        // 上次检查时估计值不高于低水位
+    int64_t since_us;                // 从什么时候起一直不高于低水位
+};
+
+void underrun_reset(struct underrun_st *u);
+// low 是这次检查时估计值是否不高于低水位；连续超过 hold_ms 返回 true，之后重新计时
+bool underrun_check(struct underrun_st *u, bool low, int64_t now_us, int hold_ms);
+
+#endif
@@ -0,0 +1,66 @@
+/*
+欠载迟滞自测：按服务端的节奏每秒到一个 40KB 的包（到达时刻抖动 ±8ms），
+播放器按码率匀速消耗，估计值在两次到达之间会碰到 0 低水位，
+每毫秒检查一次都不能算欠载；断流一秒时要算一次，不加迟滞时每个包都会算。
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "underrun.h"
+
+#define RATE 40960                   // 字节/秒，服务端 320kbps
+#define BURST RATE                   // 每秒一个包
+#define SECONDS 600
+#define HOLD_MS 20                   // 默认攒批时间
+#define JITTER_MS 8
+
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// 模拟 SECONDS 秒，stall 秒处那个包不来，返回算出的欠载次数；hold_ms 为 -1 时一碰到低水位就算（原来的做法）
+static int simulate(int hold_ms, int stall) {
+    struct underrun_st u;
+    int64_t level = 0, next = 0, arrival = 0;
+    int count = 0, k = 0;
+    int prebuffering = 0;            // 算了欠载之后写入线程去攒高水位，有数据之前不再检查
+
+    underrun_reset(&u);
+    srand(7);
+    for (int64_t ms = 0; ms < SECONDS * 1000; ms++) {
+        if (ms == arrival) {
+            if (k != stall) level += (int64_t)BURST * 1000; // 按毫秒 * 字节记，避免舍入
+            k++;
+            next += 1000;
+            arrival = next + rand() % (2 * JITTER_MS + 1) - JITTER_MS;
+        }
+        level -= RATE;
+        if (level < 0) level = 0;
+        if (prebuffering) {
+            prebuffering = level <= 0;
+            continue;
+        }
+        if (underrun_check(&u, level <= 0, ms * 1000, hold_ms)) {
+            count++;
+            prebuffering = 1;
+        }
+    }
+    return count;
+}
+
+int main(void) {
+    int steady = simulate(HOLD_MS, -1);
+    int naive = simulate(-1, -1);
+    int stalled = simulate(HOLD_MS, SECONDS / 2);
+
+    printf("underrun: steady=%d naive=%d stalled=%d\n", steady, naive, stalled);
+    check(steady == 0, "bursty arrivals must not count as underruns");
+    check(naive > SECONDS / 50, "without hysteresis the bursts look like underruns");
+    check(stalled == 1, "a missing packet is one underrun");
+    printf("underrun: failures=%d\n", failures);
+    return failures ? 1 : 0;
+}
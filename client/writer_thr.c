@@ -3,44 +3,144 @@
 #include <string.h>          // 新增：memcpy()
 #include <unistd.h>          // 新增：write(), usleep()
 #include <errno.h>           // 新增：errno, EINTR, EAGAIN等
+#include <time.h>
 #include <pthread.h>         // 新增：pthread相关函数
 #include "client.h"          // 先包含client.h
 #include "writer_thr.h"      // 再包含writer_thr.h
+#include "underrun.h"
 
-// 从环形缓冲区读取（消费者）
-int ring_buffer_read(struct ring_buffer *rb, void *data, size_t max_len) {
-    pthread_mutex_lock(&rb->mutex);
+#define WRITER_POLL_MS 100    // 没有数据时多久检查一次停止标志
+#define WRITER_RECLAIM_MS 10  // 管道里还有 vmsplice 的数据时，多久检查一次播放器读走了多少
+#define WRITER_DEFAULT_RATE (320 * 1024 / 8) // 服务端按 320kbps 限速，测出码率之前先用它
+#define WRITER_RATE_INTERVAL_US 1000000      // 多久更新一次码率估计
+
+/*
+vmsplice() 只是把环形缓冲区的页挂进管道，播放器读走之前这些字节不能被接收线程覆盖，
+所以交出去的字节先记在 inflight 里，等管道中未读的字节数（FIONREAD）小于它时
+再把读走的部分还给环形缓冲区。
+*/
+static void reclaim(struct shared_data *shared, size_t *inflight) {
+    size_t unread;
     
-    // 等待有数据可读
-    while (rb->count == 0) {
-        pthread_cond_wait(&rb->not_empty, &rb->mutex);
+    if (*inflight == 0) return;
+    unread = sink_unread(&shared->sink);
+    if (unread < *inflight) {
+        ring_buffer_read_commit(&shared->rb, *inflight - unread);
+        *inflight = unread;
     }
+}
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+交出去的数据里带着的到达标记：内核收到报文到交给播放器，中间在抖动缓冲区和
+环形缓冲区里排的队。到达时刻是 SO_TIMESTAMPNS 的墙上时间，这里也用墙上时间。
+record 为假时只是丢掉（换台清掉的旧数据）。
+*/
+static void queue_delay(struct shared_data *shared, size_t end, bool record) {
+    struct timespec ts;
+    int64_t tag, now;
     
-    // 确定实际读取长度
-    size_t len = (rb->count < max_len) ? rb->count : max_len;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    while (ring_buffer_mark_pop(&shared->rb, end, &tag)) {
+        if (record)
+            hist_record(&shared->metrics.writer.queue_delay_us,
+                        now > tag ? (now - tag) / 1000 : 0);
+    }
+}
+
+// 按接收线程交给环形缓冲区的字节数估计码率（字节/秒），把水位的毫秒数换算成字节
+struct rate_est_st {
+    int64_t last_us;
+    long last_bytes;
+    long rate;
+};
+
+static void rate_update(struct rate_est_st *re, long bytes, int64_t now) {
+    if (re->last_us == 0) {
+        re->last_us = now;
+        re->last_bytes = bytes;
+        re->rate = WRITER_DEFAULT_RATE;
+        return;
+    }
+    if (now - re->last_us < WRITER_RATE_INTERVAL_US) return;
+    // 停播或刚开始时没有数据，保留原来的估计
+    if (bytes > re->last_bytes) {
+        long cur = (bytes - re->last_bytes) * 1000000 / (now - re->last_us);
+        re->rate = (re->rate * 3 + cur) / 4;
+    }
+    re->last_us = now;
+    re->last_bytes = bytes;
+}
+
+static size_t watermark(const struct rate_est_st *re, int ms, size_t min) {
+    size_t bytes = (size_t)re->rate * ms / 1000;
+    if (bytes > RING_BUFFER_SIZE / 2) bytes = RING_BUFFER_SIZE / 2; // 留一半给接收线程
+    return bytes < min ? min : bytes;
+}
+
+// 播放器还没读走的数据：vmsplice 交出去的页还算在环形缓冲区里，write() 的要加上管道里的
+static size_t buffered(struct shared_data *shared) {
+    size_t unread = shared->sink.splice ? 0 : sink_unread(&shared->sink);
     
-    // 读取数据
-    size_t available = RING_BUFFER_SIZE - rb->head;//从当前读取指针（rb->head）到缓冲区末尾，还有多少连续可读的数据字节。
-    if (len <= available) {
-        memcpy(data, &rb->data[rb->head], len);
-        rb->head = (rb->head + len) % RING_BUFFER_SIZE;
-    } else {
-        memcpy(data, &rb->data[rb->head], available);
-        memcpy((char*)data + available, &rb->data[0], len - available);
-        rb->head = len - available;
+    return ring_buffer_count(&shared->rb) + unread;
+}
+
+/*
+换台后丢掉旧频道的数据：管道里还没被播放器读走的（从读端读掉），
+和环形缓冲区里接收线程标出的结尾之前的。播放器进程一直不用重启。
+*/
+static void flush_old_channel(struct shared_data *shared, size_t *inflight) {
+    sink_discard(&shared->sink);
+    reclaim(shared, inflight);
+    if (*inflight > 0) {
+        // 播放器抢先读走了一部分，剩下的页已经不在管道里了
+        ring_buffer_read_commit(&shared->rb, *inflight);
+        *inflight = 0;
     }
+    ring_buffer_discard_until(&shared->rb, atomic_load(&shared->flush_to));
+    queue_delay(shared, ring_buffer_read_pos(&shared->rb), false);
+}
+
+// 新频道的第一个字节交给了播放器，记下换台用了多久
+static void zap_done(struct shared_data *shared, struct writer_metrics_st *m) {
+    long ms = (now_us() - atomic_load(&shared->zap_start_us)) / 1000;
     
-    rb->count -= len;
-    pthread_cond_signal(&rb->not_full);
-    pthread_mutex_unlock(&rb->mutex);
-    return len;
+    hist_record(&m->zap_ms, ms);
+    metric_add(&m->zaps, 1);
+    printf("Zapped to channel %d in %ld ms\n", shared->chosen_channel, ms);
+}
+
+// 第一个字节交给了播放器，记下从启动到出声用了多久
+static void first_audio(struct shared_data *shared, struct writer_metrics_st *m) {
+    long ms = (now_us() - shared->start_us) / 1000;
+
+    metric_set(&m->first_audio_ms, ms > 0 ? ms : 1);
+    printf("First audio on channel %d in %ld ms\n", shared->chosen_channel, ms);
 }
 
-// 管道写入线程
+// 写入线程：把环形缓冲区的数据交给输出端（见 sink.h）
 void* writer_thread(void* arg) {
     struct shared_data *shared = (struct shared_data*)arg;
-    char buffer[64 * 1024]; // 64KB写入缓冲区
-    int bytes_read;
+    struct sink_st *sink = &shared->sink;
+    char *data;
+    size_t bytes_read;
+    size_t inflight = 0;             // 已经挂进管道、播放器还没读走的字节
+    bool realtime = sink_realtime(sink); // 没有播放时钟的输出端不需要预缓冲，也不会欠载
+    ssize_t n;
+    int64_t start;
+    struct writer_metrics_st *m = &shared->metrics.writer;
+    struct rate_est_st rate = {0};
+    bool prebuffering = realtime;    // 开始播放和欠载之后先攒够高水位
+    bool zapping = false;            // 换台之后还没写出新频道的数据
+    struct underrun_st underrun;
+    unsigned flush_gen = 0;
+    size_t want;
     
     printf("Writer thread started\n");
     
@@ -49,33 +149,82 @@ void* writer_thread(void* arg) {
         usleep(1000); // 1ms
     }
     
+    underrun_reset(&underrun);
+    metric_set(&m->prebuffering, realtime);
     while (!shared->stop_flag) {
-        bytes_read = ring_buffer_read(&shared->rb, buffer, sizeof(buffer));
+        if (atomic_load(&shared->flush_gen) != flush_gen) {
+            flush_gen = atomic_load(&shared->flush_gen);
+            flush_old_channel(shared, &inflight);
+            prebuffering = realtime;
+            zapping = true;
+            metric_set(&m->prebuffering, realtime);
+        }
+        reclaim(shared, &inflight);
+        rate_update(&rate, metric_get(&shared->metrics.recv.bytes_received), now_us());
+        
+        if (prebuffering) {
+            // 环形缓冲区只在攒够高水位时才叫醒我们
+            want = watermark(&rate, shared->high_ms, 1);
+            if (ring_buffer_read_wait(&shared->rb, want, WRITER_POLL_MS) < want) continue;
+            prebuffering = false;
+            underrun_reset(&underrun);
+            metric_set(&m->prebuffering, 0);
+        } else if (realtime &&
+                   underrun_check(&underrun, buffered(shared) <= watermark(&rate, shared->low_ms, 0),
+                                  now_us(), shared->batch_ms)) {
+            // 一碰到低水位不算，一直低过攒批时间才算，见 underrun.h
+            prebuffering = true;
+            metric_add(&m->underruns, 1);
+            metric_set(&m->prebuffering, 1);
+            continue;
+        }
+        
+        // 先等有新数据，再攒一批：够 batch 字节或等满 batch_ms 才写，不为每个包醒一次
+        if (ring_buffer_read_wait(&shared->rb, inflight + 1,
+                                  inflight ? WRITER_RECLAIM_MS : WRITER_POLL_MS) <= inflight)
+            continue;
+        want = watermark(&rate, shared->batch_ms, 1);
+        if (shared->batch_ms > 0)
+            ring_buffer_read_wait(&shared->rb, inflight + want, shared->batch_ms);
+        bytes_read = ring_buffer_read_peek(&shared->rb, inflight, &data, 0);
+        if (bytes_read == 0) continue;
+        // 接收线程先换代再放新频道的数据：取到的数据里可能已经有新频道的，先去清掉旧的
+        if (atomic_load(&shared->flush_gen) != flush_gen) continue;
+        hist_record(&m->ring_occupancy_bytes, ring_buffer_count(&shared->rb));
         
-        if (bytes_read > 0) {
-            int pos = 0;
-            while (pos < bytes_read && !shared->stop_flag) {
-                int written = write(shared->pipe_fd, buffer + pos, bytes_read - pos);
-                if (written < 0) {
-                    if (errno == EINTR) {
-                        continue;
-                    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                        usleep(1000); // 管道满，短暂休眠
-                        continue;
-                    } else {
-                        perror("write to pipe");
-                        shared->stop_flag = true;
-                        break;
-                    }
-                } else {
-                    pos += written;
-                    shared->bytes_written += written;
-                }
+        if (!sink->splice && inflight > 0) {
+            usleep(WRITER_RECLAIM_MS * 1000); // 刚退回 write()，先等挂进管道的页被读完
+            continue;
+        }
+        start = now_us();
+        n = sink_write(sink, data, bytes_read);
+        if (n > 0) {
+            hist_record(&m->write_latency_us, now_us() - start);
+            queue_delay(shared, ring_buffer_read_pos(&shared->rb) + inflight + n, true);
+            if (zapping) {
+                zap_done(shared, m);
+                zapping = false;
+            }
+            if (metric_get(&m->bytes_written) == 0) first_audio(shared, m);
+            metric_add(&m->bytes_written, n);
+            metric_add(&m->packets_written, 1);
+            if (sink->splice)
+                inflight += n;       // 页挂在管道里，读走之后才能还给接收线程
+            else
+                ring_buffer_read_commit(&shared->rb, n); // 尽早把空间还给接收线程
+        } else if (n == 0) {
+            continue;                // 刚退回 write()
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (sink_wait(sink, WRITER_RECLAIM_MS) < 0) {
+                perror("output");
+                shared->stop_flag = true;
             }
-            shared->packets_written++;
+        } else if (errno != EINTR) {
+            perror("output");
+            shared->stop_flag = true;
         }
     }
     
     printf("Writer thread exiting\n");
     pthread_exit(NULL);
-}
\ No newline at end of file
+}
@@ -3,8 +3,11 @@
 #include <sys/types.h>       // 新增：size_t类型
 #include "client.h"          // 新增：包含client.h以获取struct ring_buffer定义
 
+#define WRITER_LOW_MS 0       // 播放器手里的数据不多于它超过攒批时间就算欠载，0 表示完全放空
+#define WRITER_HIGH_MS 200    // 开始播放和欠载之后先攒够这么多毫秒的音频
+#define WRITER_RESUME_HIGH_MS 20 // 从缓存直接续播时的默认高水位
+#define WRITER_BATCH_MS 20    // 攒够这么多毫秒的数据或等满这么久才写一次
 
 void* writer_thread(void* arg);
-int ring_buffer_read(struct ring_buffer *rb, void *data, size_t max_len);
 
 #endif
\ No newline at end of file
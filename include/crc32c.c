@@ -0,0 +1,70 @@
+/*
+CRC32C 校验：x86 上用 SSE4.2 的 crc32 指令每次处理 8 字节，
+运行时检测 CPU，不支持时回退到查表实现。客户端和服务端共用。
+*/
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78 // 反射多项式
+
+static uint32_t crc_table[256];
+static uint32_t (*crc_impl)(uint32_t, const unsigned char *, size_t);
+static pthread_once_t once_init = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_table_update(uint32_t crc, const unsigned char *p, size_t len) {
+  while (len--)
+    crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw_update(uint32_t crc, const unsigned char *p, size_t len) {
+  uint64_t crc64 = crc;
+  uint64_t v;
+
+  // 先按字节对齐到 8 字节边界，再每次处理 8 字节
+  while (len > 0 && ((uintptr_t)p & 7)) {
+    crc64 = _mm_crc32_u8((uint32_t)crc64, *p++);
+    len--;
+  }
+  while (len >= 8) {
+    memcpy(&v, p, 8);
+    crc64 = _mm_crc32_u64(crc64, v);
+    p += 8;
+    len -= 8;
+  }
+  while (len--)
+    crc64 = _mm_crc32_u8((uint32_t)crc64, *p++);
+  return (uint32_t)crc64;
+}
+#endif
+
+static void module_load(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+    crc_table[i] = c;
+  }
+  crc_impl = crc32c_table_update;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2"))
+    crc_impl = crc32c_hw_update;
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len) {
+  pthread_once(&once_init, module_load);
+  return ~crc_impl(~crc, buf, len);
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len) {
+  pthread_once(&once_init, module_load);
+  return ~crc32c_table_update(~crc, buf, len);
+}
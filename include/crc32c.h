@@ -0,0 +1,12 @@
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli)，crc 传 0 开始，可以分段累加：crc = crc32c(crc, buf, len)
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+// 查表实现，不依赖 CPU 指令，用于回退和测试对照
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len);
+
+#endif // CRC32C_H_
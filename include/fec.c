@@ -0,0 +1,233 @@
+/*
+FEC 编解码内核：GF(256)（多项式 0x11D）上的乘加。
+向量实现用 pshufb 查两张 16 项的半字节乘法表，每次处理 16/32 字节，
+运行时检测 CPU，不支持时回退到 64KB 乘法表的标量实现。客户端和服务端共用。
+*/
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fec.h"
+
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+static uint8_t gf_mul_table[256][256];
+static void (*mul_add_impl)(uint8_t *, const uint8_t *, uint8_t, size_t);
+static pthread_once_t once_init = PTHREAD_ONCE_INIT;
+
+static uint8_t gf_mul(uint8_t a, uint8_t b) { return gf_mul_table[a][b]; }
+
+static uint8_t gf_inv(uint8_t a) { return gf_exp[255 - gf_log[a]]; }
+
+static void xor_region(uint8_t *dst, const uint8_t *src, size_t len) {
+  uint64_t d, s;
+  for (; len >= 8; len -= 8, dst += 8, src += 8) {
+    memcpy(&d, dst, 8);
+    memcpy(&s, src, 8);
+    d ^= s;
+    memcpy(dst, &d, 8);
+  }
+  while (len--)
+    *dst++ ^= *src++;
+}
+
+void fec_mul_add_sw(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+  const uint8_t *row;
+
+  if (c == 0)
+    return;
+  if (c == 1) {
+    xor_region(dst, src, len);
+    return;
+  }
+  row = gf_mul_table[c];
+  for (size_t i = 0; i < len; i++)
+    dst[i] ^= row[src[i]];
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// c 乘以低/高半字节的结果表
+static void nibble_tables(uint8_t c, uint8_t lo[16], uint8_t hi[16]) {
+  for (int x = 0; x < 16; x++) {
+    lo[x] = gf_mul(c, x);
+    hi[x] = gf_mul(c, x << 4);
+  }
+}
+
+__attribute__((target("ssse3")))
+static void mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+  uint8_t lo[16], hi[16];
+  __m128i tlo, thi, mask, s, p;
+
+  if (c <= 1) {
+    fec_mul_add_sw(dst, src, c, len);
+    return;
+  }
+  nibble_tables(c, lo, hi);
+  tlo = _mm_loadu_si128((const __m128i *)lo);
+  thi = _mm_loadu_si128((const __m128i *)hi);
+  mask = _mm_set1_epi8(0x0f);
+  for (; len >= 16; len -= 16, dst += 16, src += 16) {
+    s = _mm_loadu_si128((const __m128i *)src);
+    p = _mm_xor_si128(_mm_shuffle_epi8(tlo, _mm_and_si128(s, mask)),
+                      _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+    _mm_storeu_si128((__m128i *)dst,
+                     _mm_xor_si128(_mm_loadu_si128((const __m128i *)dst), p));
+  }
+  fec_mul_add_sw(dst, src, c, len);
+}
+
+__attribute__((target("avx2")))
+static void mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+  uint8_t lo[16], hi[16];
+  __m256i tlo, thi, mask, s, p;
+
+  if (c == 0)
+    return;
+  if (c == 1) {
+    for (; len >= 32; len -= 32, dst += 32, src += 32)
+      _mm256_storeu_si256((__m256i *)dst,
+                          _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)dst),
+                                           _mm256_loadu_si256((const __m256i *)src)));
+    xor_region(dst, src, len);
+    return;
+  }
+  nibble_tables(c, lo, hi);
+  tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lo));
+  thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hi));
+  mask = _mm256_set1_epi8(0x0f);
+  for (; len >= 32; len -= 32, dst += 32, src += 32) {
+    s = _mm256_loadu_si256((const __m256i *)src);
+    p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, _mm256_and_si256(s, mask)),
+                         _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+    _mm256_storeu_si256((__m256i *)dst,
+                        _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)dst), p));
+  }
+  fec_mul_add_sw(dst, src, c, len);
+}
+#endif
+
+static void module_load(void) {
+  unsigned int x = 1;
+
+  for (int i = 0; i < 255; i++) {
+    gf_exp[i] = x;
+    gf_log[x] = i;
+    x <<= 1;
+    if (x & 0x100)
+      x ^= 0x11D;
+  }
+  for (int i = 255; i < 512; i++)
+    gf_exp[i] = gf_exp[i - 255];
+  for (int a = 0; a < 256; a++)
+    for (int b = 0; b < 256; b++)
+      gf_mul_table[a][b] = (a && b) ? gf_exp[gf_log[a] + gf_log[b]] : 0;
+
+  mul_add_impl = fec_mul_add_sw;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2"))
+    mul_add_impl = mul_add_avx2;
+  else if (__builtin_cpu_supports("ssse3"))
+    mul_add_impl = mul_add_ssse3;
+#endif
+}
+
+void fec_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+  pthread_once(&once_init, module_load);
+  mul_add_impl(dst, src, c, len);
+}
+
+uint8_t fec_coef(int n, int k, int row, int col) {
+  pthread_once(&once_init, module_load);
+  if (k == 1)
+    return 1; // 单个校验包退化为 XOR
+  // Cauchy 矩阵 1/(x_row + y_col)，x = n..n+k-1，y = 0..n-1，任意方阵子阵都可逆
+  return gf_inv((uint8_t)((n + row) ^ col));
+}
+
+void fec_encode_add(int n, int k, uint8_t **parity, int col, const uint8_t *sym,
+                    size_t len) {
+  for (int j = 0; j < k; j++)
+    fec_mul_add(parity[j], sym, fec_coef(n, k, j, col), len);
+}
+
+// GF(256) 上的 Gauss-Jordan 求逆，m 为 e×e 矩阵（行主序），结果写回 inv
+static int gf_invert(uint8_t *m, uint8_t *inv, int e) {
+  memset(inv, 0, e * e);
+  for (int i = 0; i < e; i++)
+    inv[i * e + i] = 1;
+  for (int col = 0; col < e; col++) {
+    int pivot = col;
+    while (pivot < e && m[pivot * e + col] == 0)
+      pivot++;
+    if (pivot == e)
+      return -1;
+    if (pivot != col) {
+      for (int j = 0; j < e; j++) {
+        uint8_t t = m[col * e + j];
+        m[col * e + j] = m[pivot * e + j];
+        m[pivot * e + j] = t;
+        t = inv[col * e + j];
+        inv[col * e + j] = inv[pivot * e + j];
+        inv[pivot * e + j] = t;
+      }
+    }
+    uint8_t scale = gf_inv(m[col * e + col]);
+    for (int j = 0; j < e; j++) {
+      m[col * e + j] = gf_mul(m[col * e + j], scale);
+      inv[col * e + j] = gf_mul(inv[col * e + j], scale);
+    }
+    for (int i = 0; i < e; i++) {
+      uint8_t f = m[i * e + col];
+      if (i == col || f == 0)
+        continue;
+      for (int j = 0; j < e; j++) {
+        m[i * e + j] ^= gf_mul(f, m[col * e + j]);
+        inv[i * e + j] ^= gf_mul(f, inv[col * e + j]);
+      }
+    }
+  }
+  return 0;
+}
+
+int fec_decode(int n, int k, uint8_t **data, const uint8_t *data_ok,
+               uint8_t **parity, const uint8_t *parity_ok, size_t len) {
+  int missing[FEC_MAX_K], rows[FEC_MAX_K];
+  uint8_t m[FEC_MAX_K * FEC_MAX_K], inv[FEC_MAX_K * FEC_MAX_K];
+  int e = 0, r = 0;
+
+  pthread_once(&once_init, module_load);
+  for (int i = 0; i < n; i++) {
+    if (!data_ok[i]) {
+      if (e == k)
+        return -1;
+      missing[e++] = i;
+    }
+  }
+  if (e == 0)
+    return 0;
+  for (int j = 0; j < k && r < e; j++)
+    if (parity_ok[j])
+      rows[r++] = j;
+  if (r < e)
+    return -1;
+
+  // 从校验符号中减去已知数据的贡献，剩下的只与缺失的数据有关
+  for (int a = 0; a < e; a++) {
+    for (int i = 0; i < n; i++)
+      if (data_ok[i])
+        fec_mul_add(parity[rows[a]], data[i], fec_coef(n, k, rows[a], i), len);
+    for (int b = 0; b < e; b++)
+      m[a * e + b] = fec_coef(n, k, rows[a], missing[b]);
+  }
+  if (gf_invert(m, inv, e) < 0)
+    return -1;
+  for (int b = 0; b < e; b++) {
+    memset(data[missing[b]], 0, len);
+    for (int a = 0; a < e; a++)
+      fec_mul_add(data[missing[b]], parity[rows[a]], inv[b * e + a], len);
+  }
+  return 0;
+}
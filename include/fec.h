@@ -0,0 +1,33 @@
+#ifndef FEC_H_
+#define FEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+分组前向纠错：每 n 个数据包生成 k 个校验包，任意丢失不超过 k 个都能恢复。
+k == 1 时就是 XOR 校验，k > 1 时是 GF(256) 上的 Cauchy Reed-Solomon 码。
+符号 = 2字节数据长度(网络字节序) + 数据，按组内最长的符号补0对齐。
+*/
+#define FEC_MAX_N 64
+#define FEC_MAX_K 16
+#define FEC_LEN_SIZE 2 // 符号前面的长度字段
+
+// 第 row 个校验包中第 col 个数据符号的系数
+uint8_t fec_coef(int n, int k, int row, int col);
+// dst ^= c * src（GF(256)），按 CPU 支持选择 AVX2/SSSE3/标量实现
+void fec_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+// 标量实现，用于回退和测试对照
+void fec_mul_add_sw(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+// 把第 col 个数据符号累加进 k 个校验符号，len 为该符号长度
+void fec_encode_add(int n, int k, uint8_t **parity, int col, const uint8_t *sym,
+                    size_t len);
+/*
+恢复缺失的数据符号：data_ok[i]==0 的位置会被写入恢复结果，
+所有 data[i] 和 parity[j] 都是 len 字节（不足的已补0）。
+校验缓冲区会被用作临时空间。成功返回 0，校验包不够返回 -1。
+*/
+int fec_decode(int n, int k, uint8_t **data, const uint8_t *data_ok,
+               uint8_t **parity, const uint8_t *parity_ok, size_t len);
+
+#endif // FEC_H_
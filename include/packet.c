@@ -0,0 +1,54 @@
+#include <arpa/inet.h>
+#include <string.h>
+#include <time.h>
+
+#include "crc32c.h"
+#include "packet.h"
+
+uint32_t packet_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+// 校验和覆盖 checksum 置0后的包头和 data
+static uint32_t packet_crc(const struct msg_channel_st *msg, size_t data_len) {
+  struct packet_header hdr = msg->hdr;
+  uint32_t crc;
+
+  hdr.checksum = 0;
+  crc = crc32c(0, &hdr, sizeof(hdr));
+  return crc32c(crc, msg->data, data_len);
+}
+
+size_t packet_seal(struct msg_channel_st *msg, chnid_t chnid, uint32_t seq,
+                   size_t data_len) {
+  return packet_seal_magic(msg, PACKET_MAGIC, chnid, seq, data_len);
+}
+
+size_t packet_seal_magic(struct msg_channel_st *msg, uint32_t magic, chnid_t chnid,
+                         uint32_t seq, size_t data_len) {
+  msg->hdr.magic = htonl(magic);
+  msg->hdr.sequence = htonl(seq);
+  msg->hdr.timestamp = htonl(packet_now_ms());
+  msg->hdr.channel_id = htons(chnid);
+  msg->hdr.data_len = htons(data_len);
+  msg->hdr.checksum = htonl(packet_crc(msg, data_len));
+  return sizeof(struct packet_header) + data_len;
+}
+
+int packet_verify(const struct msg_channel_st *msg, size_t len) {
+  size_t data_len;
+
+  if (len < sizeof(struct packet_header))
+    return PACKET_ESHORT;
+  if (ntohl(msg->hdr.magic) != PACKET_MAGIC &&
+      ntohl(msg->hdr.magic) != PACKET_MAGIC_FEC)
+    return PACKET_EMAGIC;
+  data_len = ntohs(msg->hdr.data_len);
+  if (data_len != len - sizeof(struct packet_header))
+    return PACKET_ELEN;
+  if (ntohl(msg->hdr.checksum) != packet_crc(msg, data_len))
+    return PACKET_ECRC;
+  return PACKET_OK;
+}
@@ -0,0 +1,30 @@
+#ifndef PACKET_H_
+#define PACKET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "proto.h"
+
+// packet_verify() 的返回值
+enum
+{
+  PACKET_OK = 0,
+  PACKET_ESHORT = -1, // 比包头还短
+  PACKET_EMAGIC = -2, // 魔数不对，不是我们的数据包
+  PACKET_ELEN = -3,   // data_len 与实际长度不符
+  PACKET_ECRC = -4    // 校验和错误，数据损坏
+};
+
+// 当前墙上时间（毫秒，截断为32位），用于 packet_header.timestamp
+uint32_t packet_now_ms(void);
+// 填写包头并计算校验和，返回整个数据包的长度
+size_t packet_seal(struct msg_channel_st *msg, chnid_t chnid, uint32_t seq,
+                   size_t data_len);
+// 同上，指定魔数（PACKET_MAGIC 或 PACKET_MAGIC_FEC）
+size_t packet_seal_magic(struct msg_channel_st *msg, uint32_t magic, chnid_t chnid,
+                         uint32_t seq, size_t data_len);
+// 校验收到的数据包（数据包或校验包），成功返回 PACKET_OK
+int packet_verify(const struct msg_channel_st *msg, size_t len);
+
+#endif // PACKET_H_
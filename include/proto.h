@@ -1,6 +1,7 @@
 #ifndef PROTO_H_
 #define PROTO_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define DEFAULT_MGROUP "224.2.2.2" // default multicast group 多播组
@@ -12,24 +13,58 @@
 #define MAXCHNID (MINCHNID + CHANNUM - 1) // maximum channel id
 
 #define MSG_CHANNEL_MAX ((1<<16)-20-8) // 20:IP package head, 8:udp package head  udp包的最大长度    
-#define MAX_DATA (MSG_CHANNEL_MAX - sizeof(chnid_t))   //最大data包的大小
+#define MAX_DATA (MSG_CHANNEL_MAX - sizeof(struct packet_header))   //最大data包的大小
 
 #define MSG_LIST_MAX ((1<<16)-20-8)
+#define MSG_LIST_HDR offsetof(struct msg_list_st, entry) // 节目单包头（信标只有包头）
+#define LIST_PAGE_MAX MAX_DATA_SIZE // 每一页节目单的最大长度，避免IP分片
+#define LIST_PAGES_MAX 255          // 节目单最多的页数
 #define MAX_ENTRY (MSG_CHANNEL_MAX - sizeof(chnid_t)) //节目单包的最大大小
 
 #define PACKET_MAGIC 0xABCD1234
+#define PACKET_MAGIC_FEC 0xABCD12FE // 校验包的魔数
+#define PACKET_MAGIC_NACK 0xABCD12AC // 客户端请求重传的魔数
+#define NACK_MAX_SEQ 64 // 一个 NACK 最多请求的序列号个数
 #define MAX_DATA_SIZE 1400  // 避免IP分片
 #define SEQUENCE_WINDOW 100 // 序列号窗口大小
 
 #include "site_type.h"
-// 每一个频道内容结构体： 频道号，data(指针)
+// 数据包头部结构
+// 多字节字段都是网络字节序，checksum 是 CRC32C(头部(checksum置0) + data)
+struct packet_header {
+    uint32_t magic;        // 魔数，用于验证包的有效性 0xABCD1234
+    uint32_t sequence;     // 序列号
+    uint32_t timestamp;    // 时间戳（毫秒）
+    uint16_t channel_id;   // 频道ID must between MINCHNID MAXCHNID
+    uint16_t data_len;     // 数据长度
+    uint32_t checksum;     // 校验和
+} __attribute__((packed));
+
+// 每一个频道内容结构体： 包头（频道号、序列号等），data
+// 第一个字节是 magic 的高字节(0xAB)，不会与节目单的 LISTCHNID 混淆
 struct msg_channel_st
 {
-  uint32_t seq;//序列号
-  chnid_t chnid; // must between MINCHNID MAXCHNID  频道号
+  struct packet_header hdr;
   uint8_t data[1];
 }__attribute__((packed)); // do not align
 
+// 校验包：packet_header(magic 为 PACKET_MAGIC_FEC，sequence 为分组第一个数据包的序列号)
+// + fec_header + 校验符号，data_len 包含 fec_header
+struct fec_header {
+    uint8_t n;             // 分组的数据包数
+    uint8_t k;             // 分组的校验包数
+    uint8_t index;         // 本校验包在分组内的序号 0..k-1
+    uint8_t reserved;
+} __attribute__((packed));
+
+// 客户端单播给服务端的重传请求（网络字节序），服务端用原数据包（单播或多播）应答
+struct msg_nack_st {
+    uint32_t magic;        // PACKET_MAGIC_NACK
+    uint16_t channel_id;   // 频道ID
+    uint16_t count;        // seq 的个数，不超过 NACK_MAX_SEQ
+    uint32_t seq[1];       // 缺失的序列号
+} __attribute__((packed));
+
 // 每一条节目项包含的信息：chnid len desc
 struct msg_listentry_st
 {
@@ -39,22 +74,20 @@ struct msg_listentry_st
   //uint8_t desc[1]; // 频道的描述信息
 }__attribute__((packed)); // do not align
 
-// 节目单频道内容 chnid len desc
+#define LIST_TYPE_FULL 1   // 完整节目单
+#define LIST_TYPE_BEACON 2 // 信标：只有版本和哈希，客户端据此判断是否需要重新接收
+
+// 节目单频道内容 chnid type version hash page pages + 节目项
+// 完整节目单按页发送，每页只包含完整的节目项，客户端收齐所有页后校验 hash
 struct msg_list_st
 {
   chnid_t chnid; // must be LISTCHNID 0
+  uint8_t type;      // LIST_TYPE_FULL / LIST_TYPE_BEACON
+  uint32_t version;  // 节目单版本（网络字节序），内容变化时改变
+  uint32_t hash;     // 全部节目项（所有页拼接）的 CRC32C（网络字节序）
+  uint8_t page;      // 本页序号 0..pages-1
+  uint8_t pages;     // 总页数，信标中也填写
   struct msg_listentry_st entry[1];
 }__attribute__((packed)); // do not align
 
-
-// 数据包头部结构
-struct packet_header {
-    uint32_t magic;        // 魔数，用于验证包的有效性 0xABCD1234
-    uint32_t sequence;     // 序列号
-    uint32_t timestamp;    // 时间戳（毫秒）
-    uint16_t channel_id;   // 频道ID
-    uint16_t data_len;     // 数据长度
-    uint32_t checksum;     // 校验和
-} __attribute__((packed));
-
 #endif // PROTO_H_
@@ -7,7 +7,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/time.h>
-#include <signal.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "mytbf.h"
@@ -19,9 +19,10 @@ struct mytbf_st {
   int burst;
   int token;
   int pos;
+  int64_t last; // 上一次补充令牌的时刻（时钟源的微秒）
   /*
   为什么需要：每个令牌桶的token值可能被多个线程访问：
-  用户线程(获取/返还令牌)和定时器线程(添加令牌)。不加锁会导致令牌计数不准确。
+  用户线程(获取/返还令牌)。不加锁会导致令牌计数不准确。
   */
   pthread_mutex_t mut;
   pthread_cond_t cond;
@@ -29,66 +30,55 @@ struct mytbf_st {
 
 static struct mytbf_st *job[MYTBF_MAX];
 /*为什么需要：因为job[]是全局共享资源，可能被多线程同时访问，
-如主线程和定时器线程。不加锁保护会导致race condition，可能出现数据竞争。 */
+不加锁保护会导致race condition，可能出现数据竞争。 */
 static pthread_mutex_t mut_job = PTHREAD_MUTEX_INITIALIZER; 
 
-static pthread_once_t once_init = PTHREAD_ONCE_INIT;//指定的初始化函数只被执行一次，即使有多个线程同时调用
-static pthread_t tid;
-
-static void alrm_handle(int sig) {
-  pthread_mutex_lock(&mut_job);
-    for (int i = 0; i < MYTBF_MAX; ++i) {
-      if (job[i] != NULL) {
-        pthread_mutex_lock(&job[i]->mut);
-        job[i]->token += job[i]->cps;
-        if (job[i]->token > job[i]->burst) {
-          job[i]->token = job[i]->burst;
-        }
-        pthread_cond_broadcast(&job[i]->cond); // 惊群
-        pthread_mutex_unlock(&job[i]->mut);
-      }
-    }
-    pthread_mutex_unlock(&mut_job);
+static int64_t clock_monotonic_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
-//这是后台定时器线程的主函数 启动一个每秒触发一次 SIGALRM 信号的定时器，首次触发在 1 秒后。
-static void *thr_alrm(void *p) {
-  struct itimerval tick;
-  memset(&tick, 0, sizeof(tick));
-  tick.it_value.tv_sec = 1;  // sec
-  tick.it_value.tv_usec = 0; // micro sec.
-  tick.it_interval.tv_sec = 1;
-  tick.it_interval.tv_usec = 0;
+static mytbf_clock_t *clk_now = clock_monotonic_us; // 当前时钟源
 
-  signal(SIGALRM, alrm_handle);
-  setitimer(ITIMER_REAL, &tick, NULL);//启动实时定时器。 ITIMER_REAL：基于真实时间（系统时钟），到期时发送 SIGALRM 信号。
-
-  while (1) {
-    pause();
-  }
+void mytbf_setclock(mytbf_clock_t *clk) {
+  clk_now = clk ? clk : clock_monotonic_us;
 }
 
-// 模块卸载函数
-static void module_unload() {
-  int i;
-  pthread_cancel(tid);
-  pthread_join(tid, NULL);
-
-  for (int i = 0; i < MYTBF_MAX; i++) {
-    free(job[i]);
-  }
-  return;
+/*
+按时钟源补充令牌（调用者持有 me->mut）。
+不再依赖 setitimer + SIGALRM：每次访问令牌桶时按经过的整周期数补充，
+语义与原来每秒补充一次 cps 相同，但可以用模拟时钟驱动。
+*/
+static void refill_unlocked(struct mytbf_st *me) {
+  int64_t now = clk_now();
+  int64_t n, token;
+
+  if (now - me->last < MYTBF_PERIOD_US)
+    return;
+  n = (now - me->last) / MYTBF_PERIOD_US;
+  me->last += n * MYTBF_PERIOD_US;
+  token = me->token + n * me->cps;
+  me->token = token > me->burst ? me->burst : token;
 }
 
-// 模块加载函数
-static void module_load() {
-  int err;
-  err = pthread_create(&tid, NULL, thr_alrm, NULL);
-  if (err) {
-    fprintf(stderr, "pthread_create():%s", strerror(errno));
-    exit(1);
+// 等待到下一个补充周期（默认时钟下精确到期，模拟时钟下最多等一个周期后重新检查）
+static void wait_refill_unlocked(struct mytbf_st *me) {
+  struct timespec ts;
+  int64_t wait_us = me->last + MYTBF_PERIOD_US - clk_now();
+
+  if (wait_us < 1000)
+    wait_us = 1000;
+  if (wait_us > MYTBF_PERIOD_US)
+    wait_us = MYTBF_PERIOD_US;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += wait_us / 1000000;
+  ts.tv_nsec += (wait_us % 1000000) * 1000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
   }
-  atexit(module_unload);//是C标准库函数，用于注册一个函数，该函数会在程序正常终止时被调用
+  pthread_cond_timedwait(&me->cond, &me->mut, &ts);
 }
 
 static int get_free_pos_unlocked() {
@@ -103,11 +93,9 @@ static int get_free_pos_unlocked() {
 // 初始化一个令牌桶
 mytbf_t *mytbf_init(int cps, int burst) {
   struct mytbf_st *me;
-
-  module_load();                         // 开启定时token派发
-  pthread_once(&once_init, module_load); // 限定只开启一次
-
+  pthread_condattr_t attr;
   int pos;
+
   // 初始化mytbf
   me = malloc(sizeof(*me));
   if (me == NULL) {
@@ -116,8 +104,12 @@ mytbf_t *mytbf_init(int cps, int burst) {
   me->cps = cps;
   me->burst = burst;
   me->token = 0;
+  me->last = clk_now();
   pthread_mutex_init(&me->mut, NULL); // 初始化该令牌桶的mutex
-  pthread_cond_init(&me->cond, NULL); // 初始化该令牌桶的conditional variable
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC); // 超时等待基于单调时钟
+  pthread_cond_init(&me->cond, &attr); // 初始化该令牌桶的conditional variable
+  pthread_condattr_destroy(&attr);
   pthread_mutex_lock(&mut_job);
 
   pos = get_free_pos_unlocked();
@@ -138,8 +130,11 @@ int mytbf_fetchtoken(mytbf_t *ptr, int size) {
   int n;
   struct mytbf_st *me = ptr;
   pthread_mutex_lock(&me->mut); //什么时候别人会和你一样在访问token
-  while (me->token <= 0)
-    pthread_cond_wait(&me->cond, &me->mut); // 没有令牌的时候 等待信号量通知
+  refill_unlocked(me);
+  while (me->token <= 0) {
+    wait_refill_unlocked(me); // 没有令牌的时候 等到下一个补充周期
+    refill_unlocked(me);
+  }
   n = min(me->token, size);
   me->token -= n; 
   pthread_cond_broadcast(&me->cond);
@@ -150,6 +145,7 @@ int mytbf_fetchtoken(mytbf_t *ptr, int size) {
 int mytbf_returntoken(mytbf_t *ptr, int size) {
   struct mytbf_st *me = ptr;
   pthread_mutex_lock(&me->mut);
+  refill_unlocked(me);
   me->token += size;
   if (me->token > me->burst)
     me->token = me->burst;
@@ -173,6 +169,7 @@ int mytbf_checktoken(mytbf_t *ptr) {
   int token_left = 0;
   struct mytbf_st *me = ptr;
   pthread_mutex_lock(&me->mut);
+  refill_unlocked(me);
   token_left = me->token;
   pthread_mutex_unlock(&me->mut);
   return token_left;
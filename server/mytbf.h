@@ -1,9 +1,18 @@
 #ifndef MYTBF_H_
 #define MYTBF_H_
 
+#include <stdint.h>
+
 #define MYTBF_MAX 1024
+#define MYTBF_PERIOD_US 1000000 // 每个补充周期（微秒），每周期补充 cps 个令牌
 typedef void mytbf_t;
 
+// 时钟源：返回单调递增的时间（微秒）
+typedef int64_t mytbf_clock_t(void);
+
+// 替换时钟源，NULL 恢复默认的 CLOCK_MONOTONIC；需在 mytbf_init() 之前调用
+void mytbf_setclock(mytbf_clock_t *clk);
+
 mytbf_t *mytbf_init(int cps, int burst);
 int mytbf_fetchtoken(mytbf_t *, int);
 int mytbf_returntoken(mytbf_t *, int);
@@ -0,0 +1,164 @@
+/*
+令牌桶取/还令牌的竞争微基准。
+每次操作模拟一次 mlib_readchn()：fetchtoken + checktoken + returntoken，
+在 1..N 个线程 × 1..1024 个令牌桶的组合上测 ns/op 和吞吐量，
+结果以 CSV 输出到 stdout，便于脚本比较不同实现之间的回归。
+只依赖 mytbf.h 的公共接口，因此可以链接任意一个实现（见 Makefile 的 TBF_IMPL）。
+*/
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mytbf.h"
+
+#define FETCH_SIZE (320 * 1024 / 8) // 与 thr_channel_snder() 每次请求的大小一致
+#define BURST (1 << 30)             // 足够大，基准过程中永远不会因缺令牌而阻塞
+#define DEFAULT_DURATION_MS 200
+
+static const int bucket_counts[] = {1, 4, 16, 64, 256, 1024};
+
+struct bench_arg_st {
+  mytbf_t **tbf;
+  int nbucket;
+  uint32_t seed;
+  long long ops;
+};
+
+static volatile int bench_stop;
+static pthread_barrier_t bench_barrier;
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t xorshift32(uint32_t *s) {
+  *s ^= *s << 13;
+  *s ^= *s >> 17;
+  *s ^= *s << 5;
+  return *s;
+}
+
+static void *thr_bench(void *p) {
+  struct bench_arg_st *arg = p;
+  long long ops = 0;
+  int n;
+
+  pthread_barrier_wait(&bench_barrier);
+  while (!bench_stop) {
+    // 每轮64次操作再检查一次停止标志，减少对共享变量的读取
+    for (int i = 0; i < 64; i++) {
+      mytbf_t *tbf = arg->tbf[xorshift32(&arg->seed) % arg->nbucket];
+      n = mytbf_fetchtoken(tbf, FETCH_SIZE);
+      mytbf_checktoken(tbf);
+      mytbf_returntoken(tbf, n);
+    }
+    ops += 64;
+  }
+  arg->ops = ops;
+  return NULL;
+}
+
+static int bench_run(const char *impl, int nthread, int nbucket, int duration_ms) {
+  mytbf_t *tbf[MYTBF_MAX];
+  pthread_t tid[nthread];
+  struct bench_arg_st arg[nthread];
+  long long total = 0;
+  double start, elapsed;
+  int i;
+
+  for (i = 0; i < nbucket; i++) {
+    tbf[i] = mytbf_init(FETCH_SIZE, BURST);
+    if (tbf[i] == NULL) {
+      fprintf(stderr, "mytbf_init() failed\n");
+      return -1;
+    }
+    mytbf_returntoken(tbf[i], BURST); // 直接填满，不依赖补充周期
+  }
+
+  bench_stop = 0;
+  pthread_barrier_init(&bench_barrier, NULL, nthread + 1);
+  for (i = 0; i < nthread; i++) {
+    arg[i].tbf = tbf;
+    arg[i].nbucket = nbucket;
+    arg[i].seed = 2463534242u + i * 7919;
+    arg[i].ops = 0;
+    if (pthread_create(&tid[i], NULL, thr_bench, &arg[i]) != 0) {
+      perror("pthread_create()");
+      exit(1);
+    }
+  }
+  pthread_barrier_wait(&bench_barrier);
+  start = now_sec();
+  usleep(duration_ms * 1000);
+  bench_stop = 1;
+  for (i = 0; i < nthread; i++) {
+    pthread_join(tid[i], NULL);
+    total += arg[i].ops;
+  }
+  elapsed = now_sec() - start;
+  pthread_barrier_destroy(&bench_barrier);
+
+  for (i = 0; i < nbucket; i++)
+    mytbf_destroy(tbf[i]);
+
+  // ns_per_op 是单个线程看到的每次操作耗时，mops 是所有线程合计吞吐
+  printf("%s,%d,%d,%lld,%.3f,%.1f,%.3f\n", impl, nthread, nbucket, total,
+         elapsed, elapsed * 1e9 * nthread / total, total / elapsed / 1e6);
+  fflush(stdout);
+  return 0;
+}
+
+static void print_help(void) {
+  printf("-t    max thread count (default: online cpus)\n");
+  printf("-d    duration of each case in ms\n");
+  printf("-n    implementation name in the report\n");
+  printf("-H    show help\n");
+}
+
+int main(int argc, char **argv) {
+  int max_thread = sysconf(_SC_NPROCESSORS_ONLN);
+  int duration_ms = DEFAULT_DURATION_MS;
+  const char *impl = "mytbf";
+  int c;
+
+  while ((c = getopt(argc, argv, "t:d:n:H")) >= 0) {
+    switch (c) {
+    case 't':
+      max_thread = atoi(optarg);
+      break;
+    case 'd':
+      duration_ms = atoi(optarg);
+      break;
+    case 'n':
+      impl = optarg;
+      break;
+    case 'H':
+      print_help();
+      exit(0);
+    default:
+      print_help();
+      exit(1);
+    }
+  }
+  if (max_thread < 1)
+    max_thread = 1;
+
+  printf("impl,threads,buckets,ops,seconds,ns_per_op,mops\n");
+  for (int t = 1;; t *= 2) {
+    if (t > max_thread)
+      t = max_thread; // 线程数按 1,2,4... 递增，最后一档取 max_thread
+    for (size_t b = 0; b < sizeof(bucket_counts) / sizeof(bucket_counts[0]); b++) {
+      if (bench_run(impl, t, bucket_counts[b], duration_ms) < 0)
+        exit(1);
+    }
+    if (t >= max_thread)
+      break;
+  }
+  exit(0);
+}
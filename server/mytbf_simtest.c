@@ -0,0 +1,132 @@
+/*
+令牌桶的确定性模拟测试：用模拟时钟替换 CLOCK_MONOTONIC，
+几毫秒内跑完数小时、上千个令牌桶的补充/取令牌流量，
+并以数字形式检查速率精度、突发上限和公平性。
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mytbf.h"
+
+#define NBUCKET 1000         // 令牌桶数量（MYTBF_MAX 以内）
+#define SIM_SECONDS 3600     // 模拟时长：1小时
+#define STEP_US 250000       // 每一步推进的模拟时间
+#define BURST_PERIODS 5      // burst = cps * 5，与 medialib 一致
+#define RATE_TOLERANCE 0.001 // 速率相对误差上限
+#define FAIRNESS_MIN 0.999   // Jain 公平指数下限
+
+static int64_t sim_now; // 模拟时钟（微秒）
+
+static int64_t sim_clock(void) { return sim_now; }
+
+static int failures;
+
+static void check(int ok, const char *what) {
+  if (!ok) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+// 只在有令牌时取，单线程下 mytbf_fetchtoken() 不会阻塞
+static int try_fetch(mytbf_t *tbf, int size) {
+  if (mytbf_checktoken(tbf) <= 0)
+    return 0;
+  return mytbf_fetchtoken(tbf, size);
+}
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// 贪婪消费者：每一步都尽量取，消耗速率应等于 cps
+static void test_rate_and_fairness(void) {
+  static mytbf_t *tbf[NBUCKET];
+  static long long consumed[NBUCKET];
+  static int cps[NBUCKET];
+  double worst_err = 0, sum = 0, sumsq = 0, jain;
+  long long ops = 0;
+  int i;
+
+  sim_now = 0;
+  for (i = 0; i < NBUCKET; i++) {
+    cps[i] = 4096 + (i * 37) % 40960; // 不同频道不同码率
+    tbf[i] = mytbf_init(cps[i], cps[i] * BURST_PERIODS);
+    consumed[i] = 0;
+  }
+  // 按步推进模拟时钟
+  for (int64_t t = STEP_US; t <= (int64_t)SIM_SECONDS * 1000000; t += STEP_US) {
+    sim_now = t;
+    for (i = 0; i < NBUCKET; i++) {
+      // 每次请求量小于 cps，模拟 mlib_readchn 的分块读取
+      int n;
+      while ((n = try_fetch(tbf[i], cps[i] / 3 + 1)) > 0) {
+        consumed[i] += n;
+        ops++;
+      }
+    }
+  }
+  for (i = 0; i < NBUCKET; i++) {
+    double expect = (double)cps[i] * SIM_SECONDS;
+    double err = (consumed[i] - expect) / expect;
+    double share = consumed[i] / expect;
+    if (err < 0)
+      err = -err;
+    if (err > worst_err)
+      worst_err = err;
+    sum += share;
+    sumsq += share * share;
+    mytbf_destroy(tbf[i]);
+  }
+  jain = sum * sum / (NBUCKET * sumsq);
+  printf("rate: buckets=%d sim_seconds=%d fetches=%lld worst_rel_err=%.6f\n",
+         NBUCKET, SIM_SECONDS, ops, worst_err);
+  printf("fairness: jain_index=%.6f\n", jain);
+  check(worst_err <= RATE_TOLERANCE, "token rate deviates from cps");
+  check(jain >= FAIRNESS_MIN, "buckets are not served fairly");
+}
+
+// 空闲后令牌不能超过 burst，返还令牌也不能超过 burst
+static void test_burst(void) {
+  const int rate = 40960;
+  const int burst = rate * BURST_PERIODS;
+  mytbf_t *tbf;
+  int max_seen = 0, n, got;
+
+  sim_now = 0;
+  tbf = mytbf_init(rate, burst);
+  for (int idle = 1; idle <= 600; idle *= 2) {
+    sim_now += (int64_t)idle * 1000000;
+    n = mytbf_checktoken(tbf);
+    if (n > max_seen)
+      max_seen = n;
+    got = try_fetch(tbf, burst * 10);
+    check(got == (idle < BURST_PERIODS ? idle * rate : burst),
+          "fetch after idle does not match refill");
+    mytbf_returntoken(tbf, got * 2);
+    check(mytbf_checktoken(tbf) <= burst, "returntoken exceeds burst");
+    try_fetch(tbf, burst * 10);
+  }
+  // 不足一个周期不补充
+  sim_now += MYTBF_PERIOD_US - 1;
+  check(mytbf_checktoken(tbf) == 0, "refill before a full period");
+  mytbf_destroy(tbf);
+  printf("burst: limit=%d max_seen=%d\n", burst, max_seen);
+  check(max_seen <= burst, "tokens exceed burst after idle");
+}
+
+int main(void) {
+  double start = now_ms();
+
+  mytbf_setclock(sim_clock);
+  test_burst();
+  test_rate_and_fairness();
+  mytbf_setclock(NULL);
+
+  printf("elapsed_ms=%.1f failures=%d\n", now_ms() - start, failures);
+  return failures ? 1 : 0;
+}
@@ -9,6 +9,7 @@
 #include <signal.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -18,10 +19,12 @@
 #include <unistd.h>
 
 #include "../include/proto.h"
+#include "../include/fec.h"
 #include "medialib.h"
 #include "server_conf.h"
 #include "thr_channel.h"
 #include "thr_list.h"
+#include "thr_repair.h"
 
 int serversd;
 struct sockaddr_in sndaddr;
@@ -38,6 +41,10 @@ static void print_help() {
   printf("-F    specify foreground runmode \n");
   printf("-D    specify medialib location \n");
   printf("-I    specify net card\n");
+  printf("-f    enable FEC, N:K sends K parity packets per N data packets\n"
+         "      (parity follows the N-th packet, about N s per channel: clients need -L above that)\n");
+  printf("-R    answer NACK repairs, limited to the given KB/s (at least %d)\n",
+         REPAIR_RATE_MIN_KB);
   printf("-H    show help\n");
 }
 
@@ -45,6 +52,7 @@ static void print_help() {
 static void daemon_exit(int s) {
   thr_list_destroy();
   thr_channel_destroyall();
+  thr_repair_destroy();
   mlib_freechnlist(list);
   syslog(LOG_WARNING, "signal-%d caught, exit now.", s);
   closelog();
@@ -130,7 +138,7 @@ int main(int argc, char** argv) {
 
 /*命令行参数分析 */
   while(1) {
-    c = getopt(argc, argv, "M:P:FD:I:H");
+    c = getopt(argc, argv, "M:P:FD:I:Hf:R:");
     if(isalpha(c))
       printf("get command c:%c\n", c);
     if (c < 0) {
@@ -151,6 +159,25 @@ int main(int argc, char** argv) {
     case 'I':
       server_conf.ifname = optarg;
       break;
+    case 'f':
+      if (sscanf(optarg, "%d:%d", &server_conf.fec_n, &server_conf.fec_k) != 2 ||
+          server_conf.fec_n < 1 || server_conf.fec_n > FEC_MAX_N ||
+          server_conf.fec_k < 1 || server_conf.fec_k > FEC_MAX_K) {
+        fprintf(stderr, "invalid FEC ratio %s (N:K, N<=%d, K<=%d)\n", optarg,
+                FEC_MAX_N, FEC_MAX_K);
+        exit(1);
+      }
+      break;
+    case 'R':
+      server_conf.repair_rate = atoi(optarg);
+      if (server_conf.repair_rate < REPAIR_RATE_MIN_KB ||
+          server_conf.repair_rate > INT_MAX / 1024) {
+        fprintf(stderr, "invalid repair rate %s (KB/s, at least %d to pass one packet)\n",
+                optarg, REPAIR_RATE_MIN_KB);
+        exit(1);
+      }
+      server_conf.repair_rate *= 1024;
+      break;
     case 'H':
       print_help();
       exit(0);
@@ -189,6 +216,12 @@ int main(int argc, char** argv) {
     exit(1);
   }
 
+  /*create repair thread, before channel threads use the history*/
+  if (thr_repair_create() < 0) {
+    syslog(LOG_ERR, "thr_repair_create() failed.");
+    exit(1);
+  }
+
   /*create programme thread*/
   thr_list_create(list, list_size);
   /*if error*/
@@ -17,6 +17,9 @@ struct server_conf_st
   char *media_dir;
   char runmode;
   char *ifname;
+  int fec_n; // 每 fec_n 个数据包发送 fec_k 个校验包，0 表示不启用 FEC
+  int fec_k;
+  int repair_rate; // NACK 重传的带宽上限（字节/秒），0 表示不应答重传
 };
 
 extern struct server_conf_st server_conf;
@@ -16,6 +16,9 @@
 #include "medialib.h"
 #include "server_conf.h"
 #include "../include/proto.h"
+#include "../include/packet.h"
+#include "../include/fec.h"
+#include "thr_repair.h"
 // #include "reliablesender.h"
 static int tid_nextpos = 0;
 
@@ -27,23 +30,92 @@ struct thr_channel_entry_st {
 
 struct thr_channel_entry_st thr_channel[CHANNUM];
 
+// 每个频道的 FEC 编码状态：边发送边把数据累加进校验符号，不需要保留数据包
+struct fec_enc_st {
+  int n, k;
+  size_t maxlen;                          // 当前分组最长的数据长度
+  struct msg_channel_st *pkt[FEC_MAX_K];  // 校验包
+  uint8_t *sym[FEC_MAX_K];                // 校验符号：长度字段 + 数据
+  uint8_t *symdata[FEC_MAX_K];            // 校验符号的数据部分
+};
+
+static int fec_enc_init(struct fec_enc_st *fe, int n, int k) {
+  fe->n = n;
+  fe->k = k;
+  fe->maxlen = 0;
+  for (int j = 0; j < k; j++) {
+    fe->pkt[j] = calloc(1, MSG_CHANNEL_MAX);
+    if (fe->pkt[j] == NULL)
+      return -1;
+    fe->sym[j] = fe->pkt[j]->data + sizeof(struct fec_header);
+    fe->symdata[j] = fe->sym[j] + FEC_LEN_SIZE;
+  }
+  return 0;
+}
+
+// 第 seq 个数据包累加进校验符号，分组最后一个包发出后发送 k 个校验包
+static void fec_enc_add(struct fec_enc_st *fe, chnid_t chnid, uint32_t seq,
+                        const uint8_t *data, size_t len) {
+  int col = seq % fe->n;
+  uint8_t lenbuf[FEC_LEN_SIZE] = {len >> 8, len & 0xff};
+  size_t symlen;
+
+  fec_encode_add(fe->n, fe->k, fe->sym, col, lenbuf, FEC_LEN_SIZE);
+  fec_encode_add(fe->n, fe->k, fe->symdata, col, data, len);
+  if (len > fe->maxlen)
+    fe->maxlen = len;
+  if (col != fe->n - 1)
+    return;
+
+  symlen = FEC_LEN_SIZE + fe->maxlen;
+  for (int j = 0; j < fe->k; j++) {
+    struct fec_header *fh = (void *)fe->pkt[j]->data;
+    size_t pktlen;
+    fh->n = fe->n;
+    fh->k = fe->k;
+    fh->index = j;
+    fh->reserved = 0;
+    pktlen = packet_seal_magic(fe->pkt[j], PACKET_MAGIC_FEC, chnid, seq - col,
+                               sizeof(struct fec_header) + symlen);
+    if (sendto(serversd, fe->pkt[j], pktlen, 0, (void *)&sndaddr, sizeof(sndaddr)) < 0)
+      syslog(LOG_WARNING, "thr_channel(%d):sendto(fec):%s", chnid, strerror(errno));
+    memset(fe->sym[j], 0, symlen);
+  }
+  fe->maxlen = 0;
+}
+
+static void fec_enc_destroy(struct fec_enc_st *fe) {
+  for (int j = 0; j < fe->k; j++)
+    free(fe->pkt[j]);
+}
+
 static void *thr_channel_snder(void *ptr)
 {
   uint32_t sequence_number = 0; // 静态变量，保持递增
   struct msg_channel_st *sbufp;
+  struct msg_channel_st *ownbuf; // 未启用重传时使用的发送缓冲区
   int len;
   struct mlib_listentry_st *entry = ptr;//void *-> struct mlib_listentry_st *
-  sbufp = malloc(MSG_CHANNEL_MAX);
-  if (sbufp == NULL) 
+  struct fec_enc_st fec = {0};
+  ownbuf = malloc(MSG_CHANNEL_MAX);
+  if (ownbuf == NULL) 
   {
     syslog(LOG_ERR, "malloc():%s", strerror(errno));
     exit(1);
   }
-  sbufp->chnid = entry->chnid; // 频道号处理
+  if (server_conf.fec_n > 0 &&
+      fec_enc_init(&fec, server_conf.fec_n, server_conf.fec_k) < 0)
+  {
+    syslog(LOG_ERR, "fec_enc_init():%s", strerror(errno));
+    exit(1);
+  }
   // 频道内容读取
   while(1) 
   {
-    sbufp->seq=sequence_number;
+    // 启用重传时直接在历史槽位里组包，重传不需要再拷贝
+    sbufp = repair_hist_acquire(entry->chnid, sequence_number);
+    if (sbufp == NULL)
+      sbufp = ownbuf;
     syslog(LOG_INFO, "开始");
     len = mlib_readchn(entry->chnid, sbufp->data, 320*1024/8); // 320kbit/s
     syslog(LOG_DEBUG, "读取的字节数: %d bytes", len);
@@ -51,17 +123,23 @@ static void *thr_channel_snder(void *ptr)
     {
       break;
     }
-    if (sendto(serversd, sbufp, len + sizeof(chnid_t)+sizeof(uint32_t), 0, (void*)&sndaddr, sizeof(sndaddr)) < 0) {
+    len = packet_seal(sbufp, entry->chnid, sequence_number, len); // 填写包头和校验和
+    if (sendto(serversd, sbufp, len, 0, (void*)&sndaddr, sizeof(sndaddr)) < 0) {
       syslog(LOG_ERR, "thr_channel(%d):sendto():%s", entry->chnid,
              strerror(errno));
       break;
     }
+    if (sbufp != ownbuf)
+      repair_hist_commit(entry->chnid, sequence_number, len);
+    if (fec.n > 0)
+      fec_enc_add(&fec, entry->chnid, sequence_number, sbufp->data,
+                  len - sizeof(struct packet_header));
     // 记录日志
     char time_str[64];
     time_t now = time(NULL);
     strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&now));
     syslog(LOG_INFO, "current channel :%d:[%s] Sent packet with sequence: %u, length: %zu\n",entry->chnid,time_str, sequence_number, 
-     sizeof(uint32_t) + sizeof(chnid_t) + len);
+     (size_t)len);
 
     sequence_number++;
     sched_yield();//出让调度器
@@ -77,6 +155,8 @@ static void *thr_channel_snder(void *ptr)
     // }
     // 移除 sched_yield() - 速率控制已内置
   }
+  fec_enc_destroy(&fec);
+  free(ownbuf);
   pthread_exit(NULL);
 }
 
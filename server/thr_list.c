@@ -8,9 +8,11 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../include/proto.h"
+#include "../include/crc32c.h"
 #include "medialib.h"
 #include "server_conf.h"
 #include "thr_list.h"
@@ -18,52 +20,90 @@
 static pthread_t tid_list; // 线程
 static int num_list_entry;//频道总数
 static struct mlib_listentry_st *list_entry; // 频道列表
+static uint32_t list_version; // 节目单版本，内容变化时递增
 
-static void *thr_list(void *p) {
-  int totalsize;
-  struct msg_list_st *entrylistptr; //节目单结构体
-  struct msg_listentry_st *entryptr;//频道结构体
-  int ret;
-  int size;
+#define LIST_BEACON_US 100000  // 信标发送间隔
+#define LIST_FULL_INTERVAL 3   // 没有变化时完整节目单的刷新间隔（秒）
 
-  totalsize = sizeof(chnid_t); // 之后逐步累计节目单的大小
-  for (int i = 0; i < num_list_entry; ++i) {
-    totalsize += sizeof(struct msg_listentry_st) + strlen(list_entry[i].desc);
+static void list_send(const void *buf, int size) {
+  if (sendto(serversd, buf, size, 0, (void *)&sndaddr, sizeof(sndaddr)) < 0) {
+    syslog(LOG_WARNING, "sendto(serversd, enlistp...:%s", strerror(errno));
   }
-  entrylistptr = malloc(totalsize);
-  if (entrylistptr == NULL) {
-    syslog(LOG_ERR, "malloc():%s", strerror(errno));
-    exit(1);
-  }
-  entrylistptr->chnid = LISTCHNID; // 这是节目单频道号 0
+}
 
-  entryptr = entrylistptr->entry;//将节目单的频道结构体的地址赋给频道结构体指针
+static void *thr_list(void *p) {
+  struct msg_list_st *pagebuf[LIST_PAGES_MAX]; //节目单的每一页
+  int pagesize[LIST_PAGES_MAX];                //每一页的长度
+  int npage = 0;
+  struct msg_listentry_st *entryptr;//频道结构体
+  struct msg_list_st beacon;        //信标，只有包头
+  int size;
+  uint32_t hash = 0;
+  uint32_t sent_version = 0;        //上一次发送完整节目单时的版本
+  struct timespec last_full = {0}, now;
 
   syslog(LOG_DEBUG, "num_list_entry:%d\n", num_list_entry);
-  
+
+  // 按页组装节目单：每页不超过 LIST_PAGE_MAX，节目项不跨页
   for (int i = 0; i < num_list_entry; ++i) {
     size = sizeof(struct msg_listentry_st) + strlen(list_entry[i].desc);//size是一个频道的大小
-
+    if (MSG_LIST_HDR + size > LIST_PAGE_MAX) {
+      syslog(LOG_WARNING, "desc of channel %d is too long, skipped", list_entry[i].chnid);
+      continue;
+    }
+    if (npage == 0 || pagesize[npage - 1] + size > LIST_PAGE_MAX) {
+      if (npage == LIST_PAGES_MAX) {
+        syslog(LOG_WARNING, "too many channels, list truncated at %d", i);
+        break;
+      }
+      pagebuf[npage] = malloc(LIST_PAGE_MAX);
+      if (pagebuf[npage] == NULL) {
+        syslog(LOG_ERR, "malloc():%s", strerror(errno));
+        exit(1);
+      }
+      pagebuf[npage]->chnid = LISTCHNID; // 这是节目单频道号 0
+      pagebuf[npage]->type = LIST_TYPE_FULL;
+      pagebuf[npage]->page = npage;
+      pagesize[npage] = MSG_LIST_HDR;
+      npage++;
+    }
+    entryptr = (void *)((char *)pagebuf[npage - 1] + pagesize[npage - 1]);
     entryptr->chnid = list_entry[i].chnid;
     entryptr->len = htons(size);
     strcpy(entryptr->desc, list_entry[i].desc);
-     // 在移动指针之前打印
-    syslog(LOG_DEBUG, "entry[%d] len:%hu", i, ntohs(entryptr->len));
-    entryptr = (void *)(((char *)entryptr) + size); // 向后移动entptr
+    syslog(LOG_DEBUG, "entry[%d] page:%d len:%hu", i, npage - 1, ntohs(entryptr->len));
+    hash = crc32c(hash, entryptr, size); // 哈希覆盖所有页拼接起来的节目项
+    pagesize[npage - 1] += size;
+  }
 
+  for (int i = 0; i < npage; i++) {
+    pagebuf[i]->version = htonl(list_version);
+    pagebuf[i]->hash = htonl(hash);
+    pagebuf[i]->pages = npage;
   }
+  beacon.chnid = LISTCHNID;
+  beacon.type = LIST_TYPE_BEACON;
+  beacon.version = htonl(list_version);
+  beacon.hash = htonl(hash);
+  beacon.page = 0;
+  beacon.pages = npage;
+  syslog(LOG_DEBUG, "list version:%u pages:%d", list_version, npage);
 
+  /*
+  节目单很少变化：高频发送几个字节的信标（版本+哈希），
+  完整节目单只在版本变化时立即发送，否则低频刷新给新加入的客户端。
+  */
   while (1) {
-    syslog(LOG_INFO, "thr_list sndaddr :%d\n", sndaddr.sin_addr.s_addr);//#include "server_conf.h"中声明了此处可以直接使用
-    ret = sendto(serversd, entrylistptr, totalsize, 0, (void *)&sndaddr,
-                 sizeof(sndaddr)); // 频道列表在广播网段每秒发送entrylist
-    syslog(LOG_DEBUG, "sent content len:%d\n", entrylistptr->entry->len);
-    if (ret < 0) {
-      syslog(LOG_WARNING, "sendto(serversd, enlistp...:%s", strerror(errno));
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (sent_version != list_version || now.tv_sec - last_full.tv_sec >= LIST_FULL_INTERVAL) {
+      for (int i = 0; i < npage; i++)
+        list_send(pagebuf[i], pagesize[i]);
+      sent_version = list_version;
+      last_full = now;
     } else {
-      syslog(LOG_DEBUG, "sendto(serversd, enlistp....):success");
+      list_send(&beacon, MSG_LIST_HDR);
     }
-    sleep(1);
+    usleep(LIST_BEACON_US);
   }
 }
 
@@ -72,6 +112,7 @@ int thr_list_create(struct mlib_listentry_st *listptr, int num_ent) {
   int err;
   list_entry = listptr;
   num_list_entry = num_ent;
+  list_version = time(NULL); // 以启动时间作为初始版本，服务端重启后客户端也能发现变化
   syslog(LOG_DEBUG, "list content: chnid:%d, desc:%s", listptr->chnid,
          listptr->desc);
   err = pthread_create(&tid_list, NULL, thr_list, NULL);
@@ -0,0 +1,210 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/proto.h"
+#include "mytbf.h"
+#include "server_conf.h"
+#include "thr_repair.h"
+
+#define REPAIR_STAT_INTERVAL 10 // 每隔多少秒记录一次重传统计
+
+// 历史槽位：频道线程直接在 pkt 里组包，发送后登记 seq/len，重传时原样发出
+struct repair_slot_st {
+  struct msg_channel_st *pkt;
+  uint32_t seq;
+  size_t len;          // 0 表示槽位正在组包或为空
+  int64_t last_ms;     // 上一次重传的时刻
+  struct sockaddr_in last_to; // 上一次重传的客户端
+  int mcast_done;      // 这段时间内已经多播过
+};
+
+struct repair_hist_st {
+  pthread_mutex_t mut;
+  struct repair_slot_st slot[REPAIR_HISTORY];
+};
+
+// 重传流量单独统计，不混在频道流量里
+struct repair_stat_st {
+  long nacks;       // 收到的 NACK 报文
+  long requests;    // 请求的序列号个数
+  long sent;        // 单播重传的包数
+  long mcast;       // 多个客户端请求同一个包，改为多播的包数
+  long bytes;       // 重传的字节数
+  long suppressed;  // 短时间内重复请求，被抑制的个数
+  long ratelimited; // 超过重传带宽，被丢弃的个数
+  long miss;        // 已不在历史中的个数
+};
+
+static int repair_enabled;
+static pthread_t tid_repair;
+static struct repair_hist_st hist[MAXCHNID + 1];
+static mytbf_t *repair_tbf; // 重传带宽限制，避免挤占正常频道
+static struct repair_stat_st repair_stat;
+
+static int64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+struct msg_channel_st *repair_hist_acquire(chnid_t chnid, uint32_t seq) {
+  struct repair_slot_st *slot;
+
+  if (!repair_enabled)
+    return NULL;
+  slot = &hist[chnid].slot[seq % REPAIR_HISTORY];
+  pthread_mutex_lock(&hist[chnid].mut);
+  slot->len = 0; // 组包期间不能被重传
+  pthread_mutex_unlock(&hist[chnid].mut);
+  if (slot->pkt == NULL) {
+    slot->pkt = malloc(MSG_CHANNEL_MAX);
+    if (slot->pkt == NULL)
+      syslog(LOG_ERR, "malloc():%s", strerror(errno));
+  }
+  return slot->pkt;
+}
+
+void repair_hist_commit(chnid_t chnid, uint32_t seq, size_t len) {
+  struct repair_slot_st *slot = &hist[chnid].slot[seq % REPAIR_HISTORY];
+
+  pthread_mutex_lock(&hist[chnid].mut);
+  slot->seq = seq;
+  slot->len = len;
+  slot->last_ms = 0;
+  slot->mcast_done = 0;
+  pthread_mutex_unlock(&hist[chnid].mut);
+}
+
+// 按重传带宽发送，令牌不足直接放弃
+static int repair_send(const struct msg_channel_st *pkt, size_t len,
+                       const struct sockaddr_in *to) {
+  if (mytbf_checktoken(repair_tbf) < (int)len) {
+    repair_stat.ratelimited++;
+    return -1;
+  }
+  mytbf_fetchtoken(repair_tbf, len);
+  if (sendto(serversd, pkt, len, 0, (void *)to, sizeof(*to)) < 0) {
+    syslog(LOG_WARNING, "thr_repair:sendto():%s", strerror(errno));
+    return -1;
+  }
+  repair_stat.bytes += len;
+  return 0;
+}
+
+static void repair_one(chnid_t chnid, uint32_t seq, const struct sockaddr_in *from) {
+  struct repair_hist_st *h = &hist[chnid];
+  struct repair_slot_st *slot = &h->slot[seq % REPAIR_HISTORY];
+  int64_t now = now_ms();
+
+  pthread_mutex_lock(&h->mut);
+  if (slot->len == 0 || slot->seq != seq) {
+    repair_stat.miss++;
+  } else if (slot->last_ms == 0 || now - slot->last_ms >= REPAIR_HOLDOFF_MS) {
+    // 第一次请求：单播给请求者
+    if (repair_send(slot->pkt, slot->len, from) == 0) {
+      repair_stat.sent++;
+      slot->last_ms = now;
+      slot->last_to = *from;
+      slot->mcast_done = 0;
+    }
+  } else if (!slot->mcast_done &&
+             (slot->last_to.sin_addr.s_addr != from->sin_addr.s_addr ||
+              slot->last_to.sin_port != from->sin_port)) {
+    // 另一个客户端也丢了这个包：多播一次，覆盖所有人
+    if (repair_send(slot->pkt, slot->len, &sndaddr) == 0) {
+      repair_stat.mcast++;
+      slot->mcast_done = 1;
+    }
+  } else {
+    repair_stat.suppressed++;
+  }
+  pthread_mutex_unlock(&h->mut);
+}
+
+static void *thr_repair(void *p) {
+  char buf[sizeof(struct msg_nack_st) + NACK_MAX_SEQ * sizeof(uint32_t)];
+  struct msg_nack_st *nack = (void *)buf;
+  struct sockaddr_in from;
+  socklen_t fromlen;
+  struct pollfd pfd = {.fd = serversd, .events = POLLIN};
+  time_t last_stat = time(NULL);
+  int len, count, chnid;
+
+  while (1) {
+    if (time(NULL) - last_stat >= REPAIR_STAT_INTERVAL) {
+      syslog(LOG_INFO,
+             "repair: nacks=%ld requests=%ld sent=%ld mcast=%ld bytes=%ld "
+             "suppressed=%ld ratelimited=%ld miss=%ld",
+             repair_stat.nacks, repair_stat.requests, repair_stat.sent,
+             repair_stat.mcast, repair_stat.bytes, repair_stat.suppressed,
+             repair_stat.ratelimited, repair_stat.miss);
+      last_stat = time(NULL);
+    }
+    if (poll(&pfd, 1, 1000) <= 0)
+      continue;
+    fromlen = sizeof(from);
+    len = recvfrom(serversd, buf, sizeof(buf), 0, (void *)&from, &fromlen);
+    if (len < (int)(sizeof(struct msg_nack_st) - sizeof(uint32_t)))
+      continue;
+    if (ntohl(nack->magic) != PACKET_MAGIC_NACK)
+      continue;
+    chnid = ntohs(nack->channel_id);
+    count = ntohs(nack->count);
+    if (chnid < MINCHNID || chnid > MAXCHNID || count > NACK_MAX_SEQ ||
+        len < (int)(sizeof(struct msg_nack_st) + (count - 1) * sizeof(uint32_t)))
+      continue;
+    repair_stat.nacks++;
+    for (int i = 0; i < count; i++) {
+      repair_stat.requests++;
+      repair_one(chnid, ntohl(nack->seq[i]), &from);
+    }
+  }
+  pthread_exit(NULL);
+}
+
+// 创建重传线程，必须在频道线程之前调用
+int thr_repair_create(void) {
+  int err, burst;
+
+  if (server_conf.repair_rate <= 0)
+    return 0;
+  for (int i = 0; i <= MAXCHNID; i++)
+    pthread_mutex_init(&hist[i].mut, NULL);
+  // 一个重传包可能有 64KB，桶容量按包算，不能只等于每秒的速率
+  burst = server_conf.repair_rate;
+  if (burst < REPAIR_BURST_PKTS * MSG_CHANNEL_MAX)
+    burst = REPAIR_BURST_PKTS * MSG_CHANNEL_MAX;
+  repair_tbf = mytbf_init(server_conf.repair_rate, burst);
+  if (repair_tbf == NULL) {
+    syslog(LOG_ERR, "mytbf_init():%s", strerror(errno));
+    return -1;
+  }
+  repair_enabled = 1;
+  err = pthread_create(&tid_repair, NULL, thr_repair, NULL);
+  if (err) {
+    syslog(LOG_ERR, "pthread_create():%s", strerror(err));
+    repair_enabled = 0;
+    return -1;
+  }
+  return 0;
+}
+
+int thr_repair_destroy(void) {
+  if (!repair_enabled)
+    return 0;
+  pthread_cancel(tid_repair);
+  pthread_join(tid_repair, NULL);
+  repair_enabled = 0;
+  return 0;
+}
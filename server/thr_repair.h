@@ -0,0 +1,23 @@
+#ifndef THR_REPAIR_H_
+#define THR_REPAIR_H_
+
+// NACK 重传：每个频道保留最近发送的数据包，应答客户端的单播重传请求
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/proto.h"
+
+#define REPAIR_HISTORY 8     // 每个频道保留的最近数据包个数
+#define REPAIR_HOLDOFF_MS 200 // 同一个包在这段时间内只重传一次（第二个客户端请求时改为多播）
+#define REPAIR_BURST_PKTS 4  // 令牌桶至少攒得下这么多个最大的数据包，连丢几个包时能一起补上
+#define REPAIR_RATE_MIN_KB ((MSG_CHANNEL_MAX + 1023) / 1024) // -R 的下限：每秒至少能重传一个最大的数据包
+
+int thr_repair_create(void);
+int thr_repair_destroy(void);
+// 取序列号 seq 对应的历史槽位，频道线程直接在里面组包；未启用重传时返回 NULL
+struct msg_channel_st *repair_hist_acquire(chnid_t chnid, uint32_t seq);
+// 数据包已发送，len 为整个数据包的长度，之后才能被重传
+void repair_hist_commit(chnid_t chnid, uint32_t seq, size_t len);
+
+#endif // THR_REPAIR_H_